@@ -241,7 +241,141 @@ void read_frequencies_from_huff(const char* filename, uint32_t freq[256]) {
     fclose(file);
 }
 
-// --- Декодирование с использованием дерева ---
+// --- Табличный декодер ---
+// Вместо прохода по дереву бит за битом строим таблицу: первые 11 бит потока
+// сразу дают символ и длину его кода, длинные коды уходят в подтаблицы.
+// Элемент таблицы: биты 0-5 — сколько бит снять, 6-9 — ширина подтаблицы
+// (0 у листа), 10-31 — символ или смещение подтаблицы.
+#define TABLE_BITS 11
+#define SUBTABLE_BITS 8
+#define MAX_CODE_LEN 56
+#define IO_CHUNK (256 * 1024)
+
+void collect_words(Node* node, uint64_t word, int depth, uint64_t* words, uint8_t* lens, int* max_len) {
+    if (!node) return;
+    if (!node->left && !node->right) {
+        words[node->symbol] = word;
+        lens[node->symbol] = (uint8_t)(depth < 255 ? depth : 255);
+        if (depth > *max_len) *max_len = depth;
+        return;
+    }
+    collect_words(node->left, word << 1, depth + 1, words, lens, max_len);
+    collect_words(node->right, (word << 1) | 1, depth + 1, words, lens, max_len);
+}
+
+uint32_t fill_level(uint32_t** table, uint32_t* size, uint32_t base, int width, int consumed,
+                    const int* syms, int n, const uint64_t* words, const uint8_t* lens) {
+    for (int i = 0; i < n; i++) {                       //короткие коды — листья с повторением
+        int s = syms[i];
+        int rem = lens[s] - consumed;
+        if (rem > width) continue;
+        uint32_t start = (uint32_t)((words[s] & ((1ull << rem) - 1)) << (width - rem));
+        for (uint32_t j = 0; j < (1u << (width - rem)); j++)
+            (*table)[base + start + j] = ((uint32_t)s << 10) | (uint32_t)rem;
+    }
+
+    int group[256];
+    for (int i = 0; i < n; i++) {                       //длинные — группами по префиксу в подтаблицы
+        int rem = lens[syms[i]] - consumed;
+        if (rem <= width) continue;
+        uint32_t prefix = (uint32_t)(words[syms[i]] >> (rem - width)) & ((1u << width) - 1);
+        if ((*table)[base + prefix]) continue;
+
+        int count = 0, longest = 0;
+        for (int j = i; j < n; j++) {
+            int r = lens[syms[j]] - consumed;
+            if (r > width && ((uint32_t)(words[syms[j]] >> (r - width)) & ((1u << width) - 1)) == prefix) {
+                group[count++] = syms[j];
+                if (r - width > longest) longest = r - width;
+            }
+        }
+        int sub = longest < SUBTABLE_BITS ? longest : SUBTABLE_BITS;
+        uint32_t offset = *size;
+        *size += 1u << sub;
+        *table = (uint32_t*)realloc(*table, *size * sizeof(uint32_t));
+        memset(*table + offset, 0, (1u << sub) * sizeof(uint32_t));
+        (*table)[base + prefix] = (offset << 10) | ((uint32_t)sub << 6) | (uint32_t)width;
+        fill_level(table, size, offset, sub, consumed + width, group, count, words, lens);
+    }
+    return *size;
+}
+
+void decode_with_table(Node* root, FILE* in, FILE* out, uint64_t total_symbols) {
+    uint64_t words[256] = {0};
+    uint8_t lens[256] = {0};
+    int max_len = 0;
+    collect_words(root, 0, 0, words, lens, &max_len);
+    if (max_len > MAX_CODE_LEN) {
+        printf("Error: code too long for table decoding (%d bits)\n", max_len);
+        exit(1);
+    }
+
+    int syms[256], n = 0;
+    for (int i = 0; i < 256; i++) if (lens[i]) syms[n++] = i;
+    int root_bits = max_len < TABLE_BITS ? max_len : TABLE_BITS;
+    uint32_t size = 1u << root_bits;
+    uint32_t* table = (uint32_t*)calloc(size, sizeof(uint32_t));
+    fill_level(&table, &size, 0, root_bits, 0, syms, n, words, lens);
+
+    unsigned char* in_buf = (unsigned char*)malloc(IO_CHUNK);
+    unsigned char* out_buf = (unsigned char*)malloc(IO_CHUNK);
+    const unsigned char* p = in_buf;
+    const unsigned char* end = in_buf;
+    int at_eof = 0;
+    uint64_t bits = 0;                                  //биты потока, следующий — старший
+    int count = 0;                                      //сколько бит в bits
+    uint64_t decoded = 0;
+    size_t out_len = 0;
+
+    while (decoded < total_symbols) {
+        if (!at_eof && end - p < 8) {                   //дочитываем файл большими кусками
+            size_t rest = (size_t)(end - p);
+            memmove(in_buf, p, rest);
+            size_t got = fread(in_buf + rest, 1, IO_CHUNK - rest, in);
+            if (got < IO_CHUNK - rest) at_eof = 1;
+            p = in_buf;
+            end = in_buf + rest + got;
+        }
+
+        if (end - p >= 8) {                             //быстро: 8 байт за раз
+            uint64_t v = 0;
+            for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+            bits |= v >> count;
+            p += (63 - count) >> 3;
+            count |= 56;
+        } else {                                        //хвост: по байту, за концом — нули
+            while (count <= 56) {
+                uint64_t byte = (p < end) ? *p++ : 0;
+                bits |= byte << (56 - count);
+                count += 8;
+            }
+        }
+
+        do {                                            //снимаем символы, пока хватает бит
+            uint32_t e = table[bits >> (64 - root_bits)];
+            while ((e >> 6) & 15) {
+                bits <<= (e & 63);
+                count -= (int)(e & 63);
+                e = table[(e >> 10) + (bits >> (64 - ((e >> 6) & 15)))];
+            }
+            bits <<= (e & 63);
+            count -= (int)(e & 63);
+            out_buf[out_len++] = (unsigned char)(e >> 10);
+            decoded++;
+            if (out_len == IO_CHUNK) {
+                fwrite(out_buf, 1, out_len, out);
+                out_len = 0;
+            }
+        } while (count >= max_len && decoded < total_symbols);
+    }
+    fwrite(out_buf, 1, out_len, out);
+
+    free(in_buf);
+    free(out_buf);
+    free(table);
+}
+
+// --- Декодирование с использованием таблицы ---
 void decode_file(const char* encoded_filename, const char* output_filename) {
     // 1. Прочитать частоты
     uint32_t freq[256];
@@ -316,26 +450,11 @@ void decode_file(const char* encoded_filename, const char* output_filename) {
         fread(&dummy, sizeof(uint32_t), 1, in); // частота
     }
 
-    // 7. Декодируем биты, но ОСТАНАВЛИВАЕМСЯ по числу символов
+    // 7. Декодируем по таблице, но ОСТАНАВЛИВАЕМСЯ по числу символов
     uint64_t total_symbols = 0;
     for (int i = 0; i < 256; i++) total_symbols += freq[i];
 
-    Node* current = root;
-    uint64_t decoded = 0;
-    int byte;
-
-    while (decoded < total_symbols && (byte = fgetc(in)) != EOF) {
-        for (int i = 0; i < 8 && decoded < total_symbols; i++) {
-            int bit = (byte >> (7 - i)) & 1;
-            current = bit ? current->right : current->left;
-
-            if (!current->left && !current->right) {
-                fputc(current->symbol, out);
-                decoded++;
-                current = root;
-            }
-        }
-    }
+    decode_with_table(root, in, out, total_symbols);
 
     // 8. Закрываем и чистим
     fclose(in);
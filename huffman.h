@@ -2,7 +2,9 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 // Структура узла дерева Хаффмана
 typedef struct Node {
@@ -12,13 +14,262 @@ typedef struct Node {
     struct Node* right;       // Правый потомок (бит 1)
 } Node;
 
+// Код символа в упакованном виде
+typedef struct {
+    uint64_t word;            // Биты кода: младшие len бит, первым идёт старший
+    uint8_t len;              // Длина кода, 0 — символа нет
+} HuffCode;
+
+// --- Форматы .huff ---
+typedef enum {
+    HUFF_FORMAT_LEGACY = 1,     // Заголовок: символы и 32-битные частоты
+    HUFF_FORMAT_CANONICAL = 2,  // Заголовок: только длины канонических кодов
+    HUFF_FORMAT_BLOCKED = 3,    // Независимые блоки со своими таблицами
+    HUFF_FORMAT_ADAPTIVE = 4    // Без таблиц: модель учится по ходу, кадр на сброс
+} HuffFormat;
+
+// --- Статистика одного вызова ---
+typedef enum {
+    HUFF_PHASE_READ,            // Чтение входа
+    HUFF_PHASE_HISTOGRAM,       // Подсчёт частот (только кодирование)
+    HUFF_PHASE_TABLES,          // Коды, заголовки, таблицы декодирования
+    HUFF_PHASE_CODING,          // Кодирование или декодирование битов
+    HUFF_PHASE_WRITE,           // Запись выхода
+    HUFF_PHASE_COUNT
+} HuffPhase;
+
+// --- Ввод-вывод файлов ---
+typedef enum {
+    HUFF_IO_MAP = 0,            // Отображение в память; каналы читаются тем же потоком
+    HUFF_IO_THREADS,            // Поток чтения и поток записи с кольцами буферов,
+                                // pread/pwrite: кодер не ждёт диска
+    HUFF_IO_URING               // То же через io_uring с несколькими запросами сразу;
+                                // если ядро его не даёт — как HUFF_IO_THREADS
+} HuffIoMode;
+
+// Фазы, которые идут в пуле, считаются суммой по блокам: при нескольких
+// потоках их время может быть больше общего.
+typedef struct {
+    double wall[HUFF_PHASE_COUNT];  // Секунды по часам
+    double cpu[HUFF_PHASE_COUNT];   // Секунды процессора
+    double total_wall;
+    double total_cpu;               // Все потоки процесса
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t symbols;               // Исходных байтов
+    uint64_t bits;                  // Длина битовых потоков
+    uint64_t blocks;
+    uint64_t stored_blocks;         // Из них записаны как есть
+    uint64_t run_blocks;            // и сериями байтов
+    // Только при кодировании: сколько символов закодировано кодом каждой
+    // длины и сумма -log2 p по частотам (энтропия с теми же моделями)
+    uint64_t code_lengths[64];
+    double entropy_bits;
+} HuffStats;
+
+// Прогресс: done из total байт (total == 0 — неизвестно). Вызывается между
+// блоками или кусками не чаще раза в HUFF_PROGRESS_INTERVAL секунд и
+// ещё раз в конце.
+typedef void (*HuffProgressFn)(void* user, uint64_t done, uint64_t total);
+#define HUFF_PROGRESS_INTERVAL 0.1
+
+void huff_print_stats(FILE* f, const HuffStats* stats);
+
+// --- Параметры кодирования ---
+typedef struct {
+    HuffFormat format;          // По умолчанию HUFF_FORMAT_BLOCKED
+    int max_code_len;           // Предел длины кода, бит (0 — без предела);
+                                // в старом формате не действует
+    uint32_t block_size;        // Размер блока исходных данных (формат 3)
+    int threads;                // Потоков кодирования/декодирования (0 — по числу ядер)
+    int streams;                // Битовых потоков в блоке: 1 или 4 (формат 3)
+    int contexts;               // Кластеров таблиц по предыдущему байту, до 16
+                                // (формат 3; 0 — одна таблица на блок)
+    int checksum;               // CRC32C блоков и всего файла, декодер сверяет
+                                // (формат 3; по умолчанию 1)
+    uint32_t seek_interval;     // Шаг отметок для чтения куска с середины блока,
+                                // байт, не меньше 1 КБ (формат 3; 0 — без них)
+    HuffIoMode io;              // Как читать и писать файлы (по умолчанию HUFF_IO_MAP)
+    HuffStats* stats;           // Куда записывать статистику (NULL — не собирать)
+    HuffProgressFn progress;    // Отчёт о ходе работы (NULL — без него)
+    void* progress_user;
+} HuffOptions;
+
+#define HUFF_DEFAULT_MAX_CODE_LEN 12
+#define HUFF_DEFAULT_BLOCK_SIZE (1024 * 1024)
+#define HUFF_MIN_SEEK_INTERVAL 1024
+
+void huff_default_options(HuffOptions* options);
+
+// --- Коды ошибок ---
+typedef enum {
+    HUFF_OK = 0,
+    HUFF_ERROR_DST_TOO_SMALL = -1,  // Результат не помещается в dst
+    HUFF_ERROR_CORRUPT = -2,        // Вход повреждён или это не .huff
+    HUFF_ERROR_NO_MEMORY = -3,
+    HUFF_ERROR_READ = -4,           // Не удалось открыть или прочитать файл
+    HUFF_ERROR_WRITE = -5,          // Не удалось создать или записать файл
+    HUFF_ERROR_TOO_LARGE = -6       // Не помещается частота (формат 1) или число блоков (формат 3)
+} HuffError;
+
+const char* huff_error_string(int64_t code);
+
+// --- Сжатие в памяти ---
+// Контекст хранит параметры, пул потоков, буферы блоков и таблицы
+// декодирования между вызовами, поэтому его стоит создать один раз на
+// поток и переиспользовать. Функции ничего не печатают. Один контекст
+// нельзя использовать из нескольких потоков одновременно.
+typedef struct HuffContext HuffContext;
+
+HuffContext* huff_context_create(const HuffOptions* options);  // NULL — по умолчанию
+void huff_context_free(HuffContext* ctx);
+
+// Наибольший размер сжатых данных для src_len байт при параметрах ctx
+size_t huff_compress_bound(const HuffContext* ctx, size_t src_len);
+// Возвращают размер результата в dst или отрицательный HuffError
+int64_t huff_compress(HuffContext* ctx, const void* src, size_t src_len,
+                      void* dst, size_t dst_cap);
+int64_t huff_decompress(HuffContext* ctx, const void* src, size_t src_len,
+                        void* dst, size_t dst_cap);
+// Размер исходных данных по сжатым (или отрицательный HuffError)
+int64_t huff_decompressed_size(const void* src, size_t src_len);
+// Кусок [offset, offset + len) исходных данных формата 3: декодируются только
+// блоки куска, а с отметками (options.seek_interval) — от ближайшей отметки
+// перед offset, поэтому время не зависит от размера файла. Контрольные суммы
+// при этом не сверяются. Возвращает размер куска (за концом данных — меньше
+// len) или отрицательный HuffError.
+int64_t huff_decompress_range(HuffContext* ctx, const void* src, size_t src_len,
+                              uint64_t offset, void* dst, size_t len);
+
 // --- Основные функции кодирования/декодирования ---
-void encode_file(const char* input_filename, const char* output_filename);
-void decode_file(const char* encoded_filename, const char* output_filename);
+// decode_file читает все форматы, encode_file пишет формат по умолчанию.
+// Имя "-" означает stdin (вход) или stdout (выход). Блочный формат кодируется
+// за один проход с памятью на одну пачку блоков, поэтому годится для
+// каналов; форматам 1 и 2 нужен весь вход в памяти.
+// Работают через тот же контекст, что и функции в памяти, и печатают отчёт.
+HuffError encode_file(const char* input_filename, const char* output_filename);
+HuffError encode_file_ex(const char* input_filename, const char* output_filename,
+                         const HuffOptions* options);
+HuffError decode_file(const char* encoded_filename, const char* output_filename);
+HuffError decode_file_ex(const char* encoded_filename, const char* output_filename,
+                         const HuffOptions* options);
+// То же без отчёта, через контекст вызывающего (статистика — в его options.stats)
+HuffError huff_compress_file(HuffContext* ctx, const char* input_filename,
+                             const char* output_filename);
+HuffError huff_decompress_file(HuffContext* ctx, const char* encoded_filename,
+                               const char* output_filename);
+// Кусок [offset, offset + len) исходных данных, как huff_decompress_range;
+// файл должен быть обычным (не каналом)
+HuffError huff_decompress_file_range(HuffContext* ctx, const char* encoded_filename,
+                                     const char* output_filename, uint64_t offset,
+                                     uint64_t len);
+
+// --- Адаптивное сжатие потока сообщений ---
+// Кодер и декодер учат модель по уже пройденным символам, поэтому таблиц
+// в потоке нет и даже короткое сообщение не платит за заголовок. Каждый
+// вызов huff_adaptive_encode — сброс: он выдаёт кадр, который декодер
+// разворачивает сразу, не дожидаясь следующих. Кадры нужно декодировать
+// по порядку и без пропусков тем же потоком декодера. Кадр из пустого
+// сообщения означает конец потока. Это формат 4 без заголовка файла.
+typedef struct HuffAdaptive HuffAdaptive;
+
+HuffAdaptive* huff_adaptive_create(int decoder);   // 0 — кодер, 1 — декодер
+void huff_adaptive_free(HuffAdaptive* s);
+// Наибольший размер кадра из len байт
+size_t huff_adaptive_bound(size_t len);
+// Размер кадра в dst или отрицательный HuffError
+int64_t huff_adaptive_encode(HuffAdaptive* s, const void* src, size_t len,
+                             void* dst, size_t dst_cap);
+// Декодирует один кадр из начала src: возвращает его размер в dst или
+// HuffError, в *used — сколько байт src он занял. *used == 0 — кадр ещё
+// не пришёл целиком; 0 при *used > 0 — кадр конца потока.
+int64_t huff_adaptive_decode(HuffAdaptive* s, const void* src, size_t src_len,
+                             size_t* used, void* dst, size_t dst_cap);
+
+// --- Статические таблицы для коротких сообщений ---
+// Коды обучаются заранее на образцах (huff_static_train) и хранятся у обеих
+// сторон: в файле таблицы или в самой библиотеке. Сообщение несёт только
+// номер таблицы и длину, поэтому выгодно уже на десятках байт. Код есть у
+// всех 256 байтов, даже не встречавшихся в образцах; если код всё же не
+// сжал сообщение, оно записывается как есть с номером 0.
+typedef struct {
+    int id;                     // Номер таблицы в сообщениях, 1..255
+    uint8_t lens[256];          // Длины канонических кодов, не больше 12
+} HuffStaticTable;
+
+#define HUFF_STATIC_BUILTIN_TEXT 1  // Русский текст в cp1251
+
+// freq — частоты байтов образцов (например, сумма huff_histogram)
+void huff_static_train(HuffStaticTable* table, int id, const uint32_t* freq);
+// Встроенная таблица с номером id или NULL
+const HuffStaticTable* huff_static_builtin(int id);
+HuffError huff_static_save(const HuffStaticTable* table, const char* filename);
+HuffError huff_static_load(HuffStaticTable* table, const char* filename);
+
+// Коды и таблица декодирования одной таблицы. Не меняется при работе,
+// поэтому один объект можно делить между потоками.
+typedef struct HuffStaticCoder HuffStaticCoder;
+
+HuffStaticCoder* huff_static_create(const HuffStaticTable* table);
+void huff_static_free(HuffStaticCoder* coder);
+// Наибольший размер сообщения из len байт
+size_t huff_static_bound(size_t len);
+// Размер сообщения в dst или отрицательный HuffError
+int64_t huff_static_encode(const HuffStaticCoder* coder, const void* src, size_t len,
+                           void* dst, size_t dst_cap);
+// Номер таблицы, которой сжато сообщение (0 — лежит как есть, -1 — пусто)
+int huff_static_message_id(const void* src, size_t len);
+// Размер исходных данных в dst или отрицательный HuffError
+int64_t huff_static_decode(const HuffStaticCoder* coder, const void* src, size_t len,
+                           void* dst, size_t dst_cap);
+
+// --- Пакетная обработка файлов и каталогов ---
+// Файлы идут параллельно, по контексту на поток; потоки крадут друг у
+// друга задачи, поэтому большие файлы не задерживают остальные. Выход —
+// рядом со входом: a -> a.huff при сжатии, a.huff -> a при распаковке.
+typedef enum {
+    HUFF_BATCH_COMPRESS,
+    HUFF_BATCH_DECOMPRESS,
+    HUFF_BATCH_TEST             // Сжатие и распаковка в памяти со сверкой
+} HuffBatchMode;
+
+typedef struct {
+    HuffBatchMode mode;
+    int jobs;                   // Потоков (0 — по числу ядер)
+    int recursive;              // Обходить каталоги
+    int force;                  // Перезаписывать существующие выходы
+    int quiet;                  // Без строки на каждый файл
+    int stats;                  // Сводная статистика фаз в конце
+    const char* output;         // Имя выхода единственного входа (NULL — по суффиксу)
+    HuffOptions options;        // Параметры кодирования
+} HuffBatchOptions;
+
+void huff_default_batch_options(HuffBatchOptions* batch);
+// Возвращает число файлов с ошибками. Отчёт — в stdout, а если данные
+// идут в stdout ("-") — в stderr.
+int huff_batch(const HuffBatchOptions* batch, char* const* paths, int count);
+
+// --- Гистограмма байтов: freq[b] увеличивается на число байтов b в data ---
+// Считает в восемь подгистограмм, чтобы повторы байта не ждали друг друга.
+void huff_histogram(const uint8_t* data, size_t size, uint32_t* freq);
+// То же с 64-битными счётчиками: для входов больше 4 ГБ
+void huff_histogram64(const uint8_t* data, size_t size, uint64_t* freq);
+// Частоты для построения кодов: если сумма freq не помещается в 32 бита,
+// все частоты делятся на одну степень двойки с округлением (ненулевые
+// остаются ненулевыми), иначе копируются как есть. Возвращает сдвиг.
+int huff_scale_frequencies(const uint64_t* freq, uint32_t* scaled);
+
+// --- CRC32C (Кастаньоли), как у iSCSI и ext4 ---
+// crc — сумма предыдущих данных (0 в начале). На x86 с SSE4.2 считается
+// инструкцией crc32. combine даёт сумму A, за которыми идут B, по суммам
+// частей и длине B.
+uint32_t huff_crc32c(uint32_t crc, const void* data, size_t size);
+uint32_t huff_crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
 
 // --- Вспомогательные функции (могут быть полезны для тестирования) ---
 uint32_t* count_frequencies(const char* filename);
 char** build_huffman_dictionary(const uint32_t* freq);
+int build_huffman_code_table(const uint32_t* freq, HuffCode* codes);
 void print_dictionary(const char** codes, const uint32_t* freq);
 int files_equal(const char* f1, const char* f2);
 
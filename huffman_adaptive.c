@@ -0,0 +1,333 @@
+#include "huffman_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Адаптивный режим: кодер и декодер ведут одинаковую модель — счётчики
+// уже закодированных символов — и по ним одинаково перестраивают
+// канонические коды. Поэтому заголовок с таблицей не нужен, и первый
+// символ можно закодировать, не видя остальных.
+//
+// Коды перестраиваются не после каждого символа, а в точках, которые
+// обе стороны считают одинаково: после ADAPTIVE_MIN_STEP символов, потом
+// с шагом, равным числу уже закодированных (то есть всё реже), но не реже
+// чем через ADAPTIVE_MAX_STEP. Между перестройками работают обычные
+// табличные кодер и декодер. Счётчики начинаются с 1 у всех байтов,
+// поэтому любой байт всегда имеет код (не длиннее ADAPTIVE_MAX_LEN) и
+// отдельный escape-код не нужен. Когда сумма счётчиков переваливает за
+// ADAPTIVE_MAX_TOTAL, они делятся пополам: модель следит за сменой данных.
+//
+// Данные идут кадрами; кадр — это сброс: всё, что в нём, декодер может
+// отдать, как только кадр пришёл целиком.
+//   число символов кадра (varint; 0 — конец потока)
+//   длина битового потока кадра в байтах (varint)
+//   битовый поток, дополненный нулями до байта
+// Файл формата 4: "HUF" + байт версии (4), байт флагов (0), кадры,
+// пустой кадр в конце.
+
+// Пока сумма счётчиков не больше 2^16, дерево почти никогда не глубже
+// 16 и перестройка обходится без package-merge (в несколько раз дешевле).
+// Шаг перестройки ограничен ценой: 32K символов кодируются дольше, чем
+// строятся коды.
+#define ADAPTIVE_MAX_LEN   16
+#define ADAPTIVE_MIN_STEP  32
+#define ADAPTIVE_MAX_STEP  32768
+#define ADAPTIVE_MAX_TOTAL (1u << 16)
+#define ADAPTIVE_FRAME_HEAD 20     // Два varint
+
+// Наибольший кадр при кодировании файлов и буферов
+#define ADAPTIVE_FRAME_SIZE (64 * 1024)
+
+struct HuffAdaptive {
+    HuffAdaptiveModel model;
+};
+
+// --- Перестройка кодов по счётчикам ---
+static int adaptive_rebuild(HuffAdaptiveModel* m) {
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i++) total += m->freq[i];
+    if (total > ADAPTIVE_MAX_TOTAL) {
+        for (int i = 0; i < 256; i++) m->freq[i] = (m->freq[i] + 1) / 2;
+    }
+
+    uint64_t words[256];
+    huff_code_lengths(m->freq, ADAPTIVE_MAX_LEN, m->lens);
+    huff_canonical_codes(m->lens, words);
+    if (m->decoder) {
+        if (!huff_table_build(&m->table, words, m->lens)) return 0;
+    } else {
+        for (int i = 0; i < 256; i++) {
+            m->codes[i].word = words[i];
+            m->codes[i].len = m->lens[i];
+        }
+    }
+
+    uint64_t step = m->coded < ADAPTIVE_MIN_STEP ? ADAPTIVE_MIN_STEP : m->coded;
+    if (step > ADAPTIVE_MAX_STEP) step = ADAPTIVE_MAX_STEP;
+    m->next_rebuild = m->coded + step;
+    return 1;
+}
+
+// --- Начальная модель: все байты равновероятны ---
+// Память таблицы декодирования сохраняется между потоками.
+int huff_adaptive_init(HuffAdaptiveModel* m, int decoder) {
+    HuffDecodeTable table = m->table;
+    memset(m, 0, sizeof(*m));
+    m->table = table;
+    m->decoder = decoder;
+    for (int i = 0; i < 256; i++) m->freq[i] = 1;
+    return adaptive_rebuild(m);
+}
+
+void huff_adaptive_release(HuffAdaptiveModel* m) {
+    huff_table_free(&m->table);
+}
+
+// --- Наибольший размер кадра из n символов ---
+size_t huff_adaptive_bound(size_t n) {
+    return ADAPTIVE_FRAME_HEAD + (n * ADAPTIVE_MAX_LEN + 63) / 64 * 8 + 8;
+}
+
+// --- Кодирование кадра в dst (места — huff_adaptive_bound(n)) ---
+// Возвращает размер кадра; в *bits — длина его битового потока.
+size_t huff_adaptive_encode_frame(HuffAdaptiveModel* m, const uint8_t* src, size_t n,
+                                  uint8_t* dst, uint64_t* bits) {
+    // 1. Поток пишется с запасом под заголовок и потом сдвигается к нему
+    uint8_t* payload = dst + ADAPTIVE_FRAME_HEAD;
+    BitWriter bw;
+    bit_writer_init(&bw, payload);
+    for (size_t pos = 0; pos < n; ) {
+        size_t len = n - pos;
+        if (len > m->next_rebuild - m->coded) len = (size_t)(m->next_rebuild - m->coded);
+        huff_encode_symbols(m->codes, src + pos, len, &bw);
+        huff_histogram(src + pos, len, m->freq);
+        pos += len;
+        m->coded += len;
+        if (m->coded == m->next_rebuild) adaptive_rebuild(m);
+    }
+    *bits = (uint64_t)(bw.p - payload) * 8 + (uint64_t)bw.count;
+    size_t bytes = (size_t)(bw.p - payload);
+    bytes += bit_writer_finish(&bw);
+
+    // 2. Заголовок кадра
+    uint8_t head[ADAPTIVE_FRAME_HEAD];
+    size_t head_size = put_varint(head, n);
+    if (n == 0) {
+        memcpy(dst, head, head_size);
+        return head_size;
+    }
+    head_size += put_varint(head + head_size, bytes);
+    memmove(dst + head_size, payload, bytes);
+    memcpy(dst, head, head_size);
+    return head_size + bytes;
+}
+
+// --- Заголовок кадра: 1 — прочитан, 0 — данных мало, -1 — ошибка ---
+static int read_frame_head(const uint8_t* src, size_t size, size_t* pos,
+                           uint64_t* n, uint64_t* bytes) {
+    *pos = 0;
+    *bytes = 0;
+    if (!get_varint(src, size, pos, n)) return size >= 10 ? -1 : 0;
+    if (*n == 0) return 1;
+    if (!get_varint(src, size, pos, bytes)) return size - *pos >= 10 ? -1 : 0;
+    // Код не длиннее ADAPTIVE_MAX_LEN и не короче бита (в модели все 256
+    // символов): поток не может быть ни длиннее, ни короче этих пределов
+    if (*bytes > (*n * ADAPTIVE_MAX_LEN + 7) / 8) return -1;
+    if ((*n - 1) / 8 >= *bytes) return -1;
+    return 1;
+}
+
+// --- Декодирование кадра ---
+// Возвращает число символов (0 — кадр конца потока) или HuffError; в *used —
+// размер кадра, 0 — кадр пришёл не целиком и нужно больше данных.
+int64_t huff_adaptive_decode_frame(HuffAdaptiveModel* m, const uint8_t* src, size_t size,
+                                   size_t* used, uint8_t* dst, size_t cap) {
+    *used = 0;
+    size_t pos;
+    uint64_t n;
+    uint64_t bytes;
+    int r = read_frame_head(src, size, &pos, &n, &bytes);
+    if (r < 0) return HUFF_ERROR_CORRUPT;
+    if (r == 0 || size - pos < bytes) return 0;
+    if (n > cap) return HUFF_ERROR_DST_TOO_SMALL;
+
+    BitReader br;
+    bit_reader_init(&br, src + pos, (size_t)bytes);
+    for (size_t done = 0; done < n; ) {
+        size_t len = (size_t)n - done;
+        if (len > m->next_rebuild - m->coded) len = (size_t)(m->next_rebuild - m->coded);
+        if (huff_decode_symbols(&m->table, &br, dst + done, len, 1) != len) {
+            return HUFF_ERROR_CORRUPT;
+        }
+        huff_histogram(dst + done, len, m->freq);
+        done += len;
+        m->coded += len;
+        if (m->coded == m->next_rebuild && !adaptive_rebuild(m)) return HUFF_ERROR_CORRUPT;
+    }
+
+    // Ни один бит не взят из-за конца кадра
+    if (br.count < br.pad) return HUFF_ERROR_CORRUPT;
+    *used = pos + (size_t)bytes;
+    return (int64_t)n;
+}
+
+// --- Наибольший размер формата 4: заголовок, кадры и кадр конца ---
+size_t adaptive_compress_bound(size_t size) {
+    size_t frames = size / ADAPTIVE_FRAME_SIZE + 1;
+    return 5 + frames * huff_adaptive_bound(ADAPTIVE_FRAME_SIZE) + 1;
+}
+
+// --- Сумма символов всех кадров (или HuffError) ---
+// Кадры проходятся по заголовкам, поэтому нужен весь вход в памяти; у
+// канала размер неизвестен (0).
+int64_t adaptive_output_size(const HuffInput* in) {
+    if (!in->mapped) return 0;
+    const uint8_t* src = in->data + in->pos;
+    size_t size = in->size - in->pos;
+    uint64_t total = 0;
+    size_t at = 0;
+    while (1) {
+        size_t pos;
+        uint64_t n;
+        uint64_t bytes;
+        if (read_frame_head(src + at, size - at, &pos, &n, &bytes) <= 0 ||
+            size - at - pos < bytes) {
+            return HUFF_ERROR_CORRUPT;
+        }
+        if (n == 0) return (int64_t)total;
+        total += n;
+        at += pos + (size_t)bytes;
+    }
+}
+
+// --- Кодирование входа в формат 4: кадр на каждую порцию входа ---
+// Порция — то, что вход отдал за одно чтение (из канала — сколько успело
+// прийти), но не больше ADAPTIVE_FRAME_SIZE. Каждый кадр сразу уходит
+// в выход, поэтому задержка ограничена временем одного чтения.
+HuffError encode_adaptive(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                          HuffEncodeInfo* info) {
+    HuffTimer timer;
+    huff_timer_start(&timer, ctx->options.stats != NULL);
+    if (!huff_adaptive_init(&ctx->adaptive, 0)) return HUFF_ERROR_NO_MEMORY;
+
+    uint8_t header[16];
+    size_t header_size = put_adaptive_header(header);
+    if (!huff_output_write(out, header, header_size)) return huff_output_error(out);
+    uint64_t total_size = in->size_known ? in->file_size : 0;
+
+    while (1) {
+        const uint8_t* src;
+        size_t n = huff_input_peek(in, 1, &src);
+        if (in->error) return HUFF_ERROR_READ;
+        if (n > ADAPTIVE_FRAME_SIZE) n = ADAPTIVE_FRAME_SIZE;
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+
+        uint8_t* dst = huff_output_reserve(out, huff_adaptive_bound(n));
+        if (!dst) return huff_output_error(out);
+        uint64_t bits;
+        size_t frame = huff_adaptive_encode_frame(&ctx->adaptive, src, n, dst, &bits);
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_CODING);
+        if (!huff_output_commit(out, frame) || !huff_output_flush(out)) {
+            return huff_output_error(out);
+        }
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+
+        huff_input_skip(in, n);
+        info->total_bits += bits;
+        ctx->stats.symbols += n;
+        ctx->stats.bits += bits;
+        if (n == 0) break;
+        ctx->stats.blocks++;
+        huff_progress(ctx, in->consumed, total_size, 0);
+    }
+    info->input_size = in->consumed;
+    return HUFF_OK;
+}
+
+// --- Декодирование формата 4 (вход стоит сразу после заголовка) ---
+// Каждый кадр декодируется, как только пришёл целиком, и сразу уходит
+// в выход.
+HuffError decode_adaptive(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                          uint64_t* decoded) {
+    HuffTimer timer;
+    huff_timer_start(&timer, ctx->options.stats != NULL);
+    if (!huff_adaptive_init(&ctx->adaptive, 1)) return HUFF_ERROR_NO_MEMORY;
+
+    // Заголовок кадра дочитывается по байту: следующего кадра может ещё не быть
+    size_t want = 1;
+    while (1) {
+        const uint8_t* src;
+        size_t avail = huff_input_peek(in, want, &src);
+        if (in->error) return HUFF_ERROR_READ;
+        if (avail == 0) return HUFF_ERROR_CORRUPT;     // Нет кадра конца потока
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+
+        size_t pos;
+        uint64_t n;
+        uint64_t bytes;
+        int r = read_frame_head(src, avail, &pos, &n, &bytes);
+        if (r < 0) return HUFF_ERROR_CORRUPT;
+        if (r == 0 || avail - pos < bytes) {
+            if (in->eof && avail < want) return HUFF_ERROR_CORRUPT;
+            want = r == 0 ? avail + 1 : pos + (size_t)bytes;
+            continue;
+        }
+        want = 1;
+
+        uint8_t* dst = huff_output_reserve(out, (size_t)n);
+        if (!dst) return huff_output_error(out);
+        size_t used;
+        int64_t got = huff_adaptive_decode_frame(&ctx->adaptive, src, avail, &used,
+                                                 dst, (size_t)n);
+        if (got < 0) return (HuffError)got;
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_CODING);
+        if (!huff_output_commit(out, (size_t)got) || !huff_output_flush(out)) {
+            return huff_output_error(out);
+        }
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+
+        huff_input_skip(in, used);
+        ctx->stats.bits += bytes * 8;
+        if (n == 0) break;
+        *decoded += (uint64_t)got;
+        ctx->stats.blocks++;
+        huff_progress(ctx, *decoded, 0, 0);
+    }
+    ctx->stats.symbols = *decoded;
+    return HUFF_OK;
+}
+
+// --- Публичный потоковый интерфейс ---
+HuffAdaptive* huff_adaptive_create(int decoder) {
+    HuffAdaptive* s = (HuffAdaptive*)calloc(1, sizeof(HuffAdaptive));
+    if (!s) return NULL;
+    if (!huff_adaptive_init(&s->model, decoder)) {
+        huff_adaptive_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void huff_adaptive_free(HuffAdaptive* s) {
+    if (!s) return;
+    huff_adaptive_release(&s->model);
+    free(s);
+}
+
+// --- Кадр из src (len == 0 — кадр конца потока) ---
+int64_t huff_adaptive_encode(HuffAdaptive* s, const void* src, size_t len,
+                             void* dst, size_t dst_cap) {
+    if (s->model.decoder) return HUFF_ERROR_CORRUPT;
+    if (dst_cap < huff_adaptive_bound(len)) return HUFF_ERROR_DST_TOO_SMALL;
+    uint64_t bits;
+    return (int64_t)huff_adaptive_encode_frame(&s->model, (const uint8_t*)src, len,
+                                               (uint8_t*)dst, &bits);
+}
+
+// --- Один кадр из начала src ---
+int64_t huff_adaptive_decode(HuffAdaptive* s, const void* src, size_t src_len, size_t* used,
+                             void* dst, size_t dst_cap) {
+    *used = 0;
+    if (!s->model.decoder) return HUFF_ERROR_CORRUPT;
+    return huff_adaptive_decode_frame(&s->model, (const uint8_t*)src, src_len, used,
+                                      (uint8_t*)dst, dst_cap);
+}
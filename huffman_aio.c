@@ -0,0 +1,727 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE         // syscall, MAP_POPULATE
+
+#include "huffman_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HUFF_HAVE_URING 1
+#endif
+#endif
+#endif
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+// Конвейер: кодер, поток чтения и поток записи связаны кольцами из
+// HUFF_PIPE_SLOTS буферов по HUFF_PIPE_CHUNK байт. Буферы ходят по кругу
+// по порядку номеров: поток чтения наполняет свободные, кодер разбирает
+// готовые; при записи наоборот. Поэтому чтение следующего куска и запись
+// предыдущего идут, пока кодер занят текущим, и время работы ближе к
+// большему из времени ввода-вывода и счёта, а не к их сумме.
+//
+// Перед данными каждого буфера чтения есть запас HUFF_PIPE_HEADROOM байт:
+// недочитанный хвост прошлого куска (например, начало блока) копируется
+// туда, и окно peek остаётся непрерывным без копирования всего куска.
+// Хвосты длиннее запаса и чтение до конца файла собираются в буфере
+// HuffInput, как без конвейера.
+//
+// io_uring вызывается напрямую системными вызовами (без liburing): запросы
+// на все свободные буферы уходят одним io_uring_enter, и диск видит
+// несколько запросов сразу. Короткий или неудачный запрос дочитывается
+// (дописывается) обычным pread/pwrite, поэтому старое ядро без нужных
+// операций работает медленнее, но правильно. Каналы и устройства без
+// смещения идут через read/write: их запросы нельзя выполнять вразнобой.
+// Из канала кусок набирается, пока буфер не полон или пока кодер не
+// остался без данных: тогда он получает, что уже пришло, и сжатие потока
+// сообщений не ждёт, пока наберётся HUFF_PIPE_CHUNK.
+#define HUFF_PIPE_HEADROOM (2 * 1024 * 1024)
+
+enum { SLOT_FREE, SLOT_BUSY, SLOT_READY };
+
+typedef struct {
+    uint8_t* buf;               // Запас (только у чтения), затем cap байт данных
+    size_t cap;
+    size_t len;                 // Сколько байт данных; 0 у готового — конец входа
+    uint64_t offset;            // Смещение куска в файле
+    int state;
+} PipeSlot;
+
+#ifdef HUFF_HAVE_URING
+typedef struct {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Uring;
+#endif
+
+struct HuffPipe {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // Любой буфер сменил состояние
+    pthread_t thread;
+    PipeSlot slots[HUFF_PIPE_SLOTS];
+    size_t headroom;
+    int fd;
+    int seekable;               // Обычный файл: pread/pwrite по смещению
+    uint64_t file_size;         // Размер входа (только seekable)
+    int next;                   // Следующий буфер кодера
+    int current;                // Буфер, из которого читает кодер (-1 — нет)
+    int done;                   // Запись: кодер закрыл выход
+    int stop;                   // Чтение: кодер закрыл вход
+    int starving;               // Чтение канала: кодер ждёт следующий кусок
+    int wake[2];                // Канал, которым кодер будит поток чтения
+    int error;
+    int uring;
+#ifdef HUFF_HAVE_URING
+    Uring ring;
+#endif
+};
+
+// --- Ожидание, пока буфер придёт в состояние state (под замком) ---
+static void wait_slot(HuffPipe* pipe, PipeSlot* slot, int state) {
+    while (slot->state != state) pthread_cond_wait(&pipe->changed, &pipe->lock);
+}
+
+// --- Смена состояния буфера с оповещением ---
+static void set_slot(HuffPipe* pipe, PipeSlot* slot, int state) {
+    pthread_mutex_lock(&pipe->lock);
+    slot->state = state;
+    pthread_cond_broadcast(&pipe->changed);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+// --- Чтение len байт по смещению: меньше только в конце файла ---
+// Возвращает число байт или -1.
+static ssize_t read_chunk(HuffPipe* pipe, uint8_t* buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t got = pread(pipe->fd, buf + done, len - done, (off_t)(offset + done));
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return -1;
+        if (got == 0) break;
+        done += (size_t)got;
+    }
+    return (ssize_t)done;
+}
+
+// --- Чтение из канала: пока буфер не полон или кодер не ждёт ---
+// Возвращает число байт (0 — конец входа) или -1.
+static ssize_t read_stream(HuffPipe* pipe, uint8_t* buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        // Кодер может закрыть вход, пока канал молчит: ждём с отменой
+        struct pollfd fds[2] = {{pipe->fd, POLLIN, 0}, {pipe->wake[0], POLLIN, 0}};
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        int ready = poll(fds, 2, -1);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) return -1;
+        if (fds[1].revents) {
+            char drain[64];
+            while (read(pipe->wake[0], drain, sizeof(drain)) > 0) {}
+        }
+        if (fds[0].revents) {
+            ssize_t got = read(pipe->fd, buf + done, len - done);
+            if (got < 0 && errno == EINTR) continue;
+            if (got < 0) return -1;
+            if (got == 0) break;
+            done += (size_t)got;
+        }
+        pthread_mutex_lock(&pipe->lock);
+        int starving = pipe->starving;
+        pthread_mutex_unlock(&pipe->lock);
+        if (done > 0 && starving) break;
+    }
+    return (ssize_t)done;
+}
+
+// --- Запись len байт по смещению (канал — подряд) ---
+static int write_chunk(HuffPipe* pipe, const uint8_t* buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t put = pipe->seekable
+                          ? pwrite(pipe->fd, buf + done, len - done, (off_t)(offset + done))
+                          : write(pipe->fd, buf + done, len - done);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return 0;
+        done += (size_t)put;
+    }
+    return 1;
+}
+
+#ifdef HUFF_HAVE_URING
+// --- Кольца io_uring на entries запросов ---
+static void uring_free(Uring* r) {
+    if (r->sqes) munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring) munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring) munmap(r->sq_ring, r->sq_ring_size);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static int uring_init(Uring* r, unsigned entries) {
+    struct io_uring_params params;
+    memset(r, 0, sizeof(*r));
+    memset(&params, 0, sizeof(params));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (r->fd < 0) return 0;
+
+    r->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sq = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    void* cq = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    r->sq_ring = sq == MAP_FAILED ? NULL : sq;
+    r->cq_ring = cq == MAP_FAILED ? NULL : cq;
+    r->sqes = sqes == MAP_FAILED ? NULL : (struct io_uring_sqe*)sqes;
+    if (!r->sq_ring || !r->cq_ring || !r->sqes) {
+        uring_free(r);
+        return 0;
+    }
+
+    uint8_t* s = (uint8_t*)r->sq_ring;
+    uint8_t* c = (uint8_t*)r->cq_ring;
+    r->sq_head = (unsigned*)(s + params.sq_off.head);
+    r->sq_tail = (unsigned*)(s + params.sq_off.tail);
+    r->sq_mask = (unsigned*)(s + params.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(s + params.sq_off.array);
+    r->cq_head = (unsigned*)(c + params.cq_off.head);
+    r->cq_tail = (unsigned*)(c + params.cq_off.tail);
+    r->cq_mask = (unsigned*)(c + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(c + params.cq_off.cqes);
+    return 1;
+}
+
+// --- Запрос в очередь; уходит в ядро при uring_enter ---
+static void uring_queue(Uring* r, int op, int fd, void* buf, size_t len,
+                        uint64_t offset, int tag) {
+    unsigned tail = *r->sq_tail;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->off = offset;
+    sqe->user_data = (uint64_t)tag;
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// --- Отправка очереди и ожидание хотя бы одного завершения ---
+static int uring_enter(Uring* r) {
+    for (;;) {
+        unsigned pending = *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        long rc = syscall(__NR_io_uring_enter, r->fd, pending, 1, IORING_ENTER_GETEVENTS,
+                          NULL, 0);
+        if (rc >= 0) return 1;
+        if (errno != EINTR) return 0;
+    }
+}
+
+// --- Следующее завершение: номер буфера и результат; 0 — пока нет ---
+static int uring_reap(Uring* r, int* tag, int* res) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return 0;
+    struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+    *tag = (int)cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// --- Поток чтения через io_uring (только обычные файлы) ---
+static void uring_reader(HuffPipe* pipe) {
+    Uring* r = &pipe->ring;
+    uint64_t offset = 0;
+    int submit = 0;
+    int inflight = 0;
+    int last = 0;                       // Буфер конца файла уже отдан
+
+    for (;;) {
+        // 1. Запросы на все свободные буферы подряд
+        pthread_mutex_lock(&pipe->lock);
+        if ((last || pipe->stop) && inflight == 0) {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        while (!pipe->stop && !last && inflight == 0 &&
+               pipe->slots[submit].state != SLOT_FREE) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        while (!pipe->stop && !last && pipe->slots[submit].state == SLOT_FREE) {
+            PipeSlot* slot = &pipe->slots[submit];
+            uint64_t left = pipe->file_size - offset;
+            slot->offset = offset;
+            slot->len = left < slot->cap ? (size_t)left : slot->cap;
+            if (slot->len == 0) {
+                slot->state = SLOT_READY;
+                pthread_cond_broadcast(&pipe->changed);
+                last = 1;
+                break;
+            }
+            slot->state = SLOT_BUSY;
+            uring_queue(r, IORING_OP_READ, pipe->fd, slot->buf + pipe->headroom,
+                        slot->len, offset, submit);
+            offset += slot->len;
+            submit = (submit + 1) % HUFF_PIPE_SLOTS;
+            inflight++;
+        }
+        pthread_mutex_unlock(&pipe->lock);
+        if (inflight == 0) continue;
+
+        // 2. Ждём завершений; ядро отказало — всё, что в полёте, с ошибкой
+        if (!uring_enter(r)) {
+            pthread_mutex_lock(&pipe->lock);
+            pipe->error = 1;
+            for (int i = 0; i < HUFF_PIPE_SLOTS; i++) {
+                if (pipe->slots[i].state == SLOT_BUSY) {
+                    pipe->slots[i].len = 0;
+                    pipe->slots[i].state = SLOT_READY;
+                }
+            }
+            pthread_cond_broadcast(&pipe->changed);
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+
+        // 3. Готовые куски; короткие дочитываем сами
+        int tag, res;
+        while (uring_reap(r, &tag, &res)) {
+            PipeSlot* slot = &pipe->slots[tag];
+            size_t done = res > 0 ? (size_t)res : 0;
+            int failed = 0;
+            if (done < slot->len) {
+                ssize_t got = read_chunk(pipe, slot->buf + pipe->headroom + done,
+                                         slot->len - done, slot->offset + done);
+                failed = got < 0 || done + (size_t)got < slot->len;
+            }
+            pthread_mutex_lock(&pipe->lock);
+            if (failed) pipe->error = 1;
+            slot->state = SLOT_READY;
+            pthread_cond_broadcast(&pipe->changed);
+            pthread_mutex_unlock(&pipe->lock);
+            inflight--;
+        }
+    }
+}
+
+// --- Поток записи через io_uring (только обычные файлы) ---
+static void uring_writer(HuffPipe* pipe) {
+    Uring* r = &pipe->ring;
+    int submit = 0;
+    int inflight = 0;
+    int queued[HUFF_PIPE_SLOTS] = {0};  // Буфер в полёте
+
+    for (;;) {
+        // 1. Запросы на все готовые буферы подряд
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->done && inflight == 0 && pipe->slots[submit].state != SLOT_READY) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        if (inflight == 0 && pipe->slots[submit].state != SLOT_READY) {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        while (pipe->slots[submit].state == SLOT_READY) {
+            PipeSlot* slot = &pipe->slots[submit];
+            if (pipe->error) {
+                // После ошибки данные не пишутся, но буферы возвращаются кодеру
+                slot->state = SLOT_FREE;
+                pthread_cond_broadcast(&pipe->changed);
+            } else {
+                slot->state = SLOT_BUSY;
+                uring_queue(r, IORING_OP_WRITE, pipe->fd, slot->buf, slot->len,
+                            slot->offset, submit);
+                queued[submit] = 1;
+                inflight++;
+            }
+            submit = (submit + 1) % HUFF_PIPE_SLOTS;
+        }
+        pthread_mutex_unlock(&pipe->lock);
+        if (inflight == 0) continue;
+
+        // 2. Ждём завершений
+        if (!uring_enter(r)) {
+            pthread_mutex_lock(&pipe->lock);
+            pipe->error = 1;
+            for (int i = 0; i < HUFF_PIPE_SLOTS; i++) {
+                if (queued[i]) pipe->slots[i].state = SLOT_FREE;
+                queued[i] = 0;
+            }
+            pthread_cond_broadcast(&pipe->changed);
+            pthread_mutex_unlock(&pipe->lock);
+            inflight = 0;
+            continue;
+        }
+
+        // 3. Записанные куски; короткие дописываем сами
+        int tag, res;
+        while (uring_reap(r, &tag, &res)) {
+            PipeSlot* slot = &pipe->slots[tag];
+            size_t done = res > 0 ? (size_t)res : 0;
+            int failed = 0;
+            if (done < slot->len) {
+                failed = !write_chunk(pipe, slot->buf + done, slot->len - done,
+                                      slot->offset + done);
+            }
+            pthread_mutex_lock(&pipe->lock);
+            if (failed) pipe->error = 1;
+            slot->state = SLOT_FREE;
+            pthread_cond_broadcast(&pipe->changed);
+            pthread_mutex_unlock(&pipe->lock);
+            queued[tag] = 0;
+            inflight--;
+        }
+    }
+}
+#endif
+
+// --- Поток чтения ---
+static void* reader_main(void* arg) {
+    HuffPipe* pipe = (HuffPipe*)arg;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+#ifdef HUFF_HAVE_URING
+    if (pipe->uring) {
+        uring_reader(pipe);
+        return NULL;
+    }
+#endif
+    uint64_t offset = 0;
+    for (int i = 0;; i = (i + 1) % HUFF_PIPE_SLOTS) {
+        PipeSlot* slot = &pipe->slots[i];
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->stop && slot->state != SLOT_FREE) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        int stop = pipe->stop;
+        if (!stop) slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&pipe->lock);
+        if (stop) break;
+
+        uint8_t* data = slot->buf + pipe->headroom;
+        ssize_t got = pipe->seekable ? read_chunk(pipe, data, slot->cap, offset)
+                                     : read_stream(pipe, data, slot->cap);
+        pthread_mutex_lock(&pipe->lock);
+        if (got < 0) pipe->error = 1;
+        slot->offset = offset;
+        slot->len = got > 0 ? (size_t)got : 0;
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+        if (got <= 0) break;
+        offset += (uint64_t)got;
+    }
+    return NULL;
+}
+
+// --- Поток записи ---
+static void* writer_main(void* arg) {
+    HuffPipe* pipe = (HuffPipe*)arg;
+#ifdef HUFF_HAVE_URING
+    if (pipe->uring) {
+        uring_writer(pipe);
+        return NULL;
+    }
+#endif
+    for (int i = 0;; i = (i + 1) % HUFF_PIPE_SLOTS) {
+        PipeSlot* slot = &pipe->slots[i];
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->done && slot->state != SLOT_READY) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        int ready = slot->state == SLOT_READY;
+        int failed = pipe->error;
+        if (ready) slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&pipe->lock);
+        if (!ready) break;
+
+        if (!failed && !write_chunk(pipe, slot->buf, slot->len, slot->offset)) failed = 1;
+        pthread_mutex_lock(&pipe->lock);
+        if (failed) pipe->error = 1;
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    return NULL;
+}
+
+// --- Канал для пробуждения потока чтения; оба конца не блокируются ---
+static int pipe_open_wake(int wake[2]) {
+    if (pipe(wake) != 0) {
+        wake[0] = wake[1] = -1;
+        return 0;
+    }
+    for (int i = 0; i < 2; i++) fcntl(wake[i], F_SETFL, fcntl(wake[i], F_GETFL) | O_NONBLOCK);
+    return 1;
+}
+
+// --- Освобождение кольца (поток уже завершён) ---
+static void pipe_free(HuffPipe* pipe) {
+    for (int i = 0; i < HUFF_PIPE_SLOTS; i++) free(pipe->slots[i].buf);
+#ifdef HUFF_HAVE_URING
+    if (pipe->uring) uring_free(&pipe->ring);
+#endif
+    if (pipe->wake[0] >= 0) close(pipe->wake[0]);
+    if (pipe->wake[1] >= 0) close(pipe->wake[1]);
+    pthread_cond_destroy(&pipe->changed);
+    pthread_mutex_destroy(&pipe->lock);
+    free(pipe);
+}
+
+// --- Кольцо для fd и запуск его потока ---
+// io_uring берётся только для обычных файлов и только если просили.
+static HuffPipe* pipe_create(int fd, size_t headroom, int uring, void* (*main)(void*)) {
+    HuffPipe* pipe = (HuffPipe*)calloc(1, sizeof(HuffPipe));
+    if (!pipe) return NULL;
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->changed, NULL);
+    pipe->fd = fd;
+    pipe->headroom = headroom;
+    pipe->current = -1;
+    pipe->wake[0] = pipe->wake[1] = -1;
+
+    struct stat st;
+    int ok = 1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) == 0) {
+        pipe->seekable = 1;
+        pipe->file_size = (uint64_t)st.st_size;
+    } else if (main == reader_main) {
+        ok = pipe_open_wake(pipe->wake);
+    }
+#ifdef HUFF_HAVE_URING
+    if (uring && pipe->seekable) pipe->uring = uring_init(&pipe->ring, HUFF_PIPE_SLOTS);
+#else
+    (void)uring;
+#endif
+
+    for (int i = 0; i < HUFF_PIPE_SLOTS && ok; i++) {
+        pipe->slots[i].buf = (uint8_t*)malloc(headroom + HUFF_PIPE_CHUNK);
+        pipe->slots[i].cap = HUFF_PIPE_CHUNK;
+        ok = pipe->slots[i].buf != NULL;
+    }
+    if (ok) ok = pthread_create(&pipe->thread, NULL, main, pipe) == 0;
+    if (!ok) {
+        pipe_free(pipe);
+        return NULL;
+    }
+    return pipe;
+}
+
+int huff_pipe_uring(const HuffPipe* pipe) {
+    return pipe->uring;
+}
+
+// --- Открытие входа с потоком чтения ---
+int huff_pipe_input_open(HuffInput* in, const char* filename, int uring) {
+    memset(in, 0, sizeof(*in));
+    int is_stdin = strcmp(filename, "-") == 0;
+    in->fd = is_stdin ? dup(STDIN_FILENO) : open(filename, O_RDONLY);
+    if (in->fd < 0) return 0;
+
+    in->pipe = pipe_create(in->fd, HUFF_PIPE_HEADROOM, uring, reader_main);
+    if (!in->pipe) {
+        close(in->fd);
+        in->fd = -1;
+        return 0;
+    }
+    if (in->pipe->seekable) {
+        in->file_size = in->pipe->file_size;
+        in->size_known = 1;
+    }
+    return 1;
+}
+
+// --- peek по кольцу: хвост прошлого куска переносится к началу следующего ---
+size_t huff_pipe_peek(HuffInput* in, size_t want, const uint8_t** p) {
+    HuffPipe* pipe = in->pipe;
+    while (in->size - in->pos < want && !in->eof) {
+        // 1. Ждём следующий кусок
+        PipeSlot* slot = &pipe->slots[pipe->next];
+        pthread_mutex_lock(&pipe->lock);
+        if (slot->state != SLOT_READY && !pipe->seekable) {
+            // Поток чтения мог набирать неполный кусок: пусть отдаст его
+            pipe->starving = 1;
+            if (write(pipe->wake[1], "", 1) < 0) {}
+        }
+        wait_slot(pipe, slot, SLOT_READY);
+        pipe->starving = 0;
+        int failed = pipe->error;
+        size_t len = slot->len;
+        pthread_mutex_unlock(&pipe->lock);
+        if (len == 0 || failed) {
+            in->error = failed;
+            in->eof = 1;
+            break;
+        }
+
+        size_t rest = in->size - in->pos;
+        const uint8_t* tail = in->data + in->pos;
+        uint8_t* data = slot->buf + pipe->headroom;
+        if (rest <= pipe->headroom && want <= rest + len) {
+            // 2. Хвост помещается в запас: окно начинается прямо в куске
+            if (rest) memcpy(data - rest, tail, rest);
+            if (pipe->current >= 0) set_slot(pipe, &pipe->slots[pipe->current], SLOT_FREE);
+            pipe->current = pipe->next;
+            in->data = data - rest;
+        } else {
+            // 3. Иначе собираем окно в буфере
+            size_t need = rest + len;
+            int moved = in->buffer && in->data == in->buffer;
+            if (moved) memmove(in->buffer, tail, rest);
+            if (in->cap < need) {
+                size_t cap = in->cap ? in->cap : HUFF_PIPE_CHUNK;
+                while (cap < need) cap *= 2;
+                uint8_t* grown = (uint8_t*)realloc(in->buffer, cap);
+                if (!grown) {
+                    in->error = 1;
+                    break;
+                }
+                in->buffer = grown;
+                in->cap = cap;
+            }
+            if (!moved && rest) memcpy(in->buffer, tail, rest);
+            memcpy(in->buffer + rest, data, len);
+            if (pipe->current >= 0) set_slot(pipe, &pipe->slots[pipe->current], SLOT_FREE);
+            set_slot(pipe, slot, SLOT_FREE);
+            pipe->current = -1;
+            in->data = in->buffer;
+        }
+        in->size = rest + len;
+        in->pos = 0;
+        pipe->next = (pipe->next + 1) % HUFF_PIPE_SLOTS;
+    }
+
+    *p = in->data + in->pos;
+    return in->size - in->pos;
+}
+
+// --- Остановка потока чтения ---
+void huff_pipe_input_close(HuffInput* in) {
+    HuffPipe* pipe = in->pipe;
+    pthread_mutex_lock(&pipe->lock);
+    pipe->stop = 1;
+    pthread_cond_broadcast(&pipe->changed);
+    pthread_mutex_unlock(&pipe->lock);
+    // Канал может молчать сколько угодно: поток ждёт в read с отменой
+    if (!pipe->seekable) pthread_cancel(pipe->thread);
+    pthread_join(pipe->thread, NULL);
+    pipe_free(pipe);
+    in->pipe = NULL;
+    in->data = NULL;
+}
+
+// --- Создание выхода с потоком записи ---
+int huff_pipe_output_open(HuffOutput* out, const char* filename, int uring) {
+    memset(out, 0, sizeof(*out));
+    out->fd = strcmp(filename, "-") == 0
+                  ? dup(STDOUT_FILENO)
+                  : open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out->fd < 0) return 0;
+
+    out->pipe = pipe_create(out->fd, 0, uring, writer_main);
+    if (!out->pipe) {
+        close(out->fd);
+        out->fd = -1;
+        return 0;
+    }
+    PipeSlot* slot = &out->pipe->slots[0];
+    set_slot(out->pipe, slot, SLOT_BUSY);
+    out->data = slot->buf;
+    out->cap = slot->cap;
+    return 1;
+}
+
+// --- Отдать текущий буфер потоку записи и взять следующий ---
+int huff_pipe_output_flush(HuffOutput* out) {
+    HuffPipe* pipe = out->pipe;
+    if (out->pos > 0) {
+        PipeSlot* slot = &pipe->slots[pipe->next];
+        slot->len = out->pos;
+        slot->offset = out->flushed;
+        out->flushed += out->pos;
+        out->pos = 0;
+        pipe->next = (pipe->next + 1) % HUFF_PIPE_SLOTS;
+        PipeSlot* free_slot = &pipe->slots[pipe->next];
+
+        pthread_mutex_lock(&pipe->lock);
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&pipe->changed);
+        wait_slot(pipe, free_slot, SLOT_FREE);
+        free_slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&pipe->lock);
+        out->data = free_slot->buf;
+        out->cap = free_slot->cap;
+    }
+    pthread_mutex_lock(&pipe->lock);
+    if (pipe->error) out->error = 1;
+    pthread_mutex_unlock(&pipe->lock);
+    return !out->error;
+}
+
+// --- Место под n байт: записанное уходит, буфер при нужде растёт ---
+uint8_t* huff_pipe_reserve(HuffOutput* out, size_t n) {
+    if (out->pos > 0 && !huff_pipe_output_flush(out)) return NULL;
+    if (n > out->cap) {
+        PipeSlot* slot = &out->pipe->slots[out->pipe->next];
+        size_t cap = slot->cap;
+        while (cap < n) cap *= 2;
+        uint8_t* grown = (uint8_t*)realloc(slot->buf, cap);
+        if (!grown) {
+            out->error = 1;
+            return NULL;
+        }
+        slot->buf = grown;
+        slot->cap = cap;
+        out->data = grown;
+        out->cap = cap;
+    }
+    return out->data;
+}
+
+// --- Дописать остаток и дождаться потока записи ---
+int huff_pipe_output_close(HuffOutput* out) {
+    HuffPipe* pipe = out->pipe;
+    int ok = out->error ? 0 : huff_pipe_output_flush(out);
+    pthread_mutex_lock(&pipe->lock);
+    pipe->done = 1;
+    pthread_cond_broadcast(&pipe->changed);
+    pthread_mutex_unlock(&pipe->lock);
+    pthread_join(pipe->thread, NULL);
+    if (pipe->error) ok = 0;
+    pipe_free(pipe);
+    out->pipe = NULL;
+    out->data = NULL;
+    return ok;
+}
@@ -0,0 +1,609 @@
+#include "huffman_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Кодирование и декодирование всех форматов между HuffInput и HuffOutput.
+// Функции в памяти подставляют буферы вызывающего, файловые — файлы, и
+// дальше работа у них общая. Здесь ничего не печатается: ошибки
+// возвращаются кодами HuffError, прогресс уходит в options.progress,
+// время фаз — в статистику контекста.
+
+// Размеры кусков: столько символов кодируется и декодируется за раз
+// (между отметками прогресса) и столько байт входа нужно декодеру
+#define ENCODE_IN_CHUNK  (64 * 1024)
+#define DECODE_IN_CHUNK  (256 * 1024)
+#define DECODE_OUT_CHUNK (256 * 1024)
+
+// Один поток форматов 1 и 2 кодируется параллельно кусками по
+// ENCODE_JOB_CHUNK, по куску на поток пула за круг. Гистограммы кусков
+// считаются параллельно вместо общей; длина кода куска — сумма длин кодов
+// по его гистограмме, префиксная сумма длин даёт бит, с которого кусок
+// начинается. Каждый кусок кодируется в свой буфер с этого бита первого
+// байта и копируется в выход; байт на стыке двух кусков собирается через
+// OR. Результат совпадает с последовательным бит в бит.
+#define ENCODE_JOB_CHUNK (1024 * 1024)
+
+// Задача гистограмм: куски first, first + step, ...
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    uint32_t (*chunk_freq)[256];
+    size_t first;
+    size_t step;
+} HistogramJob;
+
+typedef struct {
+    const HuffCode* codes;
+    const uint8_t* src;
+    size_t n;
+    uint64_t bits;          // Длина кода куска
+    int phase;              // С какого бита первого байта он начинается
+    uint64_t offset;        // С какого байта от начала круга
+    uint8_t* scratch;       // Код куска, с phase нулевых бит впереди
+    uint8_t* dst;           // Место первого байта куска в выходе
+    uint8_t first;          // Первый байт, если он общий с предыдущим куском
+} StreamJob;
+
+// --- Локальные функции ---
+static HuffError encode_whole(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                              HuffEncodeInfo* info);
+static HuffError decode_whole(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                              const HuffHeader* header, uint64_t* decoded);
+static void histogram_job(void* arg);
+static int chunk_histograms(HuffContext* ctx, const uint8_t* data, size_t size,
+                            uint64_t* freq);
+static void stream_job_encode(void* arg);
+static HuffError encode_parallel(HuffContext* ctx, const HuffCode* codes,
+                                 const uint8_t* data, size_t size, HuffOutput* out,
+                                 HuffTimer* timer);
+
+// --- Параметры по умолчанию ---
+void huff_default_options(HuffOptions* options) {
+    options->format = HUFF_FORMAT_BLOCKED;
+    options->max_code_len = HUFF_DEFAULT_MAX_CODE_LEN;
+    options->block_size = HUFF_DEFAULT_BLOCK_SIZE;
+    options->threads = 0;
+    options->streams = 4;
+    options->contexts = 0;
+    options->checksum = 1;
+    options->seek_interval = 0;
+    options->io = HUFF_IO_MAP;
+    options->stats = NULL;
+    options->progress = NULL;
+    options->progress_user = NULL;
+}
+
+// --- Создание контекста ---
+HuffContext* huff_context_create(const HuffOptions* options) {
+    HuffContext* ctx = (HuffContext*)calloc(1, sizeof(HuffContext));
+    if (!ctx) return NULL;
+
+    if (options) ctx->options = *options;
+    else huff_default_options(&ctx->options);
+    if (ctx->options.block_size == 0) ctx->options.block_size = HUFF_DEFAULT_BLOCK_SIZE;
+    if (ctx->options.streams != 4) ctx->options.streams = 1;
+    if (ctx->options.contexts < 2) ctx->options.contexts = 0;
+    if (ctx->options.contexts > HUFF_MAX_CLUSTERS) ctx->options.contexts = HUFF_MAX_CLUSTERS;
+    if (ctx->options.seek_interval && ctx->options.seek_interval < HUFF_MIN_SEEK_INTERVAL) {
+        ctx->options.seek_interval = HUFF_MIN_SEEK_INTERVAL;
+    }
+
+    ctx->threads = ctx->options.threads > 0 ? ctx->options.threads : huff_cpu_count();
+    ctx->pool = huff_pool_create(ctx->threads);
+    if (!ctx->pool) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+// --- Освобождение контекста ---
+void huff_context_free(HuffContext* ctx) {
+    if (!ctx) return;
+    huff_blocks_release(ctx);
+    huff_table_free(&ctx->table);
+    free(ctx->chunk_freq);
+    huff_adaptive_release(&ctx->adaptive);
+    huff_pool_destroy(ctx->pool);
+    free(ctx);
+}
+
+// --- Текст ошибки ---
+const char* huff_error_string(int64_t code) {
+    switch (code) {
+        case HUFF_ERROR_DST_TOO_SMALL: return "destination buffer too small";
+        case HUFF_ERROR_CORRUPT:       return "corrupted or unsupported data";
+        case HUFF_ERROR_NO_MEMORY:     return "out of memory";
+        case HUFF_ERROR_READ:          return "cannot read input";
+        case HUFF_ERROR_WRITE:         return "cannot write output";
+        case HUFF_ERROR_TOO_LARGE:     return "input too large for the format";
+        default:                       return code >= 0 ? "ok" : "unknown error";
+    }
+}
+
+// --- Кодирование в формат 1 или 2: весь вход в памяти, один поток ---
+HuffError encode_whole(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                       HuffEncodeInfo* info) {
+    const HuffOptions* options = &ctx->options;
+    HuffStats* stats = &ctx->stats;
+    HuffTimer timer;
+    huff_timer_start(&timer, options->stats != NULL);
+
+    // 1. Весь вход одним окном: оба прохода идут по одним данным
+    const uint8_t* data;
+    size_t size = huff_input_peek(in, (size_t)-1, &data);
+    if (in->error) return HUFF_ERROR_READ;
+    info->input_size = size;
+    huff_timer_lap(&timer, stats, HUFF_PHASE_READ);
+
+    // 2. Подсчитываем частоты символов: вход может быть больше 4 ГБ, поэтому
+    // счётчики 64-битные, а коды строятся по частотам, уменьшенным до 32 бит.
+    // Вход больше одного куска при нескольких потоках кодируется
+    // параллельно, и частоты складываются из гистограмм кусков.
+    uint64_t freq[256] = {0};
+    uint32_t model[256];
+    int parallel = ctx->threads > 1 && size > ENCODE_JOB_CHUNK &&
+                   chunk_histograms(ctx, data, size, freq);
+    if (!parallel) huff_histogram64(data, size, freq);
+    huff_scale_frequencies(freq, model);
+    huff_timer_lap(&timer, stats, HUFF_PHASE_HISTOGRAM);
+
+    // 3-4. Строим коды Хаффмана и заголовок
+    uint8_t header[HUFF_MAX_HEADER_SIZE];
+    size_t header_size;
+    HuffCode codes[256];
+    if (options->format == HUFF_FORMAT_LEGACY) {
+        // Старый формат: 32-битные частоты, коды по дереву
+        uint32_t narrow[256];
+        for (int i = 0; i < 256; i++) {
+            if (freq[i] > UINT32_MAX) return HUFF_ERROR_TOO_LARGE;
+            narrow[i] = (uint32_t)freq[i];
+        }
+        header_size = put_legacy_header(header, narrow);
+        build_huffman_code_table(model, codes);
+    } else {
+        // Формат 2: длины, канонические коды
+        uint8_t lens[256];
+        uint64_t words[256];
+        uint64_t total_symbols = 0;
+        for (int i = 0; i < 256; i++) {
+            total_symbols += freq[i];
+            if (freq[i]) info->unique++;
+        }
+        // Предел длины не больше того, что умеет читать декодер
+        int max_len = options->max_code_len;
+        if (max_len <= 0 || max_len > HUFF_MAX_DECODE_LEN) max_len = HUFF_MAX_DECODE_LEN;
+
+        uint8_t free_lens[256];
+        huff_code_lengths(model, 0, free_lens);
+        info->longest = huff_code_lengths(model, max_len, lens);
+        for (int i = 0; i < 256; i++) {
+            info->limit_cost += (uint64_t)freq[i] * lens[i];
+            info->limit_cost -= (uint64_t)freq[i] * free_lens[i];
+        }
+        huff_canonical_codes(lens, words);
+        header_size = put_canonical_header(header, lens, total_symbols);
+        for (int i = 0; i < 256; i++) {
+            codes[i].word = words[i];
+            codes[i].len = lens[i];
+        }
+    }
+
+    // 5. Длина потока известна заранее
+    uint64_t total_bits = 0;
+    int code_max = 0;
+    for (int i = 0; i < 256; i++) {
+        total_bits += freq[i] * codes[i].len;
+        if (codes[i].len > code_max) code_max = codes[i].len;
+    }
+    // В формате 2 файл из одного символа целиком описан заголовком
+    if (options->format != HUFF_FORMAT_LEGACY && info->unique == 1) total_bits = 0;
+    info->total_bits = total_bits;
+    size_t chunk_bound = ((size_t)ENCODE_IN_CHUNK * code_max + 63) / 64 * 8 + 8;
+    if (options->stats) {
+        uint8_t lens[256];
+        for (int i = 0; i < 256; i++) lens[i] = codes[i].len;
+        huff_stats_add_codes64(stats, freq, lens, total_bits);
+    }
+    huff_timer_lap(&timer, stats, HUFF_PHASE_TABLES);
+
+    if (!huff_output_write(out, header, header_size)) return huff_output_error(out);
+    huff_timer_lap(&timer, stats, HUFF_PHASE_WRITE);
+
+    // 6. Кодируем кусками прямо в выход. Кодер пишет словами по 8 байт,
+    // поэтому место берётся с запасом, но не больше, чем слов во всём
+    // оставшемся потоке; в буфер вызывающего попадает только подтверждённое
+    if (parallel && total_bits > 0) {
+        return encode_parallel(ctx, codes, data, size, out, &timer);
+    }
+    BitWriter bw;
+    bit_writer_init(&bw, NULL);
+    uint64_t written = 0;
+    for (size_t pos = 0; total_bits > 0 && pos < size; pos += ENCODE_IN_CHUNK) {
+        size_t n = size - pos < ENCODE_IN_CHUNK ? size - pos : ENCODE_IN_CHUNK;
+        uint64_t rest = (total_bits - written * 8) / 64 * 8;
+        uint8_t* dst = huff_output_reserve(out, rest < chunk_bound ? (size_t)rest : chunk_bound);
+        if (!dst) return huff_output_error(out);
+        huff_timer_lap(&timer, stats, HUFF_PHASE_WRITE);
+        bw.p = dst;
+        huff_encode_symbols(codes, data + pos, n, &bw);
+        written += (uint64_t)(bw.p - dst);
+        huff_timer_lap(&timer, stats, HUFF_PHASE_CODING);
+        if (!huff_output_commit(out, (size_t)(bw.p - dst))) return huff_output_error(out);
+        huff_progress(ctx, pos + n, size, 0);
+    }
+
+    // Записываем последний неполный байт
+    uint8_t* dst = huff_output_reserve(out, 8);
+    if (!dst) return huff_output_error(out);
+    bw.p = dst;
+    if (!huff_output_commit(out, bit_writer_finish(&bw))) return huff_output_error(out);
+    huff_timer_lap(&timer, stats, HUFF_PHASE_WRITE);
+    return HUFF_OK;
+}
+
+// --- Гистограммы кусков задачи ---
+void histogram_job(void* arg) {
+    HistogramJob* job = (HistogramJob*)arg;
+    for (size_t c = job->first; c * ENCODE_JOB_CHUNK < job->size; c += job->step) {
+        size_t pos = c * ENCODE_JOB_CHUNK;
+        size_t n = job->size - pos < ENCODE_JOB_CHUNK ? job->size - pos : ENCODE_JOB_CHUNK;
+        memset(job->chunk_freq[c], 0, sizeof(job->chunk_freq[c]));
+        huff_histogram(job->data + pos, n, job->chunk_freq[c]);
+    }
+}
+
+// --- Гистограммы всех кусков (в ctx->chunk_freq) и их сумма в freq ---
+// Возвращает 0, если не хватило памяти: тогда кодирование последовательное.
+int chunk_histograms(HuffContext* ctx, const uint8_t* data, size_t size, uint64_t* freq) {
+    size_t chunks = (size + ENCODE_JOB_CHUNK - 1) / ENCODE_JOB_CHUNK;
+    if (chunks > ctx->chunk_freq_cap) {
+        uint32_t (*grown)[256] = (uint32_t (*)[256])realloc(ctx->chunk_freq,
+                                                            chunks * sizeof(*grown));
+        if (!grown) return 0;
+        ctx->chunk_freq = grown;
+        ctx->chunk_freq_cap = chunks;
+    }
+
+    int threads = ctx->threads;
+    HistogramJob* jobs = (HistogramJob*)malloc(threads * sizeof(HistogramJob));
+    if (!jobs) return 0;
+    for (int t = 0; t < threads; t++) {
+        jobs[t] = (HistogramJob){data, size, ctx->chunk_freq, (size_t)t, (size_t)threads};
+        huff_pool_submit(ctx->pool, histogram_job, &jobs[t]);
+    }
+    huff_pool_wait(ctx->pool);
+    free(jobs);
+
+    for (size_t c = 0; c < chunks; c++) {
+        for (int i = 0; i < 256; i++) freq[i] += ctx->chunk_freq[c][i];
+    }
+    return 1;
+}
+
+// --- Код куска в буфер и оттуда в выход ---
+// Первый байт при phase != 0 принадлежит и предыдущему куску: он не
+// копируется, а запоминается в first, и его дописывает главный поток.
+void stream_job_encode(void* arg) {
+    StreamJob* job = (StreamJob*)arg;
+    BitWriter bw;
+    bit_writer_init(&bw, job->scratch);
+    bw.count = job->phase;
+    huff_encode_symbols(job->codes, job->src, job->n, &bw);
+    bit_writer_finish(&bw);
+
+    size_t bytes = (size_t)(bw.p - job->scratch);
+    size_t skip = job->phase ? 1 : 0;
+    job->first = job->scratch[0];
+    memcpy(job->dst + skip, job->scratch + skip, bytes - skip);
+}
+
+// --- Параллельное кодирование одного потока (шаг 6 encode_whole) ---
+// Круг — по куску на поток: длины кода кусков по их гистограммам, начала,
+// кодирование, стыки.
+// Незаконченный последний байт круга не фиксируется в выходе, а переходит
+// в следующий круг (carry), как остаток аккумулятора у BitWriter.
+HuffError encode_parallel(HuffContext* ctx, const HuffCode* codes, const uint8_t* data,
+                          size_t size, HuffOutput* out, HuffTimer* timer) {
+    HuffStats* stats = &ctx->stats;
+    const int threads = ctx->threads;
+    int code_max = 0;
+    for (int i = 0; i < 256; i++) {
+        if (codes[i].len > code_max) code_max = codes[i].len;
+    }
+    // Кодеру нужно место на 8 байт за каждые начатые 64 бита
+    const size_t scratch_size = (7 + (size_t)ENCODE_JOB_CHUNK * code_max + 63) / 64 * 8 + 8;
+
+    StreamJob* jobs = (StreamJob*)calloc(threads, sizeof(StreamJob));
+    uint8_t* scratch = (uint8_t*)malloc(scratch_size * threads);
+    if (!jobs || !scratch) {
+        free(jobs);
+        free(scratch);
+        return HUFF_ERROR_NO_MEMORY;
+    }
+
+    HuffError err = HUFF_OK;
+    int phase = 0;          // Сколько бит занято в незаконченном байте
+    uint8_t carry = 0;      // Сам этот байт
+    size_t pos = 0;
+    while (pos < size) {
+        // 1. Куски круга и длины их кода
+        int n = 0;
+        for (; n < threads && pos < size; n++) {
+            StreamJob* job = &jobs[n];
+            const uint32_t* freq = ctx->chunk_freq[pos / ENCODE_JOB_CHUNK];
+            job->codes = codes;
+            job->src = data + pos;
+            job->n = size - pos < ENCODE_JOB_CHUNK ? size - pos : ENCODE_JOB_CHUNK;
+            job->bits = 0;
+            for (int i = 0; i < 256; i++) job->bits += (uint64_t)freq[i] * codes[i].len;
+            job->scratch = scratch + (size_t)n * scratch_size;
+            pos += job->n;
+        }
+
+        // 2. Префиксная сумма: с какого бита от начала круга идёт кусок
+        uint64_t bit = (uint64_t)phase;
+        for (int k = 0; k < n; k++) {
+            jobs[k].phase = (int)(bit & 7);
+            jobs[k].offset = bit >> 3;
+            bit += jobs[k].bits;
+        }
+        uint8_t* dst = huff_output_reserve(out, (size_t)((bit + 7) >> 3));
+        if (!dst) {
+            err = huff_output_error(out);
+            break;
+        }
+        huff_timer_lap(timer, stats, HUFF_PHASE_WRITE);
+
+        // 3. Кодирование; незаконченный байт прошлого круга — в начало,
+        //    первый кусок его не копирует
+        dst[0] = carry;
+        for (int k = 0; k < n; k++) {
+            jobs[k].dst = dst + jobs[k].offset;
+            huff_pool_submit(ctx->pool, stream_job_encode, &jobs[k]);
+        }
+        huff_pool_wait(ctx->pool);
+
+        // 4. Стыки: первый байт куска дописывается в последний байт
+        //    предыдущего (куски длиннее байта, так что он уже записан)
+        for (int k = 0; k < n; k++) {
+            if (jobs[k].phase) jobs[k].dst[0] |= jobs[k].first;
+        }
+        huff_timer_lap(timer, stats, HUFF_PHASE_CODING);
+
+        phase = (int)(bit & 7);
+        carry = phase ? dst[bit >> 3] : 0;
+        if (!huff_output_commit(out, (size_t)(bit >> 3))) {
+            err = huff_output_error(out);
+            break;
+        }
+        huff_timer_lap(timer, stats, HUFF_PHASE_WRITE);
+        huff_progress(ctx, pos, size, 0);
+    }
+
+    // Последний неполный байт
+    if (err == HUFF_OK && phase) {
+        uint8_t* dst = huff_output_reserve(out, 1);
+        if (dst) {
+            dst[0] = carry;
+            if (!huff_output_commit(out, 1)) dst = NULL;
+        }
+        if (!dst) err = huff_output_error(out);
+        huff_timer_lap(timer, stats, HUFF_PHASE_WRITE);
+    }
+
+    free(jobs);
+    free(scratch);
+    return err;
+}
+
+// --- Кодирование входа в формат из параметров контекста ---
+HuffError huff_encode_stream(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                             HuffEncodeInfo* info) {
+    memset(info, 0, sizeof(*info));
+    HuffError err;
+    if (ctx->options.format == HUFF_FORMAT_ADAPTIVE) {
+        err = encode_adaptive(ctx, in, out, info);
+    } else if (ctx->options.format != HUFF_FORMAT_BLOCKED) {
+        err = encode_whole(ctx, in, out, info);
+    } else {
+        err = encode_blocks(ctx, in, out, &info->total_bits);
+        info->input_size = in->consumed;
+    }
+    if (err == HUFF_OK) huff_progress(ctx, info->input_size, info->input_size, 1);
+    return err;
+}
+
+// --- Чтение заголовка любого формата; вход встаёт на начало данных ---
+HuffError huff_read_header(HuffInput* in, HuffHeader* header) {
+    // Заголовок формата 4 короче остальных, а следующего кадра из канала
+    // может ещё не быть: его не ждём
+    const uint8_t* head;
+    size_t head_size = huff_input_peek(in, 4, &head);
+    int adaptive = head_size >= 4 && memcmp(head, "HUF", 3) == 0 &&
+                   head[3] == HUFF_FORMAT_ADAPTIVE;
+    head_size = huff_input_peek(in, adaptive ? 5 : HUFF_MAX_HEADER_SIZE, &head);
+    size_t head_pos;
+    if (!get_huff_header(head, head_size, &head_pos, header)) {
+        return in->error ? HUFF_ERROR_READ : HUFF_ERROR_CORRUPT;
+    }
+    huff_input_skip(in, head_pos);
+    return HUFF_OK;
+}
+
+// --- Декодирование формата 1 или 2: один поток после заголовка ---
+HuffError decode_whole(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                       const HuffHeader* header, uint64_t* decoded) {
+    HuffStats* stats = &ctx->stats;
+    HuffTimer timer;
+    huff_timer_start(&timer, ctx->options.stats != NULL);
+
+    // 1. Пустой файл
+    uint64_t total_symbols = header->total_symbols;
+    stats->symbols = total_symbols;
+    if (header->unique == 0 || total_symbols == 0) return HUFF_OK;
+
+    // 2. Особый случай: только один символ
+    if (header->unique == 1) {
+        int symbol = -1;
+        for (int i = 0; i < 256; i++) {
+            if (header->lens[i] > 0) {
+                symbol = i;
+                break;
+            }
+        }
+
+        while (*decoded < total_symbols) {
+            uint64_t left = total_symbols - *decoded;
+            size_t n = left < DECODE_OUT_CHUNK ? (size_t)left : DECODE_OUT_CHUNK;
+            uint8_t* dst = huff_output_reserve(out, n);
+            if (!dst) return huff_output_error(out);
+            memset(dst, symbol, n);
+            if (!huff_output_commit(out, n)) return huff_output_error(out);
+            *decoded += n;
+        }
+        huff_timer_lap(&timer, stats, HUFF_PHASE_CODING);
+        return HUFF_OK;
+    }
+
+    // 3. Общий случай: таблица по кодам из заголовка (память таблицы
+    //    остаётся в контексте)
+    if (!huff_table_build(&ctx->table, header->words, header->lens)) {
+        return HUFF_ERROR_CORRUPT;
+    }
+    huff_timer_lap(&timer, stats, HUFF_PHASE_TABLES);
+    uint64_t stream_start = in->consumed;
+
+    // 4. Декодируем прямо в выход. Вход виден окном: у отображённого
+    // файла это весь остаток, иначе — буфер, который догружается по мере чтения
+    BitReader br;
+    bit_reader_init(&br, NULL, 0);
+
+    while (*decoded < total_symbols) {
+        const uint8_t* window;
+        size_t avail = huff_input_peek(in, DECODE_IN_CHUNK, &window);
+        br.p = window;
+        br.end = window + avail;
+        huff_timer_lap(&timer, stats, HUFF_PHASE_READ);
+
+        uint64_t left = total_symbols - *decoded;
+        size_t want = left < DECODE_OUT_CHUNK ? (size_t)left : DECODE_OUT_CHUNK;
+        uint8_t* dst = huff_output_reserve(out, want);
+        if (!dst) return huff_output_error(out);
+        huff_timer_lap(&timer, stats, HUFF_PHASE_WRITE);
+        size_t n = huff_decode_symbols(&ctx->table, &br, dst, want, in->eof);
+        huff_timer_lap(&timer, stats, HUFF_PHASE_CODING);
+        if (!huff_output_commit(out, n)) return huff_output_error(out);
+        huff_timer_lap(&timer, stats, HUFF_PHASE_WRITE);
+        huff_input_skip(in, (size_t)(br.p - window));
+        *decoded += n;
+        huff_progress(ctx, *decoded, total_symbols, 0);
+
+        if (in->eof && (br.count < br.pad || n == 0)) break;  // Поток оборвался
+    }
+
+    // 5. Все символы на месте и ни один бит не взят из-за конца потока
+    if (*decoded != total_symbols || br.count < br.pad) {
+        return in->error ? HUFF_ERROR_READ : HUFF_ERROR_CORRUPT;
+    }
+    // Длина потока здесь известна только с точностью до байта
+    stats->bits = (in->consumed - stream_start) * 8;
+    return HUFF_OK;
+}
+
+// --- Декодирование данных после заголовка ---
+HuffError huff_decode_stream(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                             const HuffHeader* header, uint64_t* decoded) {
+    *decoded = 0;
+    HuffError err;
+    if (header->version == HUFF_FORMAT_ADAPTIVE) {
+        err = decode_adaptive(ctx, in, out, decoded);
+    } else if (header->version != HUFF_FORMAT_BLOCKED) {
+        err = decode_whole(ctx, in, out, header, decoded);
+    } else if (decode_blocks(ctx, in, out, header, decoded)) {
+        err = HUFF_OK;
+    } else {
+        // Блочный формат: итоги хранятся в хвосте файла
+        err = in->error ? HUFF_ERROR_READ : out->error ? huff_output_error(out) : HUFF_ERROR_CORRUPT;
+    }
+    if (err == HUFF_OK) huff_progress(ctx, *decoded, *decoded, 1);
+    return err;
+}
+
+// --- Наибольший размер сжатых данных ---
+size_t huff_compress_bound(const HuffContext* ctx, size_t src_len) {
+    if (ctx->options.format == HUFF_FORMAT_BLOCKED) {
+        return blocked_compress_bound(src_len, ctx->options.block_size,
+                                      ctx->options.seek_interval);
+    }
+    if (ctx->options.format == HUFF_FORMAT_ADAPTIVE) return adaptive_compress_bound(src_len);
+    // Заголовок, поток не длиннее входа и последнее 8-байтное слово кодера
+    return HUFF_MAX_HEADER_SIZE + src_len + 8;
+}
+
+// --- Сжатие буфера ---
+int64_t huff_compress(HuffContext* ctx, const void* src, size_t src_len,
+                      void* dst, size_t dst_cap) {
+    HuffInput in;
+    HuffOutput out;
+    HuffEncodeInfo info;
+    huff_input_memory(&in, src, src_len);
+    huff_output_memory(&out, dst, dst_cap);
+
+    huff_stats_begin(ctx);
+    HuffError err = huff_encode_stream(ctx, &in, &out, &info);
+    int64_t size = (int64_t)huff_output_size(&out);
+    huff_stats_end(ctx, info.input_size, (uint64_t)size);
+    huff_input_close(&in);
+    huff_output_close(&out);
+    return err == HUFF_OK ? size : err;
+}
+
+// --- Размер исходных данных по сжатым ---
+int64_t huff_decompressed_size(const void* src, size_t src_len) {
+    HuffInput in;
+    HuffHeader header;
+    huff_input_memory(&in, src, src_len);
+    HuffError err = huff_read_header(&in, &header);
+    if (err != HUFF_OK) return err;
+    // В формате 4 размер — сумма размеров кадров
+    if (header.version == HUFF_FORMAT_ADAPTIVE) return adaptive_output_size(&in);
+    if (header.version != HUFF_FORMAT_BLOCKED) return (int64_t)header.total_symbols;
+
+    // В формате 3 размер записан в хвосте
+    if (src_len < 16 || memcmp((const uint8_t*)src + src_len - 4, "HUFI", 4) != 0) {
+        return HUFF_ERROR_CORRUPT;
+    }
+    return blocked_output_size(&in, header.block_size);
+}
+
+// --- Кусок исходных данных из буфера формата 3 ---
+int64_t huff_decompress_range(HuffContext* ctx, const void* src, size_t src_len,
+                              uint64_t offset, void* dst, size_t len) {
+    HuffInput in;
+    HuffHeader header;
+    huff_input_memory(&in, src, src_len);
+    HuffError err = huff_read_header(&in, &header);
+    if (err != HUFF_OK) return err;
+    if (header.version != HUFF_FORMAT_BLOCKED) return HUFF_ERROR_CORRUPT;
+    return decode_blocked_range(ctx, &in, &header, offset, (uint8_t*)dst, len);
+}
+
+// --- Распаковка буфера ---
+int64_t huff_decompress(HuffContext* ctx, const void* src, size_t src_len,
+                        void* dst, size_t dst_cap) {
+    HuffInput in;
+    HuffOutput out;
+    HuffHeader header;
+    huff_input_memory(&in, src, src_len);
+    huff_output_memory(&out, dst, dst_cap);
+
+    uint64_t decoded = 0;
+    huff_stats_begin(ctx);
+    HuffError err = huff_read_header(&in, &header);
+    if (err == HUFF_OK) err = huff_decode_stream(ctx, &in, &out, &header, &decoded);
+    huff_stats_end(ctx, in.consumed, decoded);
+    huff_input_close(&in);
+    huff_output_close(&out);
+    return err == HUFF_OK ? (int64_t)decoded : err;
+}
@@ -0,0 +1,417 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "huffman_internal.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Пакетная обработка: список файлов и каталогов разворачивается в файлы,
+// файлы сортируются от больших к маленьким и раздаются потокам пулом с
+// кражей задач (huff_steal_run). У каждого потока свой контекст, который
+// переиспользуется от файла к файлу, поэтому буферы блоков и таблицы
+// выделяются один раз на поток. Строка о файле печатается, как только он
+// готов; в конце — сводка.
+
+#define HUFF_SUFFIX ".huff"
+
+typedef struct {
+    char* path;
+    char* output;               // NULL в режиме проверки
+    uint64_t size;
+    HuffError err;
+    int exists;                 // Выход уже есть, файл не тронут
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    double seconds;
+} BatchFile;
+
+// Буферы проверки в памяти, свои у каждого потока
+typedef struct {
+    uint8_t* packed;
+    size_t packed_cap;
+    uint8_t* back;
+    size_t back_cap;
+} BatchBuffers;
+
+typedef struct {
+    const HuffBatchOptions* options;
+    FILE* report;
+    BatchFile* files;
+    int count;
+    int cap;
+    int skipped;
+    int failed;                 // Ошибки при разборе списка
+
+    HuffContext** contexts;     // По потоку
+    HuffStats* worker_stats;
+    BatchBuffers* buffers;
+
+    pthread_mutex_t lock;       // Печать и итоги
+    HuffStats total;
+    int done;
+} Batch;
+
+// --- Имя с суффиксом .huff? ---
+static int has_suffix(const char* path) {
+    size_t len = strlen(path);
+    size_t suffix = strlen(HUFF_SUFFIX);
+    return len > suffix && strcmp(path + len - suffix, HUFF_SUFFIX) == 0;
+}
+
+// --- Имя выхода по режиму: a -> a.huff, a.huff -> a ---
+static char* output_name(const Batch* b, const char* path) {
+    if (b->options->mode == HUFF_BATCH_TEST) return NULL;
+    if (b->options->output) return strdup(b->options->output);
+    if (strcmp(path, "-") == 0) return strdup("-");
+
+    size_t len = strlen(path);
+    char* name = (char*)malloc(len + sizeof(HUFF_SUFFIX));
+    if (!name) return NULL;
+    memcpy(name, path, len + 1);
+    if (b->options->mode == HUFF_BATCH_COMPRESS) {
+        memcpy(name + len, HUFF_SUFFIX, sizeof(HUFF_SUFFIX));
+    } else {
+        name[len - strlen(HUFF_SUFFIX)] = '\0';
+    }
+    return name;
+}
+
+// --- Добавление файла в список ---
+static int add_file(Batch* b, const char* path, uint64_t size) {
+    if (b->count == b->cap) {
+        int cap = b->cap ? b->cap * 2 : 64;
+        BatchFile* grown = (BatchFile*)realloc(b->files, cap * sizeof(BatchFile));
+        if (!grown) return 0;
+        b->files = grown;
+        b->cap = cap;
+    }
+
+    BatchFile* file = &b->files[b->count];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    file->output = output_name(b, path);
+    file->size = size;
+    if (!file->path || (!file->output && b->options->mode != HUFF_BATCH_TEST)) {
+        free(file->path);
+        free(file->output);
+        return 0;
+    }
+    b->count++;
+    return 1;
+}
+
+// --- Разбор одного пути: файл, каталог (с -r обходится) или "-" ---
+// explicit — путь задан в командной строке: о пропуске сообщается.
+static void add_path(Batch* b, const char* path, int explicit) {
+    const HuffBatchOptions* options = b->options;
+    if (strcmp(path, "-") == 0) {
+        if (!add_file(b, path, 0)) b->failed++;
+        return;
+    }
+
+    // Внутри каталогов символические ссылки не разворачиваются: так обход
+    // не зациклится и не уйдёт за пределы дерева
+    struct stat st;
+    if ((explicit ? stat(path, &st) : lstat(path, &st)) != 0) {
+        fprintf(b->report, "Error: %s: no such file or directory\n", path);
+        b->failed++;
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (!options->recursive) {
+            fprintf(b->report, "%s is a directory -- skipped (use -r)\n", path);
+            b->skipped++;
+            return;
+        }
+        DIR* dir = opendir(path);
+        if (!dir) {
+            fprintf(b->report, "Error: cannot read directory %s\n", path);
+            b->failed++;
+            return;
+        }
+        size_t len = strlen(path);
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char* child = (char*)malloc(len + strlen(entry->d_name) + 2);
+            if (!child) {
+                b->failed++;
+                break;
+            }
+            sprintf(child, "%s%s%s", path, len > 0 && path[len - 1] == '/' ? "" : "/",
+                    entry->d_name);
+            add_path(b, child, 0);
+            free(child);
+        }
+        closedir(dir);
+        return;
+    }
+    if (!explicit && !S_ISREG(st.st_mode)) return;
+
+    // Сжатые файлы не сжимаются повторно, несжатые не распаковываются
+    int suffix = has_suffix(path);
+    if (options->mode == HUFF_BATCH_COMPRESS && suffix && !options->output) {
+        if (explicit) {
+            fprintf(b->report, "%s already has %s suffix -- skipped\n", path, HUFF_SUFFIX);
+        }
+        b->skipped += explicit;
+        return;
+    }
+    if (options->mode == HUFF_BATCH_DECOMPRESS && !suffix && !options->output) {
+        if (explicit) fprintf(b->report, "%s: unknown suffix -- skipped\n", path);
+        b->skipped += explicit;
+        return;
+    }
+    if (!add_file(b, path, (uint64_t)st.st_size)) b->failed++;
+}
+
+// --- Сжатие и распаковка в памяти со сверкой ---
+static HuffError test_file(Batch* b, int worker, BatchFile* file) {
+    HuffContext* ctx = b->contexts[worker];
+    BatchBuffers* buf = &b->buffers[worker];
+    HuffStats* stats = &b->worker_stats[worker];
+
+    HuffInput in;
+    if (!huff_input_open(&in, file->path)) return HUFF_ERROR_READ;
+    const uint8_t* data;
+    size_t size = huff_input_peek(&in, (size_t)-1, &data);
+    if (in.error) {
+        huff_input_close(&in);
+        return HUFF_ERROR_READ;
+    }
+
+    // Буферы растут до самого большого файла потока
+    size_t bound = huff_compress_bound(ctx, size);
+    if (bound > buf->packed_cap) {
+        free(buf->packed);
+        buf->packed = (uint8_t*)malloc(bound);
+        buf->packed_cap = buf->packed ? bound : 0;
+    }
+    if (size > buf->back_cap) {
+        free(buf->back);
+        buf->back = (uint8_t*)malloc(size);
+        buf->back_cap = buf->back ? size : 0;
+    }
+    if (buf->packed_cap < bound || buf->back_cap < size) {
+        huff_input_close(&in);
+        return HUFF_ERROR_NO_MEMORY;
+    }
+
+    int64_t packed = huff_compress(ctx, data, size, buf->packed, bound);
+    int64_t unpacked = packed;
+    if (packed >= 0) {
+        // Время распаковки добавляется к фазам сжатия, объёмы — от сжатия
+        HuffStats both = *stats;
+        unpacked = huff_decompress(ctx, buf->packed, (size_t)packed, buf->back, size);
+        for (int p = 0; p < HUFF_PHASE_COUNT; p++) {
+            both.wall[p] += stats->wall[p];
+            both.cpu[p] += stats->cpu[p];
+        }
+        *stats = both;
+    }
+
+    HuffError err = HUFF_OK;
+    if (packed < 0) err = (HuffError)packed;
+    else if (unpacked < 0) err = (HuffError)unpacked;
+    else if ((size_t)unpacked != size || (size > 0 && memcmp(buf->back, data, size) != 0)) {
+        err = HUFF_ERROR_CORRUPT;
+    }
+    huff_input_close(&in);
+    return err;
+}
+
+// --- Строка о готовом файле ---
+static void print_file(const Batch* b, const BatchFile* file) {
+    if (file->exists) {
+        fprintf(b->report, "Error: %s already exists (use -f to overwrite)\n", file->output);
+        return;
+    }
+    if (file->err != HUFF_OK) {
+        fprintf(b->report, "Error: %s: %s\n", file->path, huff_error_string(file->err));
+        return;
+    }
+    if (b->options->quiet) return;
+
+    // Скорость считается по исходным данным
+    uint64_t original = b->options->mode == HUFF_BATCH_DECOMPRESS ? file->bytes_out
+                                                                  : file->bytes_in;
+    uint64_t packed = b->options->mode == HUFF_BATCH_DECOMPRESS ? file->bytes_in
+                                                                : file->bytes_out;
+    fprintf(b->report, "%s%s%s: %lu -> %lu bytes (%.2f%%), %.3f ms, %.1f MB/s%s\n",
+            file->path, file->output ? " -> " : "", file->output ? file->output : "",
+            (unsigned long)file->bytes_in, (unsigned long)file->bytes_out,
+            original > 0 ? 100.0 * packed / original : 0.0, file->seconds * 1e3,
+            file->seconds > 0 ? original / file->seconds / 1e6 : 0.0,
+            b->options->mode == HUFF_BATCH_TEST ? ", OK" : "");
+}
+
+// --- Один файл (выполняется в потоке worker) ---
+static void run_file(void* arg, int task, int worker) {
+    Batch* b = (Batch*)arg;
+    BatchFile* file = &b->files[task];
+    HuffContext* ctx = b->contexts[worker];
+    HuffStats* stats = &b->worker_stats[worker];
+    const HuffBatchOptions* options = b->options;
+    memset(stats, 0, sizeof(*stats));
+
+    double start = huff_wall_time();
+    struct stat st;
+    if (file->output && strcmp(file->output, "-") != 0 && !options->force &&
+        stat(file->output, &st) == 0) {
+        file->exists = 1;
+        file->err = HUFF_ERROR_WRITE;
+    } else if (options->mode == HUFF_BATCH_COMPRESS) {
+        file->err = huff_compress_file(ctx, file->path, file->output);
+    } else if (options->mode == HUFF_BATCH_DECOMPRESS) {
+        file->err = huff_decompress_file(ctx, file->path, file->output);
+    } else {
+        file->err = test_file(b, worker, file);
+    }
+    file->seconds = huff_wall_time() - start;
+    file->bytes_in = stats->bytes_in;
+    file->bytes_out = stats->bytes_out;
+
+    // Недописанный выход не оставляем
+    if (file->err != HUFF_OK && !file->exists && file->output &&
+        strcmp(file->output, "-") != 0) {
+        remove(file->output);
+    }
+
+    pthread_mutex_lock(&b->lock);
+    if (file->err == HUFF_OK) {
+        huff_stats_merge(&b->total, stats);
+        b->total.bytes_in += stats->bytes_in;
+        b->total.bytes_out += stats->bytes_out;
+        b->total.blocks += stats->blocks;
+    }
+    b->done++;
+    print_file(b, file);
+    pthread_mutex_unlock(&b->lock);
+}
+
+// --- Сначала большие файлы ---
+static int compare_files(const void* a, const void* b) {
+    uint64_t x = ((const BatchFile*)a)->size;
+    uint64_t y = ((const BatchFile*)b)->size;
+    return x > y ? -1 : x < y;
+}
+
+// --- Сводка ---
+static void print_summary(const Batch* b, int workers, double wall, double cpu) {
+    int ok = 0;
+    int failed = b->failed;
+    for (int i = 0; i < b->count; i++) {
+        if (b->files[i].err == HUFF_OK) ok++;
+        else failed++;
+    }
+
+    const HuffStats* total = &b->total;
+    int decompress = b->options->mode == HUFF_BATCH_DECOMPRESS;
+    uint64_t original = decompress ? total->bytes_out : total->bytes_in;
+    uint64_t packed = decompress ? total->bytes_in : total->bytes_out;
+    fprintf(b->report, "\n=== Batch Summary ===\n");
+    fprintf(b->report, "Files:      %d ok, %d failed, %d skipped\n", ok, failed, b->skipped);
+    fprintf(b->report, "Data:       %lu -> %lu bytes (%.2f%%)\n",
+            (unsigned long)total->bytes_in, (unsigned long)total->bytes_out,
+            original > 0 ? 100.0 * packed / original : 0.0);
+    fprintf(b->report, "Time:       %.3f s wall, %.3f s cpu, %d thread%s\n", wall, cpu, workers,
+            workers == 1 ? "" : "s");
+    if (wall > 0) {
+        fprintf(b->report, "Throughput: %.1f MB/s of original data\n", original / wall / 1e6);
+    }
+}
+
+// --- Параметры пакета по умолчанию ---
+void huff_default_batch_options(HuffBatchOptions* batch) {
+    memset(batch, 0, sizeof(*batch));
+    batch->mode = HUFF_BATCH_COMPRESS;
+    huff_default_options(&batch->options);
+}
+
+// --- Обработка файлов и каталогов ---
+int huff_batch(const HuffBatchOptions* options, char* const* paths, int count) {
+    Batch b;
+    memset(&b, 0, sizeof(b));
+    b.options = options;
+    b.report = stdout;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(paths[i], "-") == 0 ||
+            (options->output && strcmp(options->output, "-") == 0)) {
+            b.report = stderr;
+        }
+    }
+
+    // 1. Разворачиваем список
+    double start = huff_wall_time();
+    double cpu_start = huff_process_time();
+    if (options->output && count != 1) {
+        fprintf(b.report, "Error: an output name needs exactly one input file\n");
+        return count > 0 ? count : 1;
+    }
+    for (int i = 0; i < count; i++) add_path(&b, paths[i], 1);
+    if (options->output && b.count > 1) {
+        fprintf(b.report, "Error: an output name needs exactly one input file\n");
+        b.failed += b.count;
+        b.count = 0;
+    }
+    qsort(b.files, b.count, sizeof(BatchFile), compare_files);
+
+    // 2. По контексту на поток. Единственный файл получает все потоки
+    //    для своих блоков, иначе параллельны сами файлы
+    int jobs = options->jobs > 0 ? options->jobs : huff_cpu_count();
+    int workers = b.count < jobs ? b.count : jobs;
+    if (workers < 1) workers = 1;
+    HuffOptions used = options->options;
+    used.threads = b.count == 1 ? jobs : 1;
+    used.progress = NULL;
+
+    b.contexts = (HuffContext**)calloc(workers, sizeof(HuffContext*));
+    b.worker_stats = (HuffStats*)calloc(workers, sizeof(HuffStats));
+    b.buffers = (BatchBuffers*)calloc(workers, sizeof(BatchBuffers));
+    int ok = b.contexts && b.worker_stats && b.buffers;
+    for (int w = 0; ok && w < workers; w++) {
+        used.stats = &b.worker_stats[w];
+        b.contexts[w] = huff_context_create(&used);
+        if (!b.contexts[w]) ok = 0;
+    }
+    pthread_mutex_init(&b.lock, NULL);
+
+    // 3. Работаем
+    int ran = ok && b.count > 0 ? huff_steal_run(workers, b.count, run_file, &b) : 0;
+    if (b.count > 0 && ran == 0) {
+        fprintf(b.report, "Error: out of memory\n");
+        for (int i = 0; i < b.count; i++) b.files[i].err = HUFF_ERROR_NO_MEMORY;
+    }
+
+    double wall = huff_wall_time() - start;
+    double cpu = huff_process_time() - cpu_start;
+    print_summary(&b, ran, wall, cpu);
+    if (options->stats) {
+        b.total.total_wall = wall;
+        b.total.total_cpu = cpu;
+        huff_print_stats(b.report, &b.total);
+    }
+
+    // 4. Итог: сколько файлов не удалось
+    int failed = b.failed;
+    for (int i = 0; i < b.count; i++) {
+        if (b.files[i].err != HUFF_OK) failed++;
+        free(b.files[i].path);
+        free(b.files[i].output);
+    }
+    for (int w = 0; b.contexts && w < workers; w++) huff_context_free(b.contexts[w]);
+    for (int w = 0; b.buffers && w < workers; w++) {
+        free(b.buffers[w].packed);
+        free(b.buffers[w].back);
+    }
+    pthread_mutex_destroy(&b.lock);
+    free(b.contexts);
+    free(b.worker_stats);
+    free(b.buffers);
+    free(b.files);
+    return failed;
+}
@@ -0,0 +1,1283 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE         // wait4
+
+// Замеры библиотеки: гистограмма, построение кодов, сжатие и распаковка
+// (четырьмя потоками и одним) на файлах и сгенерированных входах.
+// Каждый замер повторяется на прогретых данных, в отчёт идёт медиана.
+// Каждый вход меряется в отдельном процессе, поэтому пик памяти — его
+// собственный. Кодирование однопоточное, чтобы числа были сравнимы.
+// Запуск: ./huffman_bench [--max-size N] [--min-time S] [--json FILE]
+//                         [--messages | --stream N | --pipeline MBPS | --kernels |
+//                          --scaling N]
+//                         [файл ...]
+//   файлы по умолчанию — a.txt и b.txt;
+//   N — наибольший сгенерированный вход (1K, 64K, 1M, ..., 1G), 0 — без них;
+//   S — сколько секунд повторять каждый замер (не меньше BENCH_MIN_RUNS раз);
+//   --messages — вместо замеров файлов задержка коротких сообщений
+//   (64 Б .. 4 КБ, нарезанных из файлов): заголовок на сообщение в форматах
+//   1 и 2 против встроенной статической таблицы;
+//   --stream N — вместо замеров проход N байт (например, 6G) через каналы
+//   форматами 3 и 4 с проверкой CRC32C: вход больше 4 ГБ при постоянной
+//   памяти; вход — zipf и, отдельно, один повторённый символ;
+//   --pipeline MBPS — вместо замеров сжатие и распаковка через устройство
+//   со скоростью MBPS МБ/с без конвейера ввода-вывода и с ним, а затем
+//   файлами (отображение, потоки, io_uring);
+//   --kernels — замеры файлов с каждым вариантом ядер, который умеет
+//   процессор (generic, bmi2), и сводка по ним. Без него ядра — те,
+//   что выбрала библиотека (переменная HUFF_CPU ограничивает выбор);
+//   --scaling N — первый файл, повторённый до N байт, сжимается форматом 2
+//   (один поток кода) на 1, 2, 4, ... потоках; каждый результат сверяется
+//   с однопоточным байт в байт.
+
+#include "huffman_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#define BENCH_MIN_SIZE (1024 * 1024)    // Короткий файл замеряется повторённым до 1 МБ
+#define BENCH_MIN_RUNS 3
+#define BENCH_MAX_RUNS 1001
+#define BENCH_DEFAULT_MAX_SIZE (16u << 20)
+#define BENCH_MESSAGES 1024             // Сообщений каждого размера
+
+// --- Замеряемые операции ---
+enum { OP_HISTOGRAM, OP_TREE, OP_ENCODE, OP_DECODE, OP_DECODE_ONE, OP_COUNT };
+
+static const char* op_names[OP_COUNT] = {
+    "histogram", "tree build", "encode", "decode", "decode 1 stream"
+};
+static const char* op_keys[OP_COUNT] = {
+    "histogram", "tree", "encode", "decode", "decode_1stream"
+};
+
+// --- Итоги одного входа (передаются из процесса замера через канал) ---
+typedef struct {
+    char name[48];              // У повторённого файла — с числом копий: "a.txt x2"
+    uint64_t size;
+    uint64_t source_size;       // Размер файла на диске (0 — вход сгенерирован)
+    uint64_t packed;            // Сжатый размер (четыре потока)
+    double seconds[OP_COUNT];   // Медиана одного прогона
+    double cycles[OP_COUNT];    // Медиана тактов TSC одного прогона
+    int runs[OP_COUNT];
+    double pair_symbols;        // Символов на просмотр таблицы пар (0 — не считалось)
+    int cpu;                    // HuffCpuLevel, с которым шли замеры
+    long peak_rss_kb;
+    int ok;
+} BenchResult;
+
+// --- Входы: файл или сгенерированные данные заданного размера ---
+// INPUT_STREAM — не замеры, а проход через каналы (bench_stream)
+typedef enum { INPUT_FILE, INPUT_RANDOM, INPUT_SINGLE, INPUT_ZIPF, INPUT_STREAM } InputKind;
+
+typedef struct {
+    InputKind kind;
+    const char* filename;
+    uint64_t size;
+    HuffFormat format;          // Только INPUT_STREAM
+    InputKind fill;             // Только INPUT_STREAM: INPUT_ZIPF или INPUT_SINGLE
+} InputSpec;
+
+// --- Что именно повторяется при замере ---
+typedef struct {
+    HuffContext* ctx;
+    const uint8_t* src;
+    size_t size;
+    uint8_t* dst;
+    size_t cap;
+    int64_t result;
+    uint32_t freq[256];
+    uint8_t lens[256];
+    // Сообщения: count штук длины size, i-е — с src + i * stride; сжатое
+    // i-е лежит в dst + i * slot и занимает packed[i] байт
+    const HuffStaticCoder* coder;
+    int count;
+    size_t stride;
+    size_t slot;
+    size_t* packed;
+    uint8_t* back;
+} BenchCall;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t now_cycles(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// --- Частота TSC, ГГц (0 — счётчика нет) ---
+static double tsc_ghz(void) {
+    double t = now_seconds();
+    uint64_t c = now_cycles();
+    while (now_seconds() - t < 0.05) {
+    }
+    return (now_cycles() - c) / (now_seconds() - t) / 1e9;
+}
+
+static void call_histogram(BenchCall* call) {
+    memset(call->freq, 0, sizeof(call->freq));
+    huff_histogram(call->src, call->size, call->freq);
+}
+
+static void call_tree(BenchCall* call) {
+    huff_code_lengths(call->freq, HUFF_DEFAULT_MAX_CODE_LEN, call->lens);
+}
+
+static void call_compress(BenchCall* call) {
+    call->result = huff_compress(call->ctx, call->src, call->size, call->dst, call->cap);
+}
+
+static void call_decompress(BenchCall* call) {
+    call->result = huff_decompress(call->ctx, call->src, call->size, call->dst, call->cap);
+}
+
+static void call_compress_messages(BenchCall* call) {
+    call->result = 0;
+    for (int i = 0; i < call->count; i++) {
+        const uint8_t* msg = call->src + i * call->stride;
+        uint8_t* dst = call->dst + i * call->slot;
+        int64_t r = call->coder
+                  ? huff_static_encode(call->coder, msg, call->size, dst, call->slot)
+                  : huff_compress(call->ctx, msg, call->size, dst, call->slot);
+        if (r <= 0) return;
+        call->packed[i] = (size_t)r;
+        call->result += r;
+    }
+}
+
+static void call_decompress_messages(BenchCall* call) {
+    call->result = 0;
+    for (int i = 0; i < call->count; i++) {
+        const uint8_t* src = call->dst + i * call->slot;
+        uint8_t* back = call->back + i * call->size;
+        int64_t r = call->coder
+                  ? huff_static_decode(call->coder, src, call->packed[i], back, call->size)
+                  : huff_decompress(call->ctx, src, call->packed[i], back, call->size);
+        if (r != (int64_t)call->size) return;
+        call->result += r;
+    }
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// --- Медиана прогонов fn: один прогрев, потом не меньше BENCH_MIN_RUNS ---
+// прогонов и не меньше min_time секунд
+static void measure(void (*fn)(BenchCall*), BenchCall* call, double min_time,
+                    BenchResult* res, int op) {
+    static double times[BENCH_MAX_RUNS];
+    static double cycles[BENCH_MAX_RUNS];
+    fn(call);
+
+    int runs = 0;
+    double start = now_seconds();
+    while (runs < BENCH_MAX_RUNS &&
+           (runs < BENCH_MIN_RUNS || now_seconds() - start < min_time)) {
+        uint64_t c = now_cycles();
+        double t = now_seconds();
+        fn(call);
+        times[runs] = now_seconds() - t;
+        cycles[runs] = (double)(now_cycles() - c);
+        runs++;
+    }
+
+    qsort(times, runs, sizeof(double), compare_doubles);
+    qsort(cycles, runs, sizeof(double), compare_doubles);
+    res->seconds[op] = times[runs / 2];
+    res->cycles[op] = cycles[runs / 2];
+    res->runs[op] = runs;
+}
+
+// --- Чтение файла целиком ---
+static uint8_t* load_file(const char* filename, size_t* size) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len <= 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    uint8_t* data = (uint8_t*)malloc((size_t)len);
+    if (!data || fread(data, 1, (size_t)len, f) != (size_t)len) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *size = (size_t)len;
+    return data;
+}
+
+// --- Файл для замеров: короткий повторяется до BENCH_MIN_SIZE ---
+// На меньших входах время одного прогона сравнимо с точностью часов.
+// В copies — сколько раз файл уложен подряд.
+static uint8_t* load_repeated(const char* filename, size_t* size, int* copies) {
+    size_t len;
+    uint8_t* data = load_file(filename, &len);
+    if (!data) return NULL;
+    int n = 1;
+    while (n * len < BENCH_MIN_SIZE) n++;
+    if (n > 1) {
+        uint8_t* grown = (uint8_t*)realloc(data, n * len);
+        if (!grown) {
+            free(data);
+            return NULL;
+        }
+        data = grown;
+        for (int k = 1; k < n; k++) memcpy(data + k * len, data, len);
+    }
+    *size = n * len;
+    *copies = n;
+    return data;
+}
+
+// --- Байты по закону Ципфа; state продолжается от куска к куску ---
+// Вероятность символа k из 256 пропорциональна 1 / (k + 1); старшие 16 бит
+// случайного числа выбирают символ по таблице.
+static void zipf_fill(uint8_t* data, size_t size, uint64_t* state) {
+    static uint8_t lookup[65536];
+    static int ready = 0;
+    if (!ready) {
+        double total = 0;
+        for (int k = 0; k < 256; k++) total += 1.0 / (k + 1);
+        double cumulative = 1.0 / total;
+        int k = 0;
+        for (int i = 0; i < 65536; i++) {
+            while (k < 255 && (i + 0.5) / 65536 > cumulative) {
+                k++;
+                cumulative += 1.0 / (k + 1) / total;
+            }
+            lookup[i] = (uint8_t)k;
+        }
+        ready = 1;
+    }
+    uint64_t s = *state;
+    for (size_t i = 0; i < size; i++) {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        data[i] = lookup[s >> 48];
+    }
+    *state = s;
+}
+
+// --- Генерация входа (данные одинаковы от запуска к запуску) ---
+static uint8_t* generate_input(InputKind kind, size_t size) {
+    uint8_t* data = (uint8_t*)malloc(size);
+    if (!data) return NULL;
+
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    if (kind == INPUT_SINGLE) {
+        memset(data, 'a', size);
+    } else if (kind == INPUT_RANDOM) {
+        for (size_t i = 0; i < size; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            data[i] = (uint8_t)(state >> 56);
+        }
+    } else {
+        zipf_fill(data, size, &state);
+    }
+    return data;
+}
+
+// --- Размер с суффиксом K/M/G ---
+static void format_size(char* buf, size_t cap, uint64_t size) {
+    if (size >= (1u << 30) && size % (1u << 30) == 0) {
+        snprintf(buf, cap, "%luG", (unsigned long)(size >> 30));
+    } else if (size >= (1u << 20) && size % (1u << 20) == 0) {
+        snprintf(buf, cap, "%luM", (unsigned long)(size >> 20));
+    } else if (size >= 1024 && size % 1024 == 0) {
+        snprintf(buf, cap, "%luK", (unsigned long)(size >> 10));
+    } else {
+        snprintf(buf, cap, "%lu", (unsigned long)size);
+    }
+}
+
+// --- Сколько символов в среднем даёт один просмотр таблицы пар ---
+// Кодами входа (lens) проходит его жадно, как декодер: пара берётся, если
+// оба кода целиком в окне root_bits построенной по ним таблицы.
+static double pair_symbols(const uint8_t* data, size_t n, const uint8_t* lens) {
+    uint64_t words[256];
+    HuffDecodeTable table = {0};
+    if (!huff_canonical_codes(lens, words) || !huff_table_build(&table, words, lens)) return 0;
+    const int root = table.root_bits;
+    huff_table_free(&table);
+
+    uint64_t lookups = 0;
+    size_t i = 0;
+    while (i < n) {
+        int len = lens[data[i]];
+        i += i + 1 < n && len + lens[data[i + 1]] <= root ? 2 : 1;
+        lookups++;
+    }
+    return lookups ? (double)n / lookups : 0;
+}
+
+// --- Замер одного входа (выполняется в отдельном процессе) ---
+static void bench_input(const InputSpec* spec, double min_time, BenchResult* res) {
+    static const char* kind_names[] = {"", "random", "single", "zipf"};
+    size_t n = (size_t)spec->size;
+    int copies = 1;
+    uint8_t* data = spec->kind == INPUT_FILE ? load_repeated(spec->filename, &n, &copies)
+                                             : generate_input(spec->kind, n);
+    if (spec->kind == INPUT_FILE) {
+        if (copies > 1) {
+            snprintf(res->name, sizeof(res->name), "%s x%d", spec->filename, copies);
+        } else {
+            snprintf(res->name, sizeof(res->name), "%s", spec->filename);
+        }
+        if (data) res->source_size = n / copies;
+    } else {
+        char size[24];
+        format_size(size, sizeof(size), n);
+        snprintf(res->name, sizeof(res->name), "%s %s", kind_names[spec->kind], size);
+    }
+    if (!data) return;
+    res->cpu = huff_cpu_level();
+
+    HuffOptions options;
+    huff_default_options(&options);
+    options.threads = 1;
+    HuffContext* four = huff_context_create(&options);
+    options.streams = 1;
+    HuffContext* one = huff_context_create(&options);
+    size_t cap = four ? huff_compress_bound(four, n) : 0;
+    uint8_t* packed = (uint8_t*)malloc(cap);
+    uint8_t* back = (uint8_t*)malloc(n);
+    if (!four || !one || !packed || !back) {
+        free(packed);
+        free(back);
+        huff_context_free(four);
+        huff_context_free(one);
+        free(data);
+        return;
+    }
+    res->size = n;
+
+    // 1. Гистограмма и построение кодов по ней
+    BenchCall call = {0};
+    call.src = data;
+    call.size = n;
+    measure(call_histogram, &call, min_time, res, OP_HISTOGRAM);
+    measure(call_tree, &call, min_time, res, OP_TREE);
+    res->pair_symbols = pair_symbols(data, n, call.lens);
+
+    // 2. Сжатие и распаковка четырьмя потоками на блок
+    call.ctx = four;
+    call.dst = packed;
+    call.cap = cap;
+    measure(call_compress, &call, min_time, res, OP_ENCODE);
+    res->packed = call.result > 0 ? (uint64_t)call.result : 0;
+
+    BenchCall unpack = {0};
+    unpack.ctx = four;
+    unpack.src = packed;
+    unpack.size = (size_t)res->packed;
+    unpack.dst = back;
+    unpack.cap = n;
+    measure(call_decompress, &unpack, min_time, res, OP_DECODE);
+    res->ok = res->packed > 0 && unpack.result == (int64_t)n && memcmp(back, data, n) == 0;
+
+    // 3. Распаковка одного потока на блок (его сжатие не замеряется)
+    call.ctx = one;
+    call_compress(&call);
+    unpack.ctx = one;
+    unpack.size = call.result > 0 ? (size_t)call.result : 0;
+    measure(call_decompress, &unpack, min_time, res, OP_DECODE_ONE);
+    if (unpack.result != (int64_t)n || memcmp(back, data, n) != 0) res->ok = 0;
+
+    free(packed);
+    free(back);
+    huff_context_free(four);
+    huff_context_free(one);
+    free(data);
+}
+
+// --- Поток через каналы: генератор -> кодер -> декодер -> проверка ---
+// Вход не лежит ни в памяти, ни на диске: генератор пишет его в канал
+// кусками, кодер и декодер работают с каналами как с файлами (/dev/fd/N),
+// а проверка считает байты и CRC32C того, что вышло из декодера. Так
+// через библиотеку проходят входы больше 4 ГБ, а пик памяти показывает,
+// что она не копит данные.
+#define BENCH_STREAM_CHUNK (1024 * 1024)
+
+typedef struct {
+    int fd;
+    uint64_t size;
+    InputKind fill;
+    uint32_t crc;
+} StreamSource;
+
+typedef struct {
+    HuffContext* ctx;
+    int decode;
+    int in_fd;                  // Концы каналов этой стадии
+    int out_fd;
+    HuffError err;
+} StreamStage;
+
+static void* stream_generate(void* arg) {
+    StreamSource* src = (StreamSource*)arg;
+    uint8_t* buf = (uint8_t*)malloc(BENCH_STREAM_CHUNK);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    uint64_t done = 0;
+    while (buf && done < src->size) {
+        size_t n = src->size - done < BENCH_STREAM_CHUNK ? (size_t)(src->size - done)
+                                                         : BENCH_STREAM_CHUNK;
+        if (src->fill == INPUT_SINGLE) {
+            memset(buf, 'a', n);
+        } else {
+            zipf_fill(buf, n, &state);
+        }
+        src->crc = huff_crc32c(src->crc, buf, n);
+        size_t put = 0;
+        while (put < n) {
+            ssize_t w = write(src->fd, buf + put, n - put);
+            if (w <= 0) break;
+            put += (size_t)w;
+        }
+        if (put < n) break;
+        done += n;
+    }
+    free(buf);
+    close(src->fd);
+    return NULL;
+}
+
+// Стадия открывает свои каналы заново по имени и по концу работы закрывает
+// исходные концы, чтобы следующая стадия увидела конец данных
+static void* stream_stage(void* arg) {
+    StreamStage* stage = (StreamStage*)arg;
+    char input[32], output[32];
+    snprintf(input, sizeof(input), "/dev/fd/%d", stage->in_fd);
+    snprintf(output, sizeof(output), "/dev/fd/%d", stage->out_fd);
+    stage->err = stage->decode ? huff_decompress_file(stage->ctx, input, output)
+                               : huff_compress_file(stage->ctx, input, output);
+    close(stage->in_fd);
+    close(stage->out_fd);
+    return NULL;
+}
+
+// --- Проход одного формата (выполняется в отдельном процессе) ---
+static void bench_stream(const InputSpec* spec, BenchResult* res) {
+    char size[24];
+    format_size(size, sizeof(size), spec->size);
+    snprintf(res->name, sizeof(res->name), "stream %s %s, format %d",
+             spec->fill == INPUT_SINGLE ? "single" : "zipf", size, spec->format);
+    signal(SIGPIPE, SIG_IGN);
+
+    int fds[3][2];
+    for (int i = 0; i < 3; i++) {
+        if (pipe(fds[i]) != 0) return;
+    }
+    HuffStats stats;
+    memset(&stats, 0, sizeof(stats));
+    HuffOptions options;
+    huff_default_options(&options);
+    options.format = spec->format;
+    options.stats = &stats;
+    HuffContext* enc = huff_context_create(&options);
+    options.stats = NULL;
+    HuffContext* dec = huff_context_create(&options);
+    if (!enc || !dec) return;
+
+    StreamSource src = {fds[0][1], spec->size, spec->fill, 0};
+    StreamStage stages[2] = {
+        {enc, 0, fds[0][0], fds[1][1], HUFF_OK},
+        {dec, 1, fds[1][0], fds[2][1], HUFF_OK}
+    };
+    double start = now_seconds();
+    pthread_t threads[3];
+    pthread_create(&threads[0], NULL, stream_generate, &src);
+    pthread_create(&threads[1], NULL, stream_stage, &stages[0]);
+    pthread_create(&threads[2], NULL, stream_stage, &stages[1]);
+
+    uint8_t* buf = (uint8_t*)malloc(BENCH_STREAM_CHUNK);
+    uint64_t got = 0;
+    uint32_t crc = 0;
+    ssize_t r;
+    while (buf && (r = read(fds[2][0], buf, BENCH_STREAM_CHUNK)) > 0) {
+        crc = huff_crc32c(crc, buf, (size_t)r);
+        got += (uint64_t)r;
+    }
+    close(fds[2][0]);
+    for (int i = 0; i < 3; i++) pthread_join(threads[i], NULL);
+    free(buf);
+
+    res->size = got;
+    res->packed = stats.bytes_out;
+    res->seconds[OP_ENCODE] = now_seconds() - start;
+    res->runs[OP_ENCODE] = 1;
+    res->ok = stages[0].err == HUFF_OK && stages[1].err == HUFF_OK &&
+              got == spec->size && crc == src.crc;
+    huff_context_free(enc);
+    huff_context_free(dec);
+}
+
+// --- Замер в дочернем процессе: пик памяти берётся из wait4 ---
+static int run_isolated(const InputSpec* spec, double min_time, BenchResult* res) {
+    memset(res, 0, sizeof(*res));
+    int fds[2];
+    if (pipe(fds) != 0) return 0;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        if (spec->kind == INPUT_STREAM) bench_stream(spec, res);
+        else bench_input(spec, min_time, res);
+        ssize_t put = write(fds[1], res, sizeof(*res));
+        _exit(put == (ssize_t)sizeof(*res) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    size_t got = 0;
+    while (got < sizeof(*res)) {
+        ssize_t r = read(fds[0], (char*)res + got, sizeof(*res) - got);
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return 0;
+    res->peak_rss_kb = usage.ru_maxrss;
+    return got == sizeof(*res) && res->size > 0;
+}
+
+// --- Размер с суффиксом K/M/G ---
+static uint64_t parse_size(const char* text) {
+    char* end;
+    uint64_t value = strtoull(text, &end, 10);
+    if (*end == 'K' || *end == 'k') value <<= 10;
+    if (*end == 'M' || *end == 'm') value <<= 20;
+    if (*end == 'G' || *end == 'g') value <<= 30;
+    return value;
+}
+
+// --- Текстовый отчёт по входу ---
+static void print_result(const BenchResult* res, double ghz) {
+    printf("%s: %lu -> %lu bytes (%.1f%%), peak RSS %.1f MB, %s kernels%s\n",
+           res->name, (unsigned long)res->size, (unsigned long)res->packed,
+           100.0 * res->packed / res->size, res->peak_rss_kb / 1024.0,
+           huff_cpu_name((HuffCpuLevel)res->cpu), res->ok ? "" : "  MISMATCH");
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (op == OP_TREE) {
+            printf("  %-16s %9.2f us    %9.0f cycles     (%d runs)\n", op_names[op],
+                   res->seconds[op] * 1e6, ghz > 0 ? res->cycles[op] : 0.0, res->runs[op]);
+        } else {
+            printf("  %-16s %9.1f MB/s  %9.2f cycles/B   (%d runs)\n", op_names[op],
+                   res->size / res->seconds[op] / 1e6,
+                   ghz > 0 ? res->cycles[op] / res->size : 0.0, res->runs[op]);
+        }
+    }
+    if (res->pair_symbols > 0) {
+        printf("  %-16s %9.3f symbols per lookup (+%.1f%% extra)\n", "pair table",
+               res->pair_symbols, 100.0 * (res->pair_symbols - 1));
+    }
+}
+
+// --- Отчёт в JSON ---
+static void write_json(FILE* f, const BenchResult* results, int count, double ghz) {
+    fprintf(f, "{\n  \"tsc_ghz\": %.3f,\n  \"threads\": 1,\n  \"results\": [\n", ghz);
+    for (int i = 0; i < count; i++) {
+        const BenchResult* res = &results[i];
+        fprintf(f, "    {\"input\": \"%s\", \"size\": %lu, \"packed\": %lu, "
+                   "\"peak_rss_kb\": %ld, \"kernels\": \"%s\", \"ok\": %s",
+                res->name, (unsigned long)res->size, (unsigned long)res->packed,
+                res->peak_rss_kb, huff_cpu_name((HuffCpuLevel)res->cpu),
+                res->ok ? "true" : "false");
+        if (res->source_size) {
+            fprintf(f, ", \"source_size\": %lu", (unsigned long)res->source_size);
+        }
+        for (int op = 0; op < OP_COUNT; op++) {
+            if (op == OP_TREE) {
+                fprintf(f, ",\n     \"%s\": {\"us\": %.3f, \"cycles\": %.0f, \"runs\": %d}",
+                        op_keys[op], res->seconds[op] * 1e6, res->cycles[op], res->runs[op]);
+            } else {
+                fprintf(f, ",\n     \"%s\": {\"mb_s\": %.1f, \"cycles_per_byte\": %.3f, "
+                           "\"runs\": %d}",
+                        op_keys[op], res->size / res->seconds[op] / 1e6,
+                        res->cycles[op] / res->size, res->runs[op]);
+            }
+        }
+        fprintf(f, ",\n     \"pair_symbols_per_lookup\": %.3f", res->pair_symbols);
+        fprintf(f, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+// --- Проход через каналы форматами 3 и 4: объём, скорость, пик памяти ---
+// Вход из одного символа — отдельный проход: потоки его блоков пусты.
+static int run_stream(uint64_t size, FILE* json) {
+    static const HuffFormat formats[] = {HUFF_FORMAT_BLOCKED, HUFF_FORMAT_ADAPTIVE};
+    static const InputKind fills[] = {INPUT_ZIPF, INPUT_SINGLE};
+    enum { PASSES = 4 };
+    printf("Streaming through pipes: generator -> encode -> decode -> CRC32C check\n\n");
+    if (json) fprintf(json, "{\n  \"stream\": [\n");
+    int ok = 1;
+    for (int i = 0; i < PASSES; i++) {
+        InputSpec spec = {INPUT_STREAM, NULL, size, formats[i % 2], fills[i / 2]};
+        BenchResult res;
+        if (!run_isolated(&spec, 0, &res)) {
+            printf("Error: cannot run %s\n", res.name[0] ? res.name : "stream");
+            ok = 0;
+            break;
+        }
+        double seconds = res.seconds[OP_ENCODE];
+        printf("%s: %lu -> %lu bytes (%.1f%%), %.1f s, %.1f MB/s, peak RSS %.1f MB%s\n",
+               res.name, (unsigned long)res.size, (unsigned long)res.packed,
+               100.0 * res.packed / res.size, seconds, res.size / seconds / 1e6,
+               res.peak_rss_kb / 1024.0, res.ok ? "" : "  MISMATCH");
+        if (json) {
+            fprintf(json, "    {\"input\": \"%s\", \"format\": %d, \"size\": %lu, "
+                          "\"packed\": %lu, \"seconds\": %.3f, \"peak_rss_kb\": %ld, "
+                          "\"ok\": %s}%s\n",
+                    fills[i / 2] == INPUT_SINGLE ? "single" : "zipf", formats[i % 2],
+                    (unsigned long)res.size, (unsigned long)res.packed, seconds,
+                    res.peak_rss_kb, res.ok ? "true" : "false", i + 1 < PASSES ? "," : "");
+        }
+        if (!res.ok) ok = 0;
+    }
+    if (json) fprintf(json, "  ]\n}\n");
+    return ok;
+}
+
+// --- Короткие сообщения: размер и задержка на сообщение ---
+// Сообщения нарезаются равномерно по всему тексту файлов. Форматы 1 и 2
+// пишут заголовок в каждое сообщение, статическая таблица — только номер.
+static int bench_messages(const InputSpec* specs, int count, double min_time, FILE* json) {
+    static const size_t sizes[] = {64, 128, 256, 512, 1024, 2048, 4096};
+    static const char* methods[] = {"legacy", "canonical", "static"};
+    enum { METHODS = 3, SIZES = 7 };
+
+    // 1. Текст всех файлов подряд
+    size_t total = 0;
+    uint8_t* text = NULL;
+    for (int i = 0; i < count; i++) {
+        size_t n;
+        uint8_t* data = load_file(specs[i].filename, &n);
+        uint8_t* grown = data ? (uint8_t*)realloc(text, total + n) : NULL;
+        if (!grown) {
+            printf("Error: cannot read %s\n", specs[i].filename);
+            free(data);
+            free(text);
+            return 0;
+        }
+        text = grown;
+        memcpy(text + total, data, n);
+        total += n;
+        free(data);
+    }
+
+    HuffOptions options;
+    huff_default_options(&options);
+    options.threads = 1;
+    HuffContext* ctx[2];
+    options.format = HUFF_FORMAT_LEGACY;
+    ctx[0] = huff_context_create(&options);
+    options.format = HUFF_FORMAT_CANONICAL;
+    ctx[1] = huff_context_create(&options);
+    HuffStaticCoder* coder = huff_static_create(huff_static_builtin(HUFF_STATIC_BUILTIN_TEXT));
+    size_t max_size = sizes[SIZES - 1];
+    size_t slot = huff_compress_bound(ctx[0], max_size) + huff_static_bound(max_size);
+    uint8_t* dst = (uint8_t*)malloc(BENCH_MESSAGES * slot);
+    uint8_t* back = (uint8_t*)malloc(BENCH_MESSAGES * max_size);
+    size_t* packed = (size_t*)malloc(BENCH_MESSAGES * sizeof(size_t));
+    int ok = ctx[0] && ctx[1] && coder && dst && back && packed && total >= max_size;
+
+    // 2. Замеры: все сообщения размера подряд, в отчёт — на одно сообщение
+    printf("Messages: %d of each size from the input files, 1 thread\n", BENCH_MESSAGES);
+    printf("  (static: built-in table %d, trained on a.txt and b.txt)\n\n",
+           HUFF_STATIC_BUILTIN_TEXT);
+    printf("  %6s  %-10s %10s %8s %12s %12s\n", "size", "method", "bytes", "ratio",
+           "encode us", "decode us");
+    if (json) fprintf(json, "{\n  \"messages\": [\n");
+    for (int s = 0; ok && s < SIZES; s++) {
+        for (int m = 0; ok && m < METHODS; m++) {
+            BenchCall call = {0};
+            call.ctx = m < 2 ? ctx[m] : NULL;
+            call.coder = m == 2 ? coder : NULL;
+            call.src = text;
+            call.size = sizes[s];
+            call.stride = (total - sizes[s]) / (BENCH_MESSAGES - 1);
+            call.count = BENCH_MESSAGES;
+            call.dst = dst;
+            call.slot = slot;
+            call.packed = packed;
+            call.back = back;
+
+            BenchResult res;
+            memset(&res, 0, sizeof(res));
+            measure(call_compress_messages, &call, min_time, &res, OP_ENCODE);
+            int64_t bytes = call.result;
+            measure(call_decompress_messages, &call, min_time, &res, OP_DECODE);
+            int same = bytes > 0 && call.result == (int64_t)(sizes[s] * BENCH_MESSAGES);
+            for (int i = 0; same && i < BENCH_MESSAGES; i++) {
+                same = memcmp(back + i * sizes[s], text + i * call.stride, sizes[s]) == 0;
+            }
+
+            double average = (double)bytes / BENCH_MESSAGES;
+            double encode_us = res.seconds[OP_ENCODE] / BENCH_MESSAGES * 1e6;
+            double decode_us = res.seconds[OP_DECODE] / BENCH_MESSAGES * 1e6;
+            printf("  %6lu  %-10s %10.1f %7.1f%% %12.3f %12.3f%s\n", (unsigned long)sizes[s],
+                   methods[m], average, 100.0 * average / sizes[s], encode_us, decode_us,
+                   same ? "" : "  MISMATCH");
+            if (json) {
+                fprintf(json, "    {\"size\": %lu, \"method\": \"%s\", \"bytes\": %.1f, "
+                              "\"encode_us\": %.3f, \"decode_us\": %.3f, \"ok\": %s}%s\n",
+                        (unsigned long)sizes[s], methods[m], average, encode_us, decode_us,
+                        same ? "true" : "false",
+                        s + 1 < SIZES || m + 1 < METHODS ? "," : "");
+            }
+            if (!same) ok = 0;
+        }
+    }
+    if (json) fprintf(json, "  ]\n}\n");
+
+    free(packed);
+    free(back);
+    free(dst);
+    huff_static_free(coder);
+    huff_context_free(ctx[0]);
+    huff_context_free(ctx[1]);
+    free(text);
+    return ok;
+}
+
+// --- Конвейер против поочерёдной работы на медленном устройстве ---
+// Устройство изображают два потока: подача отдаёт вход кусками по
+// BENCH_DEVICE_CHUNK не быстрее rate байт в секунду и не читает вперёд,
+// пока кусок не забрали; приём забирает выход с той же скоростью. Без
+// конвейера (HUFF_IO_MAP) кодер по очереди ждёт чтения, считает и ждёт
+// записи, и время — сумма трёх; с потоками чтения и записи
+// (HUFF_IO_THREADS) они идут одновременно, и время ближе к наибольшему.
+// Затем те же входы сжимаются и распаковываются файлами в каталоге
+// временных файлов всеми тремя способами, включая io_uring.
+#define BENCH_DEVICE_CHUNK (64 * 1024)
+#define BENCH_PIPELINE_SIZE (64u << 20)
+
+typedef struct {
+    int fd;
+    const uint8_t* data;        // Подача: что отдавать; приём: с чем сверять
+    size_t size;
+    double rate;                // Байт в секунду
+    size_t got;                 // Приём: сколько пришло
+    int same;                   // Приём: всё совпало с data
+} BenchDevice;
+
+static void sleep_until(double when) {
+    double left = when - now_seconds();
+    if (left <= 0) return;
+    struct timespec ts = {(time_t)left, (long)((left - (time_t)left) * 1e9)};
+    nanosleep(&ts, NULL);
+}
+
+// Следующий кусок готов через n / rate после того, как забрали предыдущий;
+// устройство не читает вперёд и не пишет в запас
+static void* device_feed(void* arg) {
+    BenchDevice* dev = (BenchDevice*)arg;
+    double next = now_seconds();
+    size_t done = 0;
+    while (done < dev->size) {
+        size_t n = dev->size - done < BENCH_DEVICE_CHUNK ? dev->size - done
+                                                         : BENCH_DEVICE_CHUNK;
+        // Опоздание меньше куска — неточность сна, его не копим
+        double now = now_seconds();
+        if (now - next > n / dev->rate) next = now;
+        next += n / dev->rate;
+        sleep_until(next);
+        size_t put = 0;
+        while (put < n) {
+            ssize_t w = write(dev->fd, dev->data + done + put, n - put);
+            if (w <= 0) break;
+            put += (size_t)w;
+        }
+        if (put < n) break;
+        done += n;
+    }
+    close(dev->fd);
+    return NULL;
+}
+
+static void* device_drain(void* arg) {
+    BenchDevice* dev = (BenchDevice*)arg;
+    uint8_t* buf = (uint8_t*)malloc(BENCH_DEVICE_CHUNK);
+    double next = now_seconds();
+    ssize_t r;
+    dev->same = buf != NULL;
+    while (buf && (r = read(dev->fd, buf, BENCH_DEVICE_CHUNK)) > 0) {
+        if (dev->got + (size_t)r > dev->size ||
+            memcmp(buf, dev->data + dev->got, (size_t)r) != 0) {
+            dev->same = 0;
+        }
+        dev->got += (size_t)r;
+        double now = now_seconds();
+        if (now - next > r / dev->rate) next = now;
+        next += r / dev->rate;
+        sleep_until(next);
+    }
+    free(buf);
+    close(dev->fd);
+    return NULL;
+}
+
+// --- Один проход через устройство: секунды или -1 при ошибке ---
+static double run_device(HuffContext* ctx, int decode, const uint8_t* src, size_t size,
+                         const uint8_t* expect, size_t expect_size, double rate) {
+    int in[2], out[2];
+    if (pipe(in) != 0) return -1;
+    if (pipe(out) != 0) {
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    BenchDevice feed = {in[1], src, size, rate, 0, 0};
+    BenchDevice drain = {out[0], expect, expect_size, rate, 0, 0};
+    StreamStage stage = {ctx, decode, in[0], out[1], HUFF_OK};
+
+    double start = now_seconds();
+    pthread_t threads[3];
+    pthread_create(&threads[0], NULL, device_feed, &feed);
+    pthread_create(&threads[1], NULL, stream_stage, &stage);
+    pthread_create(&threads[2], NULL, device_drain, &drain);
+    for (int i = 0; i < 3; i++) pthread_join(threads[i], NULL);
+    double seconds = now_seconds() - start;
+    int ok = stage.err == HUFF_OK && drain.same && drain.got == expect_size;
+    return ok ? seconds : -1;
+}
+
+// --- Запись буфера в файл ---
+static int write_file(const char* filename, const uint8_t* data, size_t size) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) return 0;
+    int ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+// --- Сжатие и распаковка файлами: секунды на оба или -1 при ошибке ---
+static double run_files(HuffContext* ctx, const char* input, const char* packed,
+                        const char* output, const uint8_t* expect, size_t size) {
+    double start = now_seconds();
+    if (huff_compress_file(ctx, input, packed) != HUFF_OK ||
+        huff_decompress_file(ctx, packed, output) != HUFF_OK) {
+        return -1;
+    }
+    double seconds = now_seconds() - start;
+    size_t n;
+    uint8_t* back = load_file(output, &n);
+    int same = back && n == size && memcmp(back, expect, size) == 0;
+    free(back);
+    return same ? seconds : -1;
+}
+
+static int bench_pipeline(const InputSpec* specs, int count, double rate_mb, FILE* json) {
+    static const HuffIoMode modes[] = {HUFF_IO_MAP, HUFF_IO_THREADS, HUFF_IO_URING};
+    static const char* mode_names[] = {"map", "threads", "uring"};
+    double rate = rate_mb * 1e6;
+    signal(SIGPIPE, SIG_IGN);
+
+    // Временные файлы для прохода файлами
+    const char* tmp = getenv("TMPDIR");
+    char dir[256], input[300], packed[300], output[300];
+    snprintf(dir, sizeof(dir), "%s/huffman_bench_XXXXXX", tmp ? tmp : "/tmp");
+    if (!mkdtemp(dir)) {
+        printf("Error: cannot create a directory in %s\n", tmp ? tmp : "/tmp");
+        return 0;
+    }
+    snprintf(input, sizeof(input), "%s/input", dir);
+    snprintf(packed, sizeof(packed), "%s/input.huff", dir);
+    snprintf(output, sizeof(output), "%s/output", dir);
+
+    printf("Pipelined I/O: device at %.0f MB/s for reading and for writing, 1 coding thread\n",
+           rate_mb);
+    printf("  sum = read + coding + write, max = the largest of them\n\n");
+    if (json) fprintf(json, "{\n  \"pipeline\": [\n");
+    int ok = 1;
+    for (int i = 0; ok && i < count; i++) {
+        // 1. Вход, повторённый до BENCH_PIPELINE_SIZE, и его сжатая копия
+        size_t len;
+        uint8_t* file = load_file(specs[i].filename, &len);
+        size_t size = BENCH_PIPELINE_SIZE / len * len;
+        uint8_t* data = file ? (uint8_t*)malloc(size) : NULL;
+        if (!data) {
+            printf("Error: cannot read %s\n", specs[i].filename);
+            free(file);
+            ok = 0;
+            break;
+        }
+        for (size_t pos = 0; pos < size; pos += len) memcpy(data + pos, file, len);
+        free(file);
+
+        HuffOptions options;
+        huff_default_options(&options);
+        options.threads = 1;
+        HuffContext* ctx = huff_context_create(&options);
+        size_t cap = ctx ? huff_compress_bound(ctx, size) : 0;
+        uint8_t* comp = ctx ? (uint8_t*)malloc(cap) : NULL;
+        uint8_t* back = comp ? (uint8_t*)malloc(size) : NULL;
+        ok = back != NULL && write_file(input, data, size);
+
+        // 2. Счёт без ввода-вывода (второй прогон, прогретый)
+        double coding[2] = {0, 0};
+        int64_t comp_size = 0;
+        for (int run = 0; ok && run < 2; run++) {
+            double start = now_seconds();
+            comp_size = huff_compress(ctx, data, size, comp, cap);
+            double mid = now_seconds();
+            int64_t n = comp_size > 0 ? huff_decompress(ctx, comp, (size_t)comp_size, back, size)
+                                      : -1;
+            coding[0] = mid - start;
+            coding[1] = now_seconds() - mid;
+            ok = n == (int64_t)size && memcmp(back, data, size) == 0;
+        }
+
+        // 3. Через медленное устройство, без конвейера и с ним
+        printf("%s x%lu (%.1f MB):\n", specs[i].filename, (unsigned long)(size / len),
+               size / 1e6);
+        for (int decode = 0; ok && decode < 2; decode++) {
+            const uint8_t* src = decode ? comp : data;
+            size_t src_size = decode ? (size_t)comp_size : size;
+            const uint8_t* dst = decode ? data : comp;
+            size_t dst_size = decode ? size : (size_t)comp_size;
+            double read = src_size / rate, write = dst_size / rate;
+            double largest = read > write ? read : write;
+            if (coding[decode] > largest) largest = coding[decode];
+            printf("  %s: read %.3f s, coding %.3f s, write %.3f s; sum %.3f s, max %.3f s\n",
+                   decode ? "decode" : "encode", read, coding[decode], write,
+                   read + coding[decode] + write, largest);
+            double wall[2];
+            for (int m = 0; ok && m < 2; m++) {
+                options.io = modes[m];
+                HuffContext* piped = huff_context_create(&options);
+                wall[m] = piped ? run_device(piped, decode, src, src_size, dst, dst_size, rate)
+                                : -1;
+                huff_context_free(piped);
+                if (wall[m] < 0) {
+                    printf("    %-8s MISMATCH\n", mode_names[m]);
+                    ok = 0;
+                    break;
+                }
+                printf("    %-8s %.3f s\n", mode_names[m], wall[m]);
+            }
+            if (ok && json) {
+                fprintf(json, "    {\"file\": \"%s\", \"op\": \"%s\", \"size\": %lu, "
+                              "\"read\": %.3f, \"coding\": %.3f, \"write\": %.3f, "
+                              "\"map\": %.3f, \"threads\": %.3f},\n",
+                        specs[i].filename, decode ? "decode" : "encode",
+                        (unsigned long)size, read, coding[decode], write, wall[0], wall[1]);
+            }
+        }
+
+        // 4. Файлами на локальном диске, включая io_uring
+        if (ok) printf("  files (encode + decode):");
+        for (int m = 0; ok && m < 3; m++) {
+            options.io = modes[m];
+            HuffContext* files = huff_context_create(&options);
+            double seconds = files ? run_files(files, input, packed, output, data, size) : -1;
+            huff_context_free(files);
+            if (seconds < 0) {
+                printf(" %s MISMATCH\n", mode_names[m]);
+                ok = 0;
+                break;
+            }
+            printf(" %s %.3f s%s", mode_names[m], seconds, m < 2 ? "," : "");
+            if (json) {
+                fprintf(json, "    {\"file\": \"%s\", \"op\": \"files\", \"io\": \"%s\", "
+                              "\"seconds\": %.3f},\n",
+                        specs[i].filename, mode_names[m], seconds);
+            }
+        }
+        if (ok) {
+            HuffInput in;
+            int uring = huff_input_open_io(&in, input, HUFF_IO_URING) && huff_pipe_uring(in.pipe);
+            huff_input_close(&in);
+            printf(" (io_uring %s)\n\n", uring ? "in use" : "unavailable, pread/pwrite");
+        }
+
+        free(back);
+        free(comp);
+        huff_context_free(ctx);
+        free(data);
+    }
+    if (json) fprintf(json, "    {}\n  ]\n}\n");
+
+    remove(input);
+    remove(packed);
+    remove(output);
+    rmdir(dir);
+    return ok;
+}
+
+// --- Каждый вариант ядер на каждом файле ---
+// Вариант задаётся в родителе перед fork: процесс замера его наследует.
+// Каждый замер проверяет распаковку, так что переносимый вариант
+// проходит ту же проверку, что и быстрые.
+static int bench_kernels(const InputSpec* specs, int count, double min_time, FILE* json) {
+    const int levels = huff_cpu_detect() + 1;
+    double ghz = tsc_ghz();
+    printf("Huffman kernels: median of warm runs, %.2f GHz TSC, 1 thread, "
+           "processor supports up to %s\n\n", ghz, huff_cpu_name(huff_cpu_detect()));
+
+    BenchResult* results = (BenchResult*)calloc((size_t)count * levels, sizeof(BenchResult));
+    if (!results) return 0;
+    int done = 0;
+    int ok = 1;
+    for (int i = 0; ok && i < count; i++) {
+        for (int level = 0; level < levels; level++) {
+            huff_cpu_force((HuffCpuLevel)level);
+            if (!run_isolated(&specs[i], min_time, &results[done])) {
+                printf("Error: cannot benchmark %s\n", specs[i].filename);
+                ok = 0;
+                break;
+            }
+            print_result(&results[done], ghz);
+            if (!results[done].ok) ok = 0;
+            done++;
+        }
+    }
+
+    // Сводка: МБ/с по вариантам, в скобках — во сколько раз быстрее generic.
+    // Гистограмма и дерево одни на все варианты, их разница — шум.
+    for (int first = 0; first + levels <= done; first += levels) {
+        const BenchResult* base = &results[first];
+        printf("\n%-20s", base->name);
+        for (int level = 0; level < levels; level++) {
+            printf(" %18s", huff_cpu_name((HuffCpuLevel)level));
+        }
+        printf("\n");
+        for (int op = 0; op < OP_COUNT; op++) {
+            if (op == OP_HISTOGRAM || op == OP_TREE) continue;
+            printf("  %-18s", op_names[op]);
+            for (int level = 0; level < levels; level++) {
+                const BenchResult* res = &results[first + level];
+                printf(" %9.1f MB/s %4.2fx", res->size / res->seconds[op] / 1e6,
+                       base->seconds[op] / res->seconds[op]);
+            }
+            printf("\n");
+        }
+    }
+
+    if (json) write_json(json, results, done, ghz);
+    free(results);
+    return ok;
+}
+
+// --- Масштабирование кодирования одного потока по числу потоков ---
+// Потоков — степени двойки до удвоенного числа процессоров (не меньше 4):
+// сверх процессоров видна цена разбиения без выигрыша.
+static int bench_scaling(const char* filename, uint64_t target, FILE* json) {
+    size_t len = 0;
+    uint8_t* file = load_file(filename, &len);
+    size_t size = (size_t)target;
+    uint8_t* data = file ? (uint8_t*)malloc(size) : NULL;
+    if (!data) {
+        printf("Error: cannot prepare %s\n", filename);
+        free(file);
+        return 0;
+    }
+    for (size_t pos = 0; pos < size; pos += len) {
+        memcpy(data + pos, file, size - pos < len ? size - pos : len);
+    }
+    free(file);
+
+    char size_text[24];
+    format_size(size_text, sizeof(size_text), size);
+    printf("Single-stream encode (format 2) of %s repeated to %s, processors: %d\n\n",
+           filename, size_text, huff_cpu_count());
+    if (json) fprintf(json, "{\n  \"scaling\": [\n");
+
+    int max_threads = 2 * huff_cpu_count();
+    if (max_threads < 4) max_threads = 4;
+    uint8_t* serial = NULL;
+    int64_t serial_size = 0;
+    double serial_seconds = 0;
+    int ok = 1;
+    for (int threads = 1; ok && threads <= max_threads; threads *= 2) {
+        HuffOptions options;
+        huff_default_options(&options);
+        options.format = HUFF_FORMAT_CANONICAL;
+        options.threads = threads;
+        HuffContext* ctx = huff_context_create(&options);
+        size_t cap = ctx ? huff_compress_bound(ctx, size) : 0;
+        uint8_t* packed = (uint8_t*)malloc(cap);
+        if (!ctx || !packed) {
+            printf("Error: out of memory\n");
+            huff_context_free(ctx);
+            free(packed);
+            ok = 0;
+            break;
+        }
+
+        double t = now_seconds();
+        int64_t result = huff_compress(ctx, data, size, packed, cap);
+        double seconds = now_seconds() - t;
+        huff_context_free(ctx);
+
+        int same;
+        if (threads == 1) {
+            serial = packed;
+            serial_size = result;
+            serial_seconds = seconds;
+            same = result > 0;
+        } else {
+            same = result == serial_size && memcmp(packed, serial, (size_t)result) == 0;
+            free(packed);
+        }
+        printf("  %2d threads %8.2f s  %8.1f MB/s  %5.2fx  %s\n", threads, seconds,
+               size / seconds / 1e6, serial_seconds / seconds,
+               same ? (threads == 1 ? "" : "identical") : "DIFFERENT");
+        if (json) {
+            fprintf(json, "    {\"threads\": %d, \"size\": %lu, \"packed\": %ld, "
+                          "\"seconds\": %.3f, \"identical\": %s},\n",
+                    threads, (unsigned long)size, (long)result, seconds,
+                    same ? "true" : "false");
+        }
+        if (!same) ok = 0;
+    }
+    if (json) fprintf(json, "    {}\n  ]\n}\n");
+
+    free(serial);
+    free(data);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    static const uint64_t sizes[] = {
+        1u << 10, 64u << 10, 1u << 20, 16u << 20, 256u << 20, 1u << 30
+    };
+    uint64_t max_size = BENCH_DEFAULT_MAX_SIZE;
+    double min_time = 0.2;
+    const char* json = NULL;
+    int messages = 0;
+    uint64_t stream = 0;
+    double pipeline = 0;
+    int kernels = 0;
+    uint64_t scaling = 0;
+
+    // 1. Разбор параметров: файлы, затем сгенерированные входы
+    InputSpec* specs = (InputSpec*)malloc((argc + 2 + 3 * 6) * sizeof(InputSpec));
+    if (!specs) return 1;
+    int count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+            max_size = parse_size(argv[++i]);
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        } else if (strcmp(argv[i], "--messages") == 0) {
+            messages = 1;
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            stream = parse_size(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipeline = atof(argv[++i]);
+            if (pipeline <= 0) pipeline = 1;
+        } else if (strcmp(argv[i], "--kernels") == 0) {
+            kernels = 1;
+        } else if (strcmp(argv[i], "--scaling") == 0 && i + 1 < argc) {
+            scaling = parse_size(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [--max-size N] [--min-time S] [--json FILE] "
+                            "[--messages | --stream N | --pipeline MBPS | --kernels | "
+                            "--scaling N] [file ...]\n",
+                    argv[0]);
+            free(specs);
+            return 2;
+        } else {
+            specs[count++] = (InputSpec){.kind = INPUT_FILE, .filename = argv[i]};
+        }
+    }
+    if (count == 0) {
+        specs[count++] = (InputSpec){.kind = INPUT_FILE, .filename = "a.txt"};
+        specs[count++] = (InputSpec){.kind = INPUT_FILE, .filename = "b.txt"};
+    }
+    if (messages || stream || pipeline || kernels || scaling) {
+        FILE* f = json ? fopen(json, "w") : NULL;
+        if (json && !f) printf("Error: cannot write %s\n", json);
+        int done = (!json || f) &&
+                   (stream     ? run_stream(stream, f)
+                    : pipeline ? bench_pipeline(specs, count, pipeline, f)
+                    : kernels  ? bench_kernels(specs, count, min_time, f)
+                    : scaling  ? bench_scaling(specs[0].filename, scaling, f)
+                               : bench_messages(specs, count, min_time, f));
+        if (f) {
+            fclose(f);
+            printf("\nJSON report: %s\n", json);
+        }
+        free(specs);
+        return done ? 0 : 1;
+    }
+    for (int kind = INPUT_RANDOM; kind <= INPUT_ZIPF; kind++) {
+        for (int s = 0; s < 6 && sizes[s] <= max_size; s++) {
+            specs[count++] = (InputSpec){.kind = (InputKind)kind, .size = sizes[s]};
+        }
+    }
+
+    // 2. Замеры, каждый вход в своём процессе
+    double ghz = tsc_ghz();
+    printf("Huffman benchmark: median of warm runs, %.2f GHz TSC, 1 thread\n\n", ghz);
+    BenchResult* results = (BenchResult*)calloc(count, sizeof(BenchResult));
+    int done = 0;
+    int ok = results != NULL;
+    for (int i = 0; ok && i < count; i++) {
+        if (!run_isolated(&specs[i], min_time, &results[done])) {
+            printf("Error: cannot benchmark %s\n",
+                   specs[i].filename ? specs[i].filename : "generated input");
+            ok = 0;
+            break;
+        }
+        print_result(&results[done], ghz);
+        if (!results[done].ok) ok = 0;
+        done++;
+    }
+
+    // 3. JSON для сравнения между версиями
+    if (json) {
+        FILE* f = fopen(json, "w");
+        if (!f) {
+            printf("Error: cannot write %s\n", json);
+            ok = 0;
+        } else {
+            write_json(f, results, done, ghz);
+            fclose(f);
+            printf("\nJSON report: %s\n", json);
+        }
+    }
+
+    free(results);
+    free(specs);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,1149 @@
+#include "huffman_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Блоки кодируются и декодируются независимо, пачками по BATCH_PER_THREAD
+// блоков на поток: главный поток читает пачку, пул обрабатывает её,
+// главный поток пишет результаты строго по порядку. Поэтому выход не
+// зависит от числа потоков. Задачи с их буферами и таблицами живут в
+// контексте и переиспользуются следующими вызовами; пачка из одного блока
+// кодируется прямо в вызывающем потоке. Статистику фаз задача копит в
+// своей HuffStats, главный поток складывает их после пачки.
+#define BATCH_PER_THREAD 2
+
+// Наибольший размер заголовка блока: размер, флаги, таблицы длин, 4 длины
+// потоков, CRC32C
+#define BLOCK_HEADER_MAX (10 + 1 + HUFF_MAX_CONTEXT_TABLES_SIZE + 4 * 10 + 4)
+
+// Блоки короче этого кодируются без контекстов: таблицы кластеров не окупятся
+#define CONTEXTS_MIN_BLOCK (16 * 1024)
+
+// Блок пишется как есть, если код Хаффмана выигрывает меньше 1/STORED_MIN_GAIN
+// его размера: распаковка тогда — memcpy, а не разбор битов
+#define STORED_MIN_GAIN 32
+// Серии ищутся, только если в выборке из RUN_SAMPLES пар соседних байтов
+// хотя бы половина одинаковых: иначе список серий длиннее самих данных
+#define RUN_SAMPLES 64
+
+// Как записан блок
+enum { BLOCK_CODED, BLOCK_STORED, BLOCK_RUNS };
+
+// Задача кодирования одного блока
+typedef struct EncodeJob {
+    const uint8_t* src;
+    size_t size;
+    int max_code_len;
+    int streams;            // 1 или 4
+    int contexts;           // Кластеров контекстов, 0 — без них
+    HuffOrder1Model* model; // Рабочая память контекстов (при первой нужде)
+    int checksum;           // Писать CRC32C блока
+    uint32_t crc;
+    uint64_t seek_interval; // Шаг отметок, 0 — без них
+    uint64_t* checkpoints;  // Отметки блока (формат — как в индексе)
+    size_t checkpoint_count;
+    size_t checkpoint_cap;
+    uint8_t* dst;           // Закодированный блок (заголовок блока + поток)
+    size_t dst_cap;
+    size_t dst_size;
+    uint64_t bits;
+    int stats_on;
+    HuffStats stats;
+    int ok;
+} EncodeJob;
+
+// Задача декодирования одного блока
+typedef struct DecodeJob {
+    uint8_t lens[256];
+    int unique;
+    int clusters;           // Кластеров контекстов, 0 — одна таблица lens
+    uint8_t map[256];       // Кластер каждого предыдущего байта
+    uint8_t cluster_lens[HUFF_MAX_CLUSTERS][256];
+    HuffDecodeTable cluster_tables[HUFF_MAX_CLUSTERS];
+    uint64_t bits;
+    int streams;
+    size_t stream_sizes[4]; // Длины потоков в байтах (при streams == 4)
+    const uint8_t* src;     // Битовый поток блока (в отображении или в buffer)
+    size_t src_size;
+    uint8_t* buffer;        // Копия потока, если вход не отображён
+    size_t buffer_cap;
+    int kind;               // BLOCK_*; у BLOCK_STORED и BLOCK_RUNS src — данные
+    uint8_t* dst;           // Место блока прямо в выходном файле
+    size_t size;            // Размер исходных данных блока
+    int checksum;           // У блока есть CRC32C, его надо сверить
+    uint32_t crc;
+    HuffDecodeTable table;
+    int stats_on;
+    HuffStats stats;
+    int ok;
+} DecodeJob;
+
+// --- Запись uint64_t/uint32_t little-endian ---
+static void put_le(uint8_t* buf, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) buf[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t* buf, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t)buf[i] << (8 * i);
+    return value;
+}
+
+// --- Место под блок в буфере задачи (буфер остаётся от прошлых блоков) ---
+static int reserve_block(EncodeJob* job, size_t cap) {
+    if (cap <= job->dst_cap) return 1;
+    uint8_t* grown = (uint8_t*)realloc(job->dst, cap);
+    if (!grown) return 0;
+    job->dst = grown;
+    job->dst_cap = cap;
+    return 1;
+}
+
+// --- Отметка: позиция в битах от начала потоков блока и контекст ---
+static int add_checkpoint(EncodeJob* job, uint64_t bit, int prev) {
+    if (job->checkpoint_count == job->checkpoint_cap) {
+        size_t cap = job->checkpoint_cap ? job->checkpoint_cap * 2 : 64;
+        uint64_t* grown = (uint64_t*)realloc(job->checkpoints, cap * sizeof(uint64_t));
+        if (!grown) return 0;
+        job->checkpoints = grown;
+        job->checkpoint_cap = cap;
+    }
+    job->checkpoints[job->checkpoint_count++] = bit | (uint64_t)prev << 56;
+    return 1;
+}
+
+// --- Кодирование символов [from, to) блока одним потоком ---
+// base — начало потоков блока. Поток прерывается на каждом смещении,
+// кратном шагу отметок, и там ставится отметка. by_context != NULL —
+// таблицы по предыдущему байту (поток начинается с контекста 0).
+static int encode_part(EncodeJob* job, const HuffCode* codes,
+                       const HuffCode* const* by_context, size_t from, size_t to,
+                       const uint8_t* base, BitWriter* bw) {
+    uint64_t step = job->seek_interval;
+    int prev = 0;
+    for (size_t pos = from; pos < to; ) {
+        size_t next = to;
+        if (step) {
+            if (pos > 0 && pos % step == 0 &&
+                !add_checkpoint(job, (uint64_t)(bw->p - base) * 8 + (uint64_t)bw->count, prev)) {
+                return 0;
+            }
+            if ((pos / step + 1) * step < to) next = (size_t)((pos / step + 1) * step);
+        }
+        if (by_context) {
+            huff_encode_symbols_order1(by_context, job->src + pos, next - pos, prev, bw);
+        } else {
+            huff_encode_symbols(codes, job->src + pos, next - pos, bw);
+        }
+        prev = job->src[next - 1];
+        pos = next;
+    }
+    return 1;
+}
+
+// --- Отметки блока без битового потока: все пустые, но их число то же ---
+static int add_empty_checkpoints(EncodeJob* job) {
+    for (uint64_t off = job->seek_interval; off && off < job->size; off += job->seek_interval) {
+        if (!add_checkpoint(job, 0, 0)) return 0;
+    }
+    return 1;
+}
+
+// --- Оценка по энтропии: нижняя граница кода Хаффмана, байт ---
+static uint64_t entropy_bytes(const uint32_t* freq, size_t size) {
+    double bits = 0;
+    double log_size = log2((double)size);
+    for (int i = 0; i < 256; i++) {
+        if (freq[i]) bits += freq[i] * (log_size - log2((double)freq[i]));
+    }
+    return (uint64_t)(bits / 8);
+}
+
+// --- Выборка соседних байтов: похоже ли, что блок состоит из серий ---
+static int runs_likely(const uint8_t* src, size_t size) {
+    if (size < 2 * RUN_SAMPLES) return 0;
+    size_t step = (size - 1) / RUN_SAMPLES;
+    int same = 0;
+    for (size_t i = 0; i < RUN_SAMPLES; i++) same += src[i * step] == src[i * step + 1];
+    return 2 * same >= RUN_SAMPLES;
+}
+
+// --- Длина varint ---
+static size_t varint_size(uint64_t value) {
+    size_t n = 1;
+    while (value >>= 7) n++;
+    return n;
+}
+
+// --- Размер списка серий; считается до limit, дальше не нужен ---
+static uint64_t run_list_size(const uint8_t* src, size_t size, uint64_t limit) {
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < size && bytes < limit; ) {
+        size_t j = i + 1;
+        while (j < size && src[j] == src[i]) j++;
+        bytes += 1 + varint_size(j - i - 1);
+        i = j;
+    }
+    return bytes < limit ? bytes : limit;
+}
+
+// --- Блок как есть или сериями (блок из серий короче данных) ---
+static int encode_plain_block(EncodeJob* job, int kind, uint64_t run_bytes,
+                              const uint32_t* freq, HuffTimer* timer) {
+    size_t payload = kind == BLOCK_RUNS ? (size_t)run_bytes : job->size;
+    if (!reserve_block(job, BLOCK_HEADER_MAX + payload)) return 0;
+    size_t pos = put_varint(job->dst, job->size);
+    job->dst[pos++] = kind == BLOCK_RUNS ? HUFF_FLAG_RUNS : HUFF_FLAG_STORED;
+    if (kind == BLOCK_RUNS) pos += put_varint(job->dst + pos, payload);
+    if (job->checksum) {
+        put_le(job->dst + pos, job->crc, 4);
+        pos += 4;
+    }
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_TABLES);
+
+    if (kind == BLOCK_STORED) {
+        memcpy(job->dst + pos, job->src, job->size);
+        pos += job->size;
+    } else {
+        for (size_t i = 0; i < job->size; ) {
+            size_t j = i + 1;
+            while (j < job->size && job->src[j] == job->src[i]) j++;
+            job->dst[pos++] = job->src[i];
+            pos += put_varint(job->dst + pos, j - i - 1);
+            i = j;
+        }
+    }
+    if (!add_empty_checkpoints(job)) return 0;
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_CODING);
+
+    // В статистике данные как есть — коды по 8 бит, серии — как блоки
+    // из одного символа
+    if (job->stats_on) {
+        uint8_t lens[256];
+        memset(lens, 8, sizeof(lens));
+        huff_stats_add_codes(&job->stats, freq, lens, kind == BLOCK_STORED ? payload * 8 : 0);
+        if (kind == BLOCK_RUNS) job->stats.bits += payload * 8;
+        if (kind == BLOCK_STORED) job->stats.stored_blocks++;
+        else job->stats.run_blocks++;
+    }
+    job->dst_size = pos;
+    job->bits = (uint64_t)payload * 8;
+    return 1;
+}
+
+// --- Блок с таблицами по контексту ---
+// plain_bits — цена блока с одной таблицей (поток и таблица длин).
+// Возвращает 1 — блок записан, 0 — контексты не окупаются, -1 — нет памяти.
+static int encode_order1_block(EncodeJob* job, int streams, size_t seg,
+                               uint64_t plain_bits, HuffTimer* timer) {
+    if (!job->model) {
+        job->model = (HuffOrder1Model*)malloc(sizeof(HuffOrder1Model));
+        if (!job->model) return -1;
+    }
+
+    // 1. Частоты пар; каждый поток начинается с контекста 0
+    memset(job->model->pair, 0, sizeof(job->model->pair));
+    for (int k = 0; k < streams; k++) {
+        size_t len = k < streams - 1 ? seg : job->size - (size_t)k * seg;
+        huff_pair_histogram(job->model, job->src + (size_t)k * seg, len);
+    }
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_HISTOGRAM);
+
+    // 2. Кластеры и их коды; сравниваем с одной таблицей
+    uint8_t map[256];
+    uint32_t cluster_freq[HUFF_MAX_CLUSTERS][256];
+    uint8_t lens[HUFF_MAX_CLUSTERS][256];
+    int clusters = huff_cluster_contexts(job->model, job->contexts, map, cluster_freq);
+    if (clusters < 2) return 0;
+    uint64_t bits = huff_cluster_lengths(cluster_freq, clusters, job->max_code_len, lens);
+
+    size_t pos = put_varint(job->dst, job->size);
+    job->dst[pos++] = (uint8_t)(HUFF_FLAG_CONTEXTS |
+                                (streams == 4 ? HUFF_FLAG_FOUR_STREAMS : 0));
+    pos += put_context_tables(job->dst + pos, clusters, map,
+                              (const uint8_t (*)[256])lens);
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_TABLES);
+    if (bits + pos * 8 >= plain_bits) return 0;
+
+    HuffCode codes[HUFF_MAX_CLUSTERS][256];
+    const HuffCode* by_context[256];
+    for (int k = 0; k < clusters; k++) {
+        uint64_t words[256];
+        huff_canonical_codes(lens[k], words);
+        for (int s = 0; s < 256; s++) {
+            codes[k][s].word = words[s];
+            codes[k][s].len = lens[k][s];
+        }
+    }
+    for (int c = 0; c < 256; c++) by_context[c] = codes[map[c]];
+
+    // 3. Потоки пишутся после места под наибольший заголовок (длины
+    //    потоков станут известны только после кодирования) и потом
+    //    сдвигаются вплотную к нему
+    if (!reserve_block(job, BLOCK_HEADER_MAX + (size_t)(bits / 8) + 4 * 16)) return -1;
+    uint64_t part_bits[4] = {0};
+    size_t stream_pos = BLOCK_HEADER_MAX;
+    for (int k = 0; k < streams; k++) {
+        size_t from = (size_t)k * seg;
+        size_t to = k < streams - 1 ? from + seg : job->size;
+        BitWriter bw;
+        bit_writer_init(&bw, job->dst + stream_pos);
+        if (!encode_part(job, NULL, by_context, from, to, job->dst + BLOCK_HEADER_MAX, &bw)) {
+            return -1;
+        }
+        part_bits[k] = (uint64_t)(bw.p - (job->dst + stream_pos)) * 8 + (uint64_t)bw.count;
+        bit_writer_finish(&bw);
+        stream_pos = (size_t)(bw.p - job->dst);
+    }
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_CODING);
+
+    // 4. Длины потоков, контрольная сумма и сдвиг потоков к заголовку
+    for (int k = 0; k < streams; k++) pos += put_varint(job->dst + pos, part_bits[k]);
+    if (job->checksum) {
+        put_le(job->dst + pos, job->crc, 4);
+        pos += 4;
+    }
+    memmove(job->dst + pos, job->dst + BLOCK_HEADER_MAX, stream_pos - BLOCK_HEADER_MAX);
+    if (job->stats_on) {
+        for (int k = 0; k < clusters; k++) {
+            uint64_t cluster_bits = 0;
+            for (int s = 0; s < 256; s++) {
+                cluster_bits += (uint64_t)cluster_freq[k][s] * lens[k][s];
+            }
+            huff_stats_add_codes(&job->stats, cluster_freq[k], lens[k], cluster_bits);
+        }
+    }
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_TABLES);
+
+    job->dst_size = pos + (stream_pos - BLOCK_HEADER_MAX);
+    job->bits = bits;
+    return 1;
+}
+
+// --- Кодирование одного блока (выполняется в пуле) ---
+static void encode_block(void* arg) {
+    EncodeJob* job = (EncodeJob*)arg;
+    job->ok = 0;
+    job->checkpoint_count = 0;
+    HuffTimer timer;
+    huff_timer_start(&timer, job->stats_on);
+
+    // 1. Гистограмма по частям блока: при четырёх потоках нужна длина
+    //    каждого из них, при одном части просто складываются
+    int streams = job->streams == 4 && job->size >= HUFF_FOUR_STREAMS_MIN_BLOCK ? 4 : 1;
+    size_t seg = streams == 4 ? (job->size + 3) / 4 : job->size;
+    uint32_t part_freq[4][256] = {{0}};
+    uint32_t freq[256];
+    for (int k = 0; k < streams; k++) {
+        size_t len = k < streams - 1 ? seg : job->size - (size_t)k * seg;
+        huff_histogram(job->src + (size_t)k * seg, len, part_freq[k]);
+    }
+    for (int i = 0; i < 256; i++) {
+        freq[i] = part_freq[0][i] + part_freq[1][i] + part_freq[2][i] + part_freq[3][i];
+    }
+    // Контрольная сумма — тоже проход по исходным данным, идёт в ту же фазу
+    if (job->checksum) job->crc = huff_crc32c(0, job->src, job->size);
+    huff_timer_lap(&timer, &job->stats, HUFF_PHASE_HISTOGRAM);
+
+    // 2. Оценка до кодирования. Серии считаются, только если выборка их
+    //    обещает. Если даже энтропия не выигрывает STORED_MIN_GAIN, коды
+    //    не строятся: блок пойдёт как есть или сериями
+    int unique = 0;
+    for (int i = 0; i < 256; i++) unique += freq[i] != 0;
+    uint64_t stored_limit = job->size - job->size / STORED_MIN_GAIN;
+    uint64_t run_bytes = job->size;
+    if (unique > 1 && runs_likely(job->src, job->size)) {
+        run_bytes = run_list_size(job->src, job->size, job->size);
+    }
+    if (unique > 1 && entropy_bytes(freq, job->size) >= stored_limit) {
+        job->ok = encode_plain_block(job, run_bytes < job->size ? BLOCK_RUNS : BLOCK_STORED,
+                                     run_bytes, freq, &timer);
+        return;
+    }
+
+    // 3. Коды
+    uint8_t lens[256];
+    uint64_t words[256];
+    HuffCode codes[256];
+    huff_code_lengths(freq, job->max_code_len, lens);
+    huff_canonical_codes(lens, words);
+
+    uint64_t part_bits[4] = {0};
+    for (int i = 0; i < 256; i++) {
+        for (int k = 0; k < streams; k++) part_bits[k] += (uint64_t)part_freq[k][i] * lens[i];
+        codes[i].word = words[i];
+        codes[i].len = lens[i];
+    }
+    uint64_t bits = part_bits[0] + part_bits[1] + part_bits[2] + part_bits[3];
+    if (unique == 1) {
+        bits = 0;           // Блок из одного символа описан таблицей
+        streams = 1;
+    }
+
+    // 4. Заголовок блока. Код с таблицей длин сравнивается с сериями и с
+    //    данными как есть
+    if (!reserve_block(job, BLOCK_HEADER_MAX + (size_t)(bits / 8) + 4 * 16)) return;
+    int flags = code_lengths_flags(lens);
+    uint64_t plain_bits = bits + 8 * (1 + put_code_lengths(job->dst, lens, flags));
+    uint64_t coded_bytes = (plain_bits + 7) / 8;
+    int runs = run_bytes < job->size && run_bytes < coded_bytes;
+    if (unique > 1 && (runs || coded_bytes >= stored_limit)) {
+        job->ok = encode_plain_block(job, runs ? BLOCK_RUNS : BLOCK_STORED, run_bytes, freq,
+                                     &timer);
+        return;
+    }
+
+    // Контексты — если так выйдет короче (в заголовок блока входит и
+    // таблица длин)
+    if (job->contexts && unique > 1 && job->size >= CONTEXTS_MIN_BLOCK) {
+        int r = encode_order1_block(job, streams, seg, plain_bits, &timer);
+        if (r != 0) {
+            job->ok = r > 0;
+            return;
+        }
+    }
+
+    size_t pos = put_varint(job->dst, job->size);
+    if (streams == 4) flags |= HUFF_FLAG_FOUR_STREAMS;
+    job->dst[pos++] = (uint8_t)flags;
+    pos += put_code_lengths(job->dst + pos, lens, flags);
+    if (streams == 4) {
+        for (int k = 0; k < 4; k++) pos += put_varint(job->dst + pos, part_bits[k]);
+    } else {
+        pos += put_varint(job->dst + pos, bits);
+    }
+    if (job->checksum) {
+        put_le(job->dst + pos, job->crc, 4);
+        pos += 4;
+    }
+    if (job->stats_on) huff_stats_add_codes(&job->stats, freq, lens, bits);
+    huff_timer_lap(&timer, &job->stats, HUFF_PHASE_TABLES);
+
+    // 5. Потоки, каждый с начала байта; у блока из одного символа отметки
+    //    пустые
+    const uint8_t* base = job->dst + pos;
+    for (int k = 0; bits > 0 && k < streams; k++) {
+        size_t from = (size_t)k * seg;
+        size_t to = k < streams - 1 ? from + seg : job->size;
+        BitWriter bw;
+        bit_writer_init(&bw, job->dst + pos);
+        if (!encode_part(job, codes, NULL, from, to, base, &bw)) return;
+        bit_writer_finish(&bw);
+        pos = (size_t)(bw.p - job->dst);
+    }
+    if (bits == 0 && !add_empty_checkpoints(job)) return;
+    huff_timer_lap(&timer, &job->stats, HUFF_PHASE_CODING);
+
+    job->dst_size = pos;
+    job->bits = bits;
+    job->ok = 1;
+}
+
+// --- Задачи пачки в контексте (выделяются при первом вызове) ---
+static int ensure_jobs(HuffContext* ctx) {
+    if (ctx->encode_jobs) return 1;
+    ctx->batch = ctx->threads * BATCH_PER_THREAD;
+    ctx->encode_jobs = (EncodeJob*)calloc(ctx->batch, sizeof(EncodeJob));
+    ctx->decode_jobs = (DecodeJob*)calloc(ctx->batch, sizeof(DecodeJob));
+    if (ctx->encode_jobs && ctx->decode_jobs) return 1;
+    free(ctx->encode_jobs);
+    free(ctx->decode_jobs);
+    ctx->encode_jobs = NULL;
+    ctx->decode_jobs = NULL;
+    return 0;
+}
+
+// --- Освобождение задач и их буферов ---
+void huff_blocks_release(HuffContext* ctx) {
+    for (int i = 0; ctx->encode_jobs && i < ctx->batch; i++) {
+        free(ctx->encode_jobs[i].dst);
+        free(ctx->encode_jobs[i].model);
+        free(ctx->encode_jobs[i].checkpoints);
+    }
+    for (int i = 0; ctx->decode_jobs && i < ctx->batch; i++) {
+        free(ctx->decode_jobs[i].buffer);
+        huff_table_free(&ctx->decode_jobs[i].table);
+        for (int k = 0; k < HUFF_MAX_CLUSTERS; k++) {
+            huff_table_free(&ctx->decode_jobs[i].cluster_tables[k]);
+        }
+    }
+    free(ctx->encode_jobs);
+    free(ctx->decode_jobs);
+    free(ctx->offsets);
+    free(ctx->checkpoints);
+    ctx->encode_jobs = NULL;
+    ctx->decode_jobs = NULL;
+    ctx->offsets = NULL;
+    ctx->offsets_cap = 0;
+    ctx->checkpoints = NULL;
+    ctx->checkpoints_cap = 0;
+}
+
+// --- Выполнение пачки задач: одна задача — без передачи в пул ---
+static void run_batch(HuffContext* ctx, void (*fn)(void*), void* jobs,
+                      size_t job_size, int n) {
+    if (n == 1) {
+        fn(jobs);
+        return;
+    }
+    for (int i = 0; i < n; i++) huff_pool_submit(ctx->pool, fn, (char*)jobs + i * job_size);
+    huff_pool_wait(ctx->pool);
+}
+
+// --- Статистика задачи уходит в статистику вызова ---
+static void take_job_stats(HuffContext* ctx, HuffStats* stats) {
+    huff_stats_merge(&ctx->stats, stats);
+    memset(stats, 0, sizeof(*stats));
+}
+
+// --- Отметки блока уходят в общий список для индекса ---
+static int keep_checkpoints(HuffContext* ctx, size_t* count, const EncodeJob* job) {
+    size_t need = *count + job->checkpoint_count;
+    if (job->checkpoint_count == 0) return 1;
+    if (need > ctx->checkpoints_cap) {
+        size_t cap = need * 2;
+        uint64_t* grown = (uint64_t*)realloc(ctx->checkpoints, cap * sizeof(uint64_t));
+        if (!grown) return 0;
+        ctx->checkpoints = grown;
+        ctx->checkpoints_cap = cap;
+    }
+    memcpy(ctx->checkpoints + *count, job->checkpoints, job->checkpoint_count * sizeof(uint64_t));
+    *count = need;
+    return 1;
+}
+
+// --- Число отметок файла: по шагу на блок, кроме начала блока ---
+static uint64_t checkpoint_total(const HuffHeader* header, uint64_t total_symbols) {
+    if (!(header->file_flags & HUFF_FILE_FLAG_SEEK)) return 0;
+    uint64_t step = header->seek_interval;
+    uint64_t per_block = (header->block_size + step - 1) / step - 1;
+    uint64_t full = total_symbols / header->block_size;
+    uint64_t last = total_symbols % header->block_size;
+    return full * per_block + (last ? (last + step - 1) / step - 1 : 0);
+}
+
+// --- Кодирование потока в формат 3 ---
+// В total_bits — сумма длин битовых потоков блоков. Число блоков в хвосте
+// 32-битное: вход, которому при этом block_size нужно больше блоков, не
+// кодируется (HUFF_ERROR_TOO_LARGE), а не пишется в нечитаемый файл.
+HuffError encode_blocks(HuffContext* ctx, HuffInput* in, HuffOutput* out, uint64_t* total_bits) {
+    const HuffOptions* options = &ctx->options;
+    size_t block_size = options->block_size;
+    int max_len = options->max_code_len;
+    if (max_len <= 0 || max_len > HUFF_MAX_DECODE_LEN) max_len = HUFF_MAX_DECODE_LEN;
+
+    int ok = ensure_jobs(ctx);
+    int too_large = 0;
+    int batch = ctx->batch;
+    size_t batch_bytes = (size_t)batch * block_size;
+    EncodeJob* jobs = ctx->encode_jobs;
+    size_t block_count = 0;
+    int stats_on = options->stats != NULL;
+    uint64_t total_size = in->size_known ? in->file_size : 0;
+    HuffTimer timer;
+    huff_timer_start(&timer, stats_on);
+
+    uint8_t header[32];
+    int checksum = options->checksum != 0;
+    uint64_t seek_interval = options->seek_interval;
+    size_t header_size = put_blocked_header(header, block_size,
+                                            (checksum ? HUFF_FILE_FLAG_CHECKSUM : 0) |
+                                            (seek_interval ? HUFF_FILE_FLAG_SEEK : 0),
+                                            seek_interval);
+    if (ok) ok = huff_output_write(out, header, header_size);
+    uint64_t total_symbols = 0;
+    uint32_t file_crc = 0;
+    size_t checkpoint_count = 0;
+    *total_bits = 0;
+
+    while (ok) {
+        // 1. Берём пачку блоков; отображённый файл не копируется
+        const uint8_t* src;
+        size_t got = huff_input_peek(in, batch_bytes, &src);
+        if (got > batch_bytes) got = batch_bytes;
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+        if (got == 0) break;
+
+        int n = 0;
+        for (size_t off = 0; off < got; off += block_size) {
+            jobs[n].src = src + off;
+            jobs[n].size = got - off < block_size ? got - off : block_size;
+            jobs[n].max_code_len = max_len;
+            jobs[n].streams = options->streams;
+            jobs[n].contexts = options->contexts;
+            jobs[n].checksum = checksum;
+            jobs[n].seek_interval = seek_interval;
+            jobs[n].stats_on = stats_on;
+            n++;
+        }
+
+        // 2. Кодируем параллельно; ожидание пула не входит ни в одну фазу
+        run_batch(ctx, encode_block, jobs, sizeof(EncodeJob), n);
+        huff_timer_start(&timer, stats_on);
+
+        // 3. Пишем по порядку и запоминаем смещения для индекса
+        if (block_count + n > UINT32_MAX) {
+            ok = 0;
+            too_large = 1;
+            break;
+        }
+        if (block_count + n > ctx->offsets_cap) {
+            size_t cap = (block_count + n) * 2;
+            uint64_t* grown = (uint64_t*)realloc(ctx->offsets, cap * sizeof(uint64_t));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            ctx->offsets = grown;
+            ctx->offsets_cap = cap;
+        }
+        for (int i = 0; ok && i < n; i++) {
+            if (!jobs[i].ok) {
+                ok = 0;
+                break;
+            }
+            ctx->offsets[block_count++] = huff_output_size(out);
+            ok = huff_output_write(out, jobs[i].dst, jobs[i].dst_size) &&
+                 keep_checkpoints(ctx, &checkpoint_count, &jobs[i]);
+            total_symbols += jobs[i].size;
+            *total_bits += jobs[i].bits;
+            if (checksum) file_crc = huff_crc32c_combine(file_crc, jobs[i].crc, jobs[i].size);
+            if (stats_on) take_job_stats(ctx, &jobs[i].stats);
+        }
+
+        // Готовые блоки сразу уходят дальше по конвейеру
+        if (ok) ok = huff_output_flush(out);
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+
+        huff_input_skip(in, got);
+        huff_progress(ctx, in->consumed, total_size, 0);
+        if (got < batch_bytes) break;
+    }
+    if (in->error) ok = 0;
+    ctx->stats.blocks = block_count;
+
+    // 4. Признак конца, индекс и хвост (по частям: буфер записи не растёт)
+    uint8_t buf[16];
+    buf[0] = 0;
+    if (ok) ok = huff_output_write(out, buf, 1);
+    for (size_t i = 0; ok && i < block_count; i++) {
+        put_le(buf, ctx->offsets[i], 8);
+        ok = huff_output_write(out, buf, 8);
+    }
+    for (size_t i = 0; ok && i < checkpoint_count; i++) {
+        put_le(buf, ctx->checkpoints[i], 8);
+        ok = huff_output_write(out, buf, 8);
+    }
+    if (ok && checksum) {
+        put_le(buf, file_crc, 4);
+        ok = huff_output_write(out, buf, 4);
+    }
+    if (ok) {
+        put_le(buf, total_symbols, 8);
+        put_le(buf + 8, block_count, 4);
+        memcpy(buf + 12, "HUFI", 4);
+        ok = huff_output_write(out, buf, 16);
+    }
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+    if (ok) return HUFF_OK;
+    if (too_large) return HUFF_ERROR_TOO_LARGE;
+    if (in->error) return HUFF_ERROR_READ;
+    if (out->error) return huff_output_error(out);
+    return HUFF_ERROR_NO_MEMORY;
+}
+
+// --- Таблицы кластеров блока и таблица по каждому контексту ---
+static int build_order1_tables(DecodeJob* job, HuffOrder1Tables* tables) {
+    tables->max_len = 0;
+    for (int k = 0; k < job->clusters; k++) {
+        uint64_t words[256];
+        HuffDecodeTable* table = &job->cluster_tables[k];
+        if (!huff_canonical_codes(job->cluster_lens[k], words) ||
+            !huff_table_build(table, words, job->cluster_lens[k])) {
+            return 0;
+        }
+        if (table->max_len > tables->max_len) tables->max_len = table->max_len;
+    }
+    for (int c = 0; c < 256; c++) {
+        const HuffDecodeTable* table = &job->cluster_tables[job->map[c]];
+        tables->entries[c] = table->entries;
+        tables->root_bits[c] = (uint8_t)table->root_bits;
+    }
+    return 1;
+}
+
+// --- Декодирование блока с таблицами по контексту ---
+static void decode_order1_block(DecodeJob* job, HuffTimer* timer) {
+    HuffOrder1Tables tables;
+    if (!build_order1_tables(job, &tables)) return;
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_TABLES);
+
+    if (job->streams == 4) {
+        job->ok = huff_decode_four_streams_order1(&tables, job->src, job->stream_sizes,
+                                                  job->dst, job->size);
+    } else {
+        BitReader br;
+        bit_reader_init(&br, job->src, job->src_size);
+        size_t n = huff_decode_symbols_order1(&tables, &br, job->dst, job->size, 0);
+        job->ok = n == job->size && br.count >= br.pad;
+    }
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_CODING);
+}
+
+// --- Символы [from, to) блока из серий ---
+// Серии до from пропускаются, после to не читаются. Весь блок (to == size)
+// должен занять ровно список серий.
+static int expand_runs(const DecodeJob* job, size_t from, size_t to, uint8_t* out) {
+    const uint8_t* src = job->src;
+    size_t size = job->src_size;
+    size_t pos = 0;
+    size_t at = 0;
+    while (at < to) {
+        uint64_t run;
+        if (pos >= size) return 0;
+        uint8_t b = src[pos++];
+        if (!get_varint(src, size, &pos, &run) || run >= job->size - at) return 0;
+        size_t end = at + (size_t)run + 1;
+        if (end > from) {
+            size_t lo = at > from ? at : from;
+            size_t hi = end < to ? end : to;
+            memset(out + (lo - from), b, hi - lo);
+        }
+        at = end;
+    }
+    return to < job->size || pos == size;
+}
+
+// --- Декодирование символов блока ---
+static void decode_block_symbols(DecodeJob* job, HuffTimer* timer) {
+    if (job->kind != BLOCK_CODED) {
+        if (job->kind == BLOCK_STORED) {
+            memcpy(job->dst, job->src, job->size);
+            job->ok = 1;
+        } else {
+            job->ok = expand_runs(job, 0, job->size, job->dst);
+        }
+        if (job->stats_on) {
+            if (job->kind == BLOCK_STORED) job->stats.stored_blocks++;
+            else job->stats.run_blocks++;
+        }
+        huff_timer_lap(timer, &job->stats, HUFF_PHASE_CODING);
+        return;
+    }
+
+    if (job->unique == 1) {
+        for (int i = 0; i < 256; i++) {
+            if (job->lens[i]) memset(job->dst, i, job->size);
+        }
+        huff_timer_lap(timer, &job->stats, HUFF_PHASE_CODING);
+        job->ok = 1;
+        return;
+    }
+
+    if (job->clusters) {
+        decode_order1_block(job, timer);
+        return;
+    }
+
+    uint64_t words[256];
+    if (!huff_canonical_codes(job->lens, words) ||
+        !huff_table_build(&job->table, words, job->lens)) {
+        return;
+    }
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_TABLES);
+
+    if (job->streams == 4) {
+        job->ok = huff_decode_four_streams(&job->table, job->src, job->stream_sizes,
+                                           job->dst, job->size);
+    } else {
+        BitReader br;
+        bit_reader_init(&br, job->src, job->src_size);
+        size_t n = huff_decode_symbols(&job->table, &br, job->dst, job->size, 1);
+
+        // Все символы на месте и ни один бит не взят из-за конца потока
+        job->ok = n == job->size && br.count >= br.pad;
+    }
+    huff_timer_lap(timer, &job->stats, HUFF_PHASE_CODING);
+}
+
+// --- Декодирование одного блока (выполняется в пуле) ---
+// Контрольная сумма сверяется сразу, пока блок ещё в кэше.
+static void decode_block(void* arg) {
+    DecodeJob* job = (DecodeJob*)arg;
+    job->ok = 0;
+    HuffTimer timer;
+    huff_timer_start(&timer, job->stats_on);
+
+    decode_block_symbols(job, &timer);
+    if (job->ok && job->checksum) {
+        job->ok = huff_crc32c(0, job->dst, job->size) == job->crc;
+        huff_timer_lap(&timer, &job->stats, HUFF_PHASE_CODING);
+    }
+}
+
+// --- Чтение заголовка очередного блока и его потока ---
+// Возвращает 1 — блок прочитан, 0 — блоки кончились, -1 — ошибка.
+static int read_block(HuffInput* in, const HuffHeader* header, DecodeJob* job) {
+    uint64_t block_size = header->block_size;
+    const uint8_t* p;
+    size_t avail = huff_input_peek(in, BLOCK_HEADER_MAX, &p);
+    size_t pos = 0;
+
+    uint64_t size;
+    if (!get_varint(p, avail, &pos, &size)) return -1;
+    if (size == 0) {
+        huff_input_skip(in, pos);
+        return 0;
+    }
+    if (size > block_size || pos >= avail) return -1;
+
+    int flags = p[pos++];
+    job->kind = BLOCK_CODED;
+    job->streams = 1;
+    if (flags & (HUFF_FLAG_STORED | HUFF_FLAG_RUNS)) {
+        // Без таблиц: данные как есть или список серий
+        uint64_t bytes = size;
+        if (flags == HUFF_FLAG_RUNS) {
+            if (!get_varint(p, avail, &pos, &bytes) || bytes > block_size) return -1;
+        } else if (flags != HUFF_FLAG_STORED) {
+            return -1;
+        }
+        job->kind = flags == HUFF_FLAG_RUNS ? BLOCK_RUNS : BLOCK_STORED;
+        job->clusters = 0;
+        job->unique = 256;
+        job->bits = bytes * 8;
+        job->src_size = (size_t)bytes;
+    } else if (flags & HUFF_FLAG_CONTEXTS) {
+        if (flags & ~(HUFF_FLAG_CONTEXTS | HUFF_FLAG_FOUR_STREAMS)) return -1;
+        job->clusters = get_context_tables(p, avail, &pos, job->map, job->cluster_lens);
+        if (job->clusters < 0) return -1;
+        job->unique = 256;      // Не блок из одного символа
+    } else {
+        if (flags & ~(HUFF_FLAG_BYTE_LENGTHS | HUFF_FLAG_SYMBOL_LIST |
+                      HUFF_FLAG_FOUR_STREAMS)) {
+            return -1;
+        }
+        job->clusters = 0;
+        job->unique = get_code_lengths(p, avail, &pos, flags, job->lens);
+        if (job->unique <= 0) return -1;
+    }
+
+    // Длина потока или таблица переходов из четырёх длин
+    if (job->kind == BLOCK_CODED) {
+        job->streams = (flags & HUFF_FLAG_FOUR_STREAMS) ? 4 : 1;
+        job->bits = 0;
+        job->src_size = 0;
+        for (int k = 0; k < job->streams; k++) {
+            uint64_t bits;
+            if (!get_varint(p, avail, &pos, &bits) || bits > block_size * 64) return -1;
+            job->bits += bits;
+            job->stream_sizes[k] = (size_t)((bits + 7) / 8);
+            job->src_size += job->stream_sizes[k];
+        }
+    }
+    job->checksum = (header->file_flags & HUFF_FILE_FLAG_CHECKSUM) != 0;
+    if (job->checksum) {
+        if (avail - pos < 4) return -1;
+        job->crc = (uint32_t)get_le(p + pos, 4);
+        pos += 4;
+    }
+    huff_input_skip(in, pos);
+
+    job->size = (size_t)size;
+    if (job->src_size > block_size * 8) return -1;
+    if (huff_input_peek(in, job->src_size, &p) < job->src_size) return -1;
+
+    // Отображение живёт до конца декодирования, буфер чтения — нет
+    if (in->mapped) {
+        job->src = p;
+    } else {
+        if (job->src_size > job->buffer_cap) {
+            uint8_t* grown = (uint8_t*)realloc(job->buffer, job->src_size);
+            if (!grown) return -1;
+            job->buffer = grown;
+            job->buffer_cap = job->src_size;
+        }
+        // Поток блока из одного символа пуст, а буфер ещё мог не появиться
+        if (job->src_size > 0) memcpy(job->buffer, p, job->src_size);
+        job->src = job->buffer;
+    }
+    huff_input_skip(in, job->src_size);
+    return 1;
+}
+
+// --- Размер исходных данных по хвосту отображённого файла (0 — неизвестен) ---
+// Хвост не проверен декодером: итог больше, чем вмещают блоки из того же
+// хвоста, — HUFF_ERROR_CORRUPT, иначе по нему создавался бы выход любого размера.
+int64_t blocked_output_size(const HuffInput* in, uint64_t block_size) {
+    if (!in->mapped || in->size < 16) return 0;
+    const uint8_t* tail = in->data + in->size - 16;
+    if (memcmp(tail + 12, "HUFI", 4) != 0) return 0;
+    uint64_t total = get_le(tail, 8);
+    uint64_t blocks = get_le(tail + 8, 4);
+    if (total == 0) return 0;
+    if ((total - 1) / block_size >= blocks || total > INT64_MAX) return HUFF_ERROR_CORRUPT;
+    return (int64_t)total;
+}
+
+// --- Наибольший размер формата 3 для size байт ---
+// Поток блока не длиннее самого блока (8-битный код всегда возможен), к нему
+// добавляются заголовок блока с выравниванием потоков и запись индекса.
+size_t blocked_compress_bound(size_t size, size_t block_size, size_t seek_interval) {
+    size_t blocks = size / block_size + 1;
+    size_t checkpoints = seek_interval ? size / seek_interval * 8 : 0;
+    return 32 + size + blocks * (BLOCK_HEADER_MAX + 4 + 8) + checkpoints + 1 + 4 + 16;
+}
+
+// --- Символы [from, to) блока, начиная с отметки ---
+// checkpoints — отметки блока (NULL — их нет, и декодирование идёт с
+// начала блока). Декодируется от ближайшей отметки не дальше from до to в
+// job->buffer, затем кусок уходит в out.
+static int decode_block_range(DecodeJob* job, const uint64_t* checkpoints, uint64_t step,
+                              size_t from, size_t to, uint8_t* out) {
+    if (job->kind == BLOCK_STORED) {
+        memcpy(out, job->src + from, to - from);
+        return 1;
+    }
+    if (job->kind == BLOCK_RUNS) return expand_runs(job, from, to, out);
+    if (job->unique == 1) {
+        for (int i = 0; i < 256; i++) {
+            if (job->lens[i]) memset(out, i, to - from);
+        }
+        return 1;
+    }
+
+    // 1. Таблицы
+    HuffOrder1Tables tables;
+    uint64_t words[256];
+    if (job->clusters) {
+        if (!build_order1_tables(job, &tables)) return 0;
+    } else if (!huff_canonical_codes(job->lens, words) ||
+               !huff_table_build(&job->table, words, job->lens)) {
+        return 0;
+    }
+
+    // 2. Откуда начинать: отметка или начало блока
+    size_t start = 0;
+    uint64_t bit = 0;
+    int prev = 0;
+    if (checkpoints && from >= step) {
+        uint64_t mark = checkpoints[from / step - 1];
+        start = (size_t)(from / step * step);
+        bit = mark & (((uint64_t)1 << 56) - 1);
+        prev = (int)(mark >> 56);
+    }
+    if (to - start > job->buffer_cap) {
+        uint8_t* grown = (uint8_t*)realloc(job->buffer, to - start);
+        if (!grown) return 0;
+        job->buffer = grown;
+        job->buffer_cap = to - start;
+    }
+
+    // 3. По потокам: дойдя до конца потока, продолжаем со следующего
+    size_t seg = job->streams == 4 ? (job->size + 3) / 4 : job->size;
+    for (size_t pos = start; pos < to; ) {
+        size_t k = pos / seg;
+        size_t stream_start = 0;
+        for (size_t i = 0; i < k; i++) stream_start += job->stream_sizes[i];
+        size_t stream_end = stream_start + (job->streams == 4 ? job->stream_sizes[k]
+                                                              : job->src_size);
+        if (pos == k * seg) {
+            bit = (uint64_t)stream_start * 8;
+            prev = 0;
+        }
+        if (bit / 8 < stream_start || bit / 8 > stream_end) return 0;
+
+        BitReader br;
+        bit_reader_init(&br, job->src + bit / 8, stream_end - (size_t)(bit / 8));
+        if (bit % 8) bit_reader_skip(&br, (int)(bit % 8));
+        size_t end = (k + 1) * seg < to ? (k + 1) * seg : to;
+        size_t want = end - pos;
+        uint8_t* dst = job->buffer + (pos - start);
+        size_t got = job->clusters ? huff_decode_symbols_order1(&tables, &br, dst, want, prev)
+                                   : huff_decode_symbols(&job->table, &br, dst, want, 1);
+        if (got != want || br.count < br.pad) return 0;
+        pos = end;
+    }
+    memcpy(out, job->buffer + (from - start), to - from);
+    return 1;
+}
+
+// --- Кусок [offset, offset + len) исходных данных формата 3 ---
+// Вход отображён и стоит сразу после заголовка. Блоки куска находятся по
+// индексу в хвосте, внутри блока — по отметкам, если они есть.
+int64_t decode_blocked_range(HuffContext* ctx, const HuffInput* in, const HuffHeader* header,
+                             uint64_t offset, uint8_t* dst, size_t len) {
+    if (!in->mapped) return HUFF_ERROR_READ;
+    if (!ensure_jobs(ctx)) return HUFF_ERROR_NO_MEMORY;
+    DecodeJob* job = &ctx->decode_jobs[0];
+
+    // 1. Хвост: итоги, контрольная сумма, отметки, индекс — от конца к началу
+    const uint8_t* data = in->data;
+    size_t size = in->size;
+    size_t body = (size_t)in->consumed;
+    if (size < body + 16 || memcmp(data + size - 4, "HUFI", 4) != 0) {
+        return HUFF_ERROR_CORRUPT;
+    }
+    uint64_t total = get_le(data + size - 16, 8);
+    uint64_t block_count = get_le(data + size - 8, 4);
+    uint64_t block_size = header->block_size;
+    if (block_count != (total + block_size - 1) / block_size) return HUFF_ERROR_CORRUPT;
+    uint64_t tail = 16 + ((header->file_flags & HUFF_FILE_FLAG_CHECKSUM) ? 4 : 0);
+    uint64_t marks = checkpoint_total(header, total);
+    if (size - body < tail || (size - body - tail) / 8 < block_count + marks) {
+        return HUFF_ERROR_CORRUPT;
+    }
+    size_t marks_at = size - (size_t)tail - (size_t)marks * 8;
+    size_t index_at = marks_at - (size_t)block_count * 8;
+
+    // 2. Кусок внутри данных
+    if (offset >= total) return 0;
+    if (len > total - offset) len = (size_t)(total - offset);
+    uint64_t end = offset + len;
+    uint64_t step = header->seek_interval;
+    uint64_t per_block = marks ? (block_size + step - 1) / step - 1 : 0;
+    uint64_t* checkpoints = NULL;
+    if (marks) {
+        checkpoints = (uint64_t*)malloc((size_t)per_block * sizeof(uint64_t));
+        if (!checkpoints) return HUFF_ERROR_NO_MEMORY;
+    }
+
+    // 3. Блоки куска по одному
+    int ok = 1;
+    for (uint64_t b = offset / block_size; ok && b * block_size < end; b++) {
+        uint64_t block_start = b * block_size;
+        uint64_t at = get_le(data + index_at + b * 8, 8);
+        if (at < body || at >= index_at) {
+            ok = 0;
+            break;
+        }
+        HuffInput block;
+        huff_input_memory(&block, data + at, index_at - (size_t)at);
+        if (read_block(&block, header, job) != 1 ||
+            job->size != (total - block_start < block_size ? total - block_start : block_size)) {
+            ok = 0;
+            break;
+        }
+        if (marks) {
+            size_t count = (job->size + step - 1) / step - 1;
+            for (size_t i = 0; i < count; i++) {
+                checkpoints[i] = get_le(data + marks_at + (b * per_block + i) * 8, 8);
+            }
+        }
+        size_t from = (size_t)((offset > block_start ? offset : block_start) - block_start);
+        size_t to = (size_t)((end < block_start + job->size ? end : block_start + job->size) -
+                             block_start);
+        ok = decode_block_range(job, checkpoints, step, from, to,
+                                dst + (block_start + from - offset));
+    }
+    free(checkpoints);
+    return ok ? (int64_t)len : HUFF_ERROR_CORRUPT;
+}
+
+// --- Декодирование формата 3 (вход стоит сразу после заголовка) ---
+// Блоки пачки декодируются прямо на их место в выходном файле.
+int decode_blocks(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                  const HuffHeader* header, uint64_t* decoded) {
+    int ok = ensure_jobs(ctx);
+    int batch = ctx->batch;
+    DecodeJob* jobs = ctx->decode_jobs;
+    int checksum = (header->file_flags & HUFF_FILE_FLAG_CHECKSUM) != 0;
+    uint32_t file_crc = 0;
+    int stats_on = ctx->options.stats != NULL;
+    int64_t tail_size = blocked_output_size(in, header->block_size);
+    uint64_t total_size = tail_size > 0 ? (uint64_t)tail_size : 0;
+    HuffTimer timer;
+    huff_timer_start(&timer, stats_on);
+
+    uint64_t block_count = 0;
+    int more = 1;
+    *decoded = 0;
+
+    while (ok && more) {
+        // 1. Читаем пачку блоков
+        int n = 0;
+        size_t batch_size = 0;
+        while (n < batch) {
+            int r = read_block(in, header, &jobs[n]);
+            if (r < 0) ok = 0;
+            if (r <= 0) {
+                more = 0;
+                break;
+            }
+            batch_size += jobs[n].size;
+            jobs[n].stats_on = stats_on;
+            n++;
+        }
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+        if (!ok || n == 0) break;
+
+        // 2. Раскладываем блоки по месту в выходе
+        uint8_t* dst = huff_output_reserve(out, batch_size);
+        if (!dst) {
+            ok = 0;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            jobs[i].dst = dst;
+            dst += jobs[i].size;
+        }
+
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+
+        // 3. Декодируем параллельно
+        run_batch(ctx, decode_block, jobs, sizeof(DecodeJob), n);
+        huff_timer_start(&timer, stats_on);
+
+        for (int i = 0; i < n; i++) {
+            if (!jobs[i].ok) ok = 0;
+            if (checksum) file_crc = huff_crc32c_combine(file_crc, jobs[i].crc, jobs[i].size);
+            if (stats_on) {
+                ctx->stats.bits += jobs[i].bits;
+                take_job_stats(ctx, &jobs[i].stats);
+            }
+        }
+        if (!ok || !huff_output_commit(out, batch_size)) {
+            ok = 0;
+            break;
+        }
+        huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+        *decoded += batch_size;
+        block_count += (uint64_t)n;
+        huff_progress(ctx, *decoded, total_size, 0);
+    }
+    ctx->stats.blocks = block_count;
+    ctx->stats.symbols = *decoded;
+
+    // 4. Сверяем хвост: индекс и отметки пропускаем по частям, итоги и
+    //    контрольная сумма файла должны совпасть
+    const uint8_t* tail;
+    uint64_t index_size = (block_count + checkpoint_total(header, *decoded)) * 8;
+    for (uint64_t left = index_size; ok && left > 0; ) {
+        size_t got = huff_input_peek(in, 1, &tail);
+        if (got == 0) ok = 0;
+        if (got > left) got = (size_t)left;
+        huff_input_skip(in, got);
+        left -= got;
+    }
+    if (ok && checksum) {
+        if (huff_input_peek(in, 4, &tail) < 4) {
+            ok = 0;
+        } else {
+            ok = (uint32_t)get_le(tail, 4) == file_crc;
+            huff_input_skip(in, 4);
+        }
+    }
+    if (ok) {
+        if (huff_input_peek(in, 16, &tail) < 16) {
+            ok = 0;
+        } else {
+            ok = memcmp(tail + 12, "HUFI", 4) == 0 && get_le(tail, 8) == *decoded &&
+                 get_le(tail + 8, 4) == block_count;
+            huff_input_skip(in, 16);
+        }
+    }
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+
+    return ok;
+}
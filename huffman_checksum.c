@@ -0,0 +1,110 @@
+#include "huffman_internal.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HUFF_HAVE_SSE42_KERNEL 1
+#endif
+
+// CRC32C (полином Кастаньоли, отражённый, начальное и конечное значение
+// ~0) — как у iSCSI и ext4. На x86 с SSE4.2 считается инструкцией crc32
+// по 8 байт, иначе таблицами по 8 байт за шаг. Контрольная сумма файла
+// собирается из сумм блоков сдвигом (huff_crc32c_combine), поэтому блоки
+// по-прежнему считаются параллельно.
+
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crc_tables[8][256];
+static pthread_once_t crc_tables_once = PTHREAD_ONCE_INIT;
+
+// --- Таблицы для 8 байт за шаг: tables[k][b] — b, за которым k нулей ---
+static void build_crc_tables(void) {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++) crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc_tables[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc_tables[k - 1][b];
+            crc_tables[k][b] = (prev >> 8) ^ crc_tables[0][prev & 0xFF];
+        }
+    }
+}
+
+// --- Переносимый вариант ---
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t* p, size_t size) {
+    pthread_once(&crc_tables_once, build_crc_tables);
+    while (size >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                             (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc_tables[7][lo & 0xFF] ^ crc_tables[6][(lo >> 8) & 0xFF] ^
+              crc_tables[5][(lo >> 16) & 0xFF] ^ crc_tables[4][lo >> 24] ^
+              crc_tables[3][p[4]] ^ crc_tables[2][p[5]] ^
+              crc_tables[1][p[6]] ^ crc_tables[0][p[7]];
+        p += 8;
+        size -= 8;
+    }
+    while (size--) crc = (crc >> 8) ^ crc_tables[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#ifdef HUFF_HAVE_SSE42_KERNEL
+// --- SSE4.2: инструкция crc32 ---
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t size) {
+#if defined(__x86_64__)
+    uint64_t c = crc;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)c;
+#endif
+    while (size >= 4) {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        crc = _mm_crc32_u32(crc, word);
+        p += 4;
+        size -= 4;
+    }
+    while (size--) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+// --- CRC32C буфера, продолжая crc (0 — начало данных) ---
+uint32_t huff_crc32c(uint32_t crc, const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+#ifdef HUFF_HAVE_SSE42_KERNEL
+    if (__builtin_cpu_supports("sse4.2")) return ~crc32c_sse42(crc, p, size);
+#endif
+    return ~crc32c_scalar(crc, p, size);
+}
+
+// --- Произведение многочленов a * b по модулю полинома (отражённые) ---
+static uint32_t multiply_mod_poly(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m; m >>= 1) {
+        if (a & m) product ^= b;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+// --- CRC32C данных A, за которыми идут B, по crc1 = CRC(A), crc2 = CRC(B) ---
+// crc1 сдвигается на len2 нулевых байт умножением на x^(8 * len2).
+uint32_t huff_crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+    uint32_t shift = 1u << 31;          // x^0
+    uint32_t square = 1u << 23;         // x^8
+    for (; len2; len2 >>= 1) {
+        if (len2 & 1) shift = multiply_mod_poly(square, shift);
+        square = multiply_mod_poly(square, square);
+    }
+    return multiply_mod_poly(shift, crc1) ^ crc2;
+}
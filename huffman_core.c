@@ -1,91 +1,147 @@
-#include "huffman.h"
+#include "huffman_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // --- Локальные функции (используются только внутри этого файла) ---
-static Node* create_node(unsigned char symbol, uint32_t freq);
-static void sort_nodes(Node** nodes, int n);
-static Node* build_huffman_tree(Node** nodes, int* node_count);
-static void generate_codes(Node* node, char* buffer, int depth, char** codes);
-static void read_frequencies_from_huff(const char* filename, uint32_t* freq);
-
-// --- Создание узла ---
-Node* create_node(unsigned char symbol, uint32_t freq) {
-    Node* node = (Node*)malloc(sizeof(Node));
-    node->symbol = symbol;
-    node->freq = freq;
-    node->left = node->right = NULL;
-    return node;
-}
+static void generate_codes(const Node* node, char* buffer, int depth, char** codes);
+static void collect_words(const Node* node, uint64_t word, int depth,
+                          uint64_t* words, uint8_t* lens, int* max_depth);
+static void package_merge(const uint32_t* freq, int max_len, uint8_t* lens);
 
 // --- Подсчёт частот ---
+// Считается в 64 бита; у файла больше 4 ГБ частоты уменьшены
+// huff_scale_frequencies, чтобы по ним строилось дерево.
 uint32_t* count_frequencies(const char* filename) {
     uint32_t* freq = (uint32_t*)calloc(256, sizeof(uint32_t));
     if (!freq) return NULL;
 
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
+    HuffInput in;
+    if (!huff_input_open(&in, filename)) {
         free(freq);
         return NULL;
     }
 
-    int c;
-    while ((c = fgetc(file)) != EOF) {
-        freq[c]++;
+    // Отображённый файл виден целиком сразу, остальные — кусками
+    uint64_t wide[256] = {0};
+    const uint8_t* p;
+    size_t got;
+    while ((got = huff_input_peek(&in, 1, &p)) > 0) {
+        huff_histogram64(p, got, wide);
+        huff_input_skip(&in, got);
     }
 
-    fclose(file);
+    huff_input_close(&in);
+    huff_scale_frequencies(wide, freq);
     return freq;
 }
 
-// --- Сортировка узлов по частоте (пузырьком) ---
-void sort_nodes(Node** nodes, int n) {
-    for (int i = 0; i < n - 1; i++) {
-        for (int j = 0; j < n - i - 1; j++) {
-            if (nodes[j]->freq > nodes[j + 1]->freq) {
-                Node* tmp = nodes[j];
-                nodes[j] = nodes[j + 1];
-                nodes[j + 1] = tmp;
-            }
-        }
+// --- Частоты для дерева: сумма должна помещаться в 32 бита ---
+// Узел дерева хранит сумму частот поддерева в uint32_t, поэтому после
+// сдвига сумма не больше UINT32_MAX: округление и единицы у редких
+// символов добавляют к ней меньше 512. Пока сумма помещается, частоты
+// не меняются, и коды старых файлов остаются прежними.
+int huff_scale_frequencies(const uint64_t* freq, uint32_t* scaled) {
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i++) total += freq[i];
+
+    int shift = 0;
+    while ((total >> shift) + (shift ? 512 : 0) > UINT32_MAX) shift++;
+
+    uint64_t half = shift ? (uint64_t)1 << (shift - 1) : 0;
+    for (int i = 0; i < 256; i++) {
+        uint64_t f = (freq[i] + half) >> shift;
+        scaled[i] = (uint32_t)(freq[i] && f == 0 ? 1 : f);
     }
+    return shift;
+}
+
+// --- Очередь узлов при построении дерева ---
+// Ключ узла — частота, а при равных частотах порядок, который давала
+// прежняя устойчивая сортировка пузырьком: новый внутренний узел встаёт
+// перед всеми узлами той же частоты (более новый — раньше), листья идут
+// по возрастанию символа. От этого порядка зависят коды старого формата,
+// поэтому он сохранён в точности.
+// Младшие 9 бит ключа: 256 + символ у листа, 255 - k у k-го внутреннего узла.
+#define TREE_RANK_BITS 9
+
+static uint64_t tree_key(uint32_t freq, int rank) {
+    return ((uint64_t)freq << TREE_RANK_BITS) | (uint64_t)rank;
+}
+
+// Номер узла в HuffTree.nodes по ключу: листья лежат по символам,
+// внутренние узлы — после них в порядке создания
+static int tree_node_index(uint64_t key) {
+    int rank = (int)(key & ((1 << TREE_RANK_BITS) - 1));
+    return rank >= 256 ? rank - 256 : 256 + (255 - rank);
+}
+
+static void heap_push(uint64_t* heap, int* n, uint64_t key) {
+    int i = (*n)++;
+    while (i > 0 && heap[(i - 1) / 2] > key) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = key;
+}
+
+static uint64_t heap_pop(uint64_t* heap, int* n) {
+    uint64_t top = heap[0];
+    uint64_t last = heap[--(*n)];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *n) break;
+        if (child + 1 < *n && heap[child + 1] < heap[child]) child++;
+        if (heap[child] >= last) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
 }
 
 // --- Построение дерева Хаффмана ---
-Node* build_huffman_tree(Node** nodes, int* node_count) {
-    int n = *node_count;
+// Все узлы лежат в tree, память не выделяется и не освобождается.
+// Возвращает корень (NULL, если символов нет). Единственный символ
+// получает фиктивный корень, чтобы его код был "0".
+const Node* huff_build_tree(HuffTree* tree, const uint32_t* freq) {
+    uint64_t heap[256];
+    int n = 0;
+    for (int i = 0; i < 256; i++) {
+        Node* leaf = &tree->nodes[i];
+        leaf->symbol = (unsigned char)i;
+        leaf->freq = freq[i];
+        leaf->left = leaf->right = NULL;
+        if (freq[i]) heap_push(heap, &n, tree_key(freq[i], 256 + i));
+    }
     if (n == 0) return NULL;
 
+    Node* root = &tree->nodes[256];
     if (n == 1) {
-        // Особый случай: один символ — делаем фиктивный корень
-        Node* root = create_node(0, nodes[0]->freq);
-        root->left = nodes[0];
-        *node_count = 1;
+        root->symbol = 0;
+        root->freq = (uint32_t)(heap[0] >> TREE_RANK_BITS);
+        root->left = &tree->nodes[tree_node_index(heap[0])];
+        root->right = NULL;
         return root;
     }
 
-    while (n > 1) {
-        sort_nodes(nodes, n);
-        Node* left = nodes[0];
-        Node* right = nodes[1];
-        Node* parent = create_node(0, left->freq + right->freq);
+    // Каждый раз сливаются два наименьших узла: первый — левый потомок
+    for (int k = 0; n > 1; k++) {
+        Node* left = &tree->nodes[tree_node_index(heap_pop(heap, &n))];
+        Node* right = &tree->nodes[tree_node_index(heap_pop(heap, &n))];
+        Node* parent = &tree->nodes[256 + k];
+        parent->symbol = 0;
+        parent->freq = left->freq + right->freq;
         parent->left = left;
         parent->right = right;
-
-        nodes[0] = parent;
-        for (int i = 1; i < n - 1; i++) {
-            nodes[i] = nodes[i + 1];
-        }
-        n--;
+        heap_push(heap, &n, tree_key(parent->freq, 255 - k));
     }
-
-    *node_count = n;
-    return nodes[0];
+    return &tree->nodes[tree_node_index(heap[0])];
 }
 
 // --- Генерация кодов рекурсивно ---
-void generate_codes(Node* node, char* buffer, int depth, char** codes) {
+void generate_codes(const Node* node, char* buffer, int depth, char** codes) {
     if (!node) return;
 
     if (!node->left && !node->right) {
@@ -108,6 +164,168 @@ void generate_codes(Node* node, char* buffer, int depth, char** codes) {
     }
 }
 
+// --- Сбор кодов в виде чисел (для табличного декодера) ---
+void collect_words(const Node* node, uint64_t word, int depth,
+                   uint64_t* words, uint8_t* lens, int* max_depth) {
+    if (!node) return;
+
+    if (!node->left && !node->right) {
+        if (depth > *max_depth) *max_depth = depth;
+        if (depth <= HUFF_MAX_DECODE_LEN) {
+            words[node->symbol] = word;
+            lens[node->symbol] = (uint8_t)depth;
+        }
+        return;
+    }
+
+    collect_words(node->left, word << 1, depth + 1, words, lens, max_depth);
+    collect_words(node->right, (word << 1) | 1, depth + 1, words, lens, max_depth);
+}
+
+// --- Коды дерева: words[s] — биты кода, lens[s] — длина (0 — нет символа) ---
+// Возвращает длину самого длинного кода.
+int collect_code_words(const Node* root, uint64_t* words, uint8_t* lens) {
+    for (int i = 0; i < 256; i++) {
+        words[i] = 0;
+        lens[i] = 0;
+    }
+
+    int max_depth = 0;
+    collect_words(root, 0, 0, words, lens, &max_depth);
+    return max_depth;
+}
+
+// --- Длины кодов с ограничением max_len (алгоритм package-merge) ---
+// Список уровня 1 — листья по возрастанию частоты. Список уровня l+1 —
+// слияние листьев с «пакетами», склеенными попарно из списка уровня l.
+// В оптимальный код входят первые 2n-2 элемента списка уровня max_len;
+// длина кода символа — сколько раз его лист попал в выбранные элементы.
+// Выбор разворачивается сверху вниз: k выбранных элементов уровня l,
+// среди которых p пакетов, — это ещё 2p первых элементов уровня l-1.
+// Вес нужен только у соседних уровней, а пометки пакетов — у всех, но их
+// не больше PACKAGE_MERGE_LEVELS x 512, поэтому память на стеке и функция
+// не может не сработать.
+#define PACKAGE_MERGE_LEVELS HUFF_MAX_DECODE_LEN
+
+void package_merge(const uint32_t* freq, int max_len, uint8_t* lens) {
+    int order[256];
+    int n = 0;
+    for (int i = 0; i < 256; i++) {
+        lens[i] = 0;
+        if (freq[i]) order[n++] = i;
+    }
+
+    // Листья по возрастанию частоты, при равенстве — по символу
+    for (int i = 1; i < n; i++) {
+        int s = order[i];
+        int j = i - 1;
+        while (j >= 0 && freq[order[j]] > freq[s]) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = s;
+    }
+
+    // Код длиннее PACKAGE_MERGE_LEVELS декодер всё равно не прочитает
+    if (max_len > PACKAGE_MERGE_LEVELS) max_len = PACKAGE_MERGE_LEVELS;
+    uint64_t weight[2][512];
+    unsigned char is_package[PACKAGE_MERGE_LEVELS][512];
+    int size[PACKAGE_MERGE_LEVELS];
+    memset(is_package, 0, (size_t)max_len * sizeof(is_package[0]));
+
+    for (int i = 0; i < n; i++) weight[0][i] = freq[order[i]];
+    size[0] = n;
+
+    for (int l = 1; l < max_len; l++) {
+        const uint64_t* prev = weight[(l - 1) & 1];
+        uint64_t* cur = weight[l & 1];
+        unsigned char* pkg = is_package[l];
+        int packages = size[l - 1] / 2;
+        int a = 0, b = 0, k = 0;
+
+        while (a < n || b < packages) {
+            uint64_t pw = b < packages ? prev[2 * b] + prev[2 * b + 1] : 0;
+            if (b >= packages || (a < n && freq[order[a]] <= pw)) {
+                cur[k++] = freq[order[a++]];
+            } else {
+                pkg[k] = 1;
+                cur[k++] = pw;
+                b++;
+            }
+        }
+        size[l] = k;
+    }
+
+    int take = 2 * n - 2;
+    for (int l = max_len - 1; l >= 0 && take > 0; l--) {
+        const unsigned char* pkg = is_package[l];
+        int leaves = 0, packages = 0;
+        for (int i = 0; i < take; i++) {
+            if (pkg[i]) packages++;
+            else leaves++;
+        }
+        for (int i = 0; i < leaves; i++) lens[order[i]]++;
+        take = 2 * packages;
+    }
+}
+
+// --- Длины кодов Хаффмана по частотам ---
+// max_len > 0 ограничивает длину кода (но не меньше, чем нужно, чтобы
+// уместить все символы). Возвращает длину самого длинного кода.
+// Единственному символу даётся длина 1.
+int huff_code_lengths(const uint32_t* freq, int max_len, uint8_t* lens) {
+    int unique = 0;
+    for (int i = 0; i < 256; i++) {
+        if (freq[i]) unique++;
+    }
+
+    // Единственному символу дерево тоже даёт длину 1
+    HuffTree tree;
+    uint64_t words[256];
+    int longest = collect_code_words(huff_build_tree(&tree, freq), words, lens);
+    if (unique < 2) return longest;
+    if (max_len <= 0 || longest <= max_len) return longest;
+
+    // Дерево вышло глубже предела — строим оптимальный ограниченный код
+    int min_len = 0;
+    while ((1 << min_len) < unique) min_len++;
+    if (max_len < min_len) max_len = min_len;
+
+    package_merge(freq, max_len, lens);
+
+    longest = 0;
+    for (int i = 0; i < 256; i++) {
+        if (lens[i] > longest) longest = lens[i];
+    }
+    return longest;
+}
+
+// --- Канонические коды по длинам ---
+// Коды раздаются по возрастанию длины, при равной длине — по возрастанию
+// символа, поэтому кодеру и декодеру достаточно знать одни длины.
+// Возвращает 0, если длины не образуют префиксный код.
+int huff_canonical_codes(const uint8_t* lens, uint64_t* words) {
+    uint32_t count[HUFF_MAX_DECODE_LEN + 1] = {0};
+    for (int i = 0; i < 256; i++) {
+        if (lens[i] > HUFF_MAX_DECODE_LEN) return 0;
+        count[lens[i]]++;
+    }
+    count[0] = 0;
+
+    uint64_t next[HUFF_MAX_DECODE_LEN + 2];
+    uint64_t code = 0;
+    for (int len = 1; len <= HUFF_MAX_DECODE_LEN; len++) {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+        if (count[len] && code + count[len] > (1ull << len)) return 0;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        words[i] = lens[i] ? next[lens[i]]++ : 0;
+    }
+    return 1;
+}
+
 // --- Построение словаря кодов ---
 char** build_huffman_dictionary(const uint32_t* freq) {
     // Выделяем память для кодов
@@ -140,33 +358,33 @@ char** build_huffman_dictionary(const uint32_t* freq) {
     }
 
     // Обычный случай: несколько символов
-    Node** nodes = (Node**)malloc(unique * sizeof(Node*));
-    if (!nodes) {
-        free(codes);
-        return NULL;
-    }
-
-    // Создаем узлы для каждого символа
-    int idx = 0;
-    for (int i = 0; i < 256; i++) {
-        if (freq[i]) {
-            nodes[idx++] = create_node((unsigned char)i, freq[i]);
-        }
-    }
-
-    int node_count = unique;
-    Node* root = build_huffman_tree(nodes, &node_count);
+    HuffTree tree;
+    const Node* root = huff_build_tree(&tree, freq);
 
     // Генерируем коды
     char buffer[257];
     generate_codes(root, buffer, 0, codes);
 
-    // Освобождаем память узлов (но не само дерево целиком)
-    free(nodes);
-
     return codes;
 }
 
+// --- Построение словаря в упакованном виде ---
+// Те же коды, что у build_huffman_dictionary, но числами: кодеру не нужно
+// разбирать строки. Возвращает длину самого длинного кода.
+int build_huffman_code_table(const uint32_t* freq, HuffCode* codes) {
+    // Единственный символ получает код "0" от фиктивного корня
+    HuffTree tree;
+    uint64_t words[256];
+    uint8_t lens[256];
+    int longest = collect_code_words(huff_build_tree(&tree, freq), words, lens);
+
+    for (int i = 0; i < 256; i++) {
+        codes[i].word = words[i];
+        codes[i].len = lens[i];
+    }
+    return longest;
+}
+
 // --- Печать словаря ---
 void print_dictionary(const char** codes, const uint32_t* freq) {
     printf("\n=== Translation Dictionary ===\n");
@@ -192,56 +410,37 @@ void print_dictionary(const char** codes, const uint32_t* freq) {
     }
 }
 
-// --- Чтение частот из заголовка .huff файла ---
-void read_frequencies_from_huff(const char* filename, uint32_t* freq) {
-    for (int i = 0; i < 256; i++) freq[i] = 0;
-
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        printf("Error: cannot open %s\n", filename);
-        return;
-    }
-
-    uint32_t symbol_count;
-    if (fread(&symbol_count, sizeof(uint32_t), 1, file) != 1) {
-        fclose(file);
-        return;
-    }
-
-    for (uint32_t i = 0; i < symbol_count; i++) {
-        int c = fgetc(file);
-        uint32_t f;
-        if (fread(&f, sizeof(uint32_t), 1, file) != 1) {
-            break;
-        }
-        freq[c] = f;
-    }
-
-    fclose(file);
-}
-
 // --- Сравнение двух файлов ---
 int files_equal(const char* f1, const char* f2) {
-    FILE* a = fopen(f1, "rb");
-    FILE* b = fopen(f2, "rb");
-    if (!a || !b) return 0;
+    HuffInput a, b;
+    if (!huff_input_open(&a, f1)) return 0;
+    if (!huff_input_open(&b, f2)) {
+        huff_input_close(&a);
+        return 0;
+    }
 
-    int c1, c2;
-    int equal = 1;
+    // Разные размеры видны сразу, без чтения
+    int equal = !(a.size_known && b.size_known && a.file_size != b.file_size);
 
-    while (1) {
-        c1 = fgetc(a);
-        c2 = fgetc(b);
+    while (equal) {
+        const uint8_t* pa;
+        const uint8_t* pb;
+        size_t na = huff_input_peek(&a, 1, &pa);
+        size_t nb = huff_input_peek(&b, 1, &pb);
+        size_t n = na < nb ? na : nb;
 
-        if (c1 != c2) {
-            equal = 0;
+        if (n == 0) {
+            equal = na == nb;
             break;
         }
-
-        if (c1 == EOF) break;
+        if (memcmp(pa, pb, n) != 0) equal = 0;
+        huff_input_skip(&a, n);
+        huff_input_skip(&b, n);
     }
 
-    fclose(a);
-    fclose(b);
+    if (a.error || b.error) equal = 0;
+
+    huff_input_close(&a);
+    huff_input_close(&b);
     return equal;
 }
\ No newline at end of file
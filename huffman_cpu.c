@@ -0,0 +1,56 @@
+#include "huffman_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Горячие ядра (дозагрузка и табличное декодирование, запись кодов)
+// собраны в нескольких вариантах под наборы инструкций.
+// Вариант выбирается один раз за процесс: по cpuid, но не выше уровня из
+// переменной окружения HUFF_CPU (generic, bmi2) — так переносимый
+// вариант проверяется на любой машине.
+
+static const char* level_names[HUFF_CPU_LEVELS] = {"generic", "bmi2"};
+
+static HuffCpuLevel selected_level = HUFF_CPU_GENERIC;
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+// --- Что умеет процессор ---
+HuffCpuLevel huff_cpu_detect(void) {
+#ifdef HUFF_HAVE_X86_KERNELS
+    if (__builtin_cpu_supports("bmi2")) return HUFF_CPU_BMI2;
+#endif
+    return HUFF_CPU_GENERIC;
+}
+
+// --- Выбор при первом обращении: cpuid и HUFF_CPU ---
+static void select_level(void) {
+    HuffCpuLevel level = huff_cpu_detect();
+    const char* want = getenv("HUFF_CPU");
+    if (want) {
+        for (int i = 0; i < HUFF_CPU_LEVELS; i++) {
+            if (strcmp(want, level_names[i]) == 0 && (HuffCpuLevel)i < level) {
+                level = (HuffCpuLevel)i;
+            }
+        }
+    }
+    selected_level = level;
+}
+
+// --- Вариант ядер этого процесса ---
+HuffCpuLevel huff_cpu_level(void) {
+    pthread_once(&select_once, select_level);
+    return selected_level;
+}
+
+// --- Смена варианта (замеры); выше возможностей процессора не поднимается ---
+// Вызывать, пока библиотека не работает в других потоках.
+HuffCpuLevel huff_cpu_force(HuffCpuLevel level) {
+    pthread_once(&select_once, select_level);
+    HuffCpuLevel best = huff_cpu_detect();
+    selected_level = level < best ? level : best;
+    return selected_level;
+}
+
+const char* huff_cpu_name(HuffCpuLevel level) {
+    return level >= 0 && level < HUFF_CPU_LEVELS ? level_names[level] : "?";
+}
@@ -1,259 +1,368 @@
-#include "huffman.h"
+#include "huffman_internal.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// --- Кодирование файла ---
-void encode_file(const char* input_filename, const char* output_filename) {
-    // 1. Подсчитываем частоты символов
-    uint32_t* freq = count_frequencies(input_filename);
-    if (!freq) {
-        printf("Error: cannot read input file %s\n", input_filename);
-        return;
-    }
-
-    // 2. Открываем файлы
-    FILE* in = fopen(input_filename, "rb");
-    FILE* out = fopen(output_filename, "wb");
-    if (!in || !out) {
-        printf("Error: cannot open files for encoding\n");
-        free(freq);
-        return;
-    }
+// Файловые функции: открывают файлы, отдают работу контексту
+// (huffman_api.c) и печатают отчёт. Открытие и закрытие файлов входят
+// в статистику как чтение и запись: отображение подгружает файл при открытии.
+// huff_compress_file и huff_decompress_file делают то же молча и через
+// контекст вызывающего — для пакетной обработки.
+
+// --- Локальные функции ---
+static FILE* report_stream(const char* output_filename);
+static void report_printf(FILE* report, const char* format, ...);
+static void print_encode_results(FILE* report,
+                                 const char* input_filename, uint64_t input_size,
+                                 const char* output_filename, uint64_t output_size,
+                                 uint64_t total_bits);
+static void print_progress_dot(void* user, uint64_t done, uint64_t total);
+static HuffError encode_path(HuffContext* ctx, const char* input_filename,
+                             const char* output_filename, FILE* report,
+                             HuffEncodeInfo* info, uint64_t* output_size);
+static HuffError decode_path(HuffContext* ctx, const char* encoded_filename,
+                             const char* output_filename, FILE* report);
+
+
+// --- Куда писать сообщения: при выводе данных в stdout ("-") — в stderr ---
+FILE* report_stream(const char* output_filename) {
+    return strcmp(output_filename, "-") == 0 ? stderr : stdout;
+}
 
-    // 3. Записываем заголовок с частотами
-    uint32_t symbol_count = 0;
-    for (int i = 0; i < 256; i++) {
-        if (freq[i]) symbol_count++;
-    }
-    fwrite(&symbol_count, sizeof(uint32_t), 1, out);
+// --- Сообщение в отчёт (report == NULL — молча) ---
+void report_printf(FILE* report, const char* format, ...) {
+    if (!report) return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(report, format, args);
+    va_end(args);
+}
 
-    for (int i = 0; i < 256; i++) {
-        if (freq[i]) {
-            fputc((unsigned char)i, out);
-            fwrite(&freq[i], sizeof(uint32_t), 1, out);
-        }
-    }
+// --- Вывод размеров и степени сжатия ---
+void print_encode_results(FILE* report,
+                          const char* input_filename, uint64_t input_size,
+                          const char* output_filename, uint64_t output_size,
+                          uint64_t total_bits) {
+    fprintf(report, "\n=== Encoding Results ===\n");
+    fprintf(report, "Input file:  %s (%lu bytes)\n", input_filename, (unsigned long)input_size);
+    fprintf(report, "Output file: %s (%lu bytes)\n", output_filename, (unsigned long)output_size);
+    fprintf(report, "Total bits:  %lu\n", (unsigned long)total_bits);
 
-    // 4. Строим коды Хаффмана
-    char** codes = build_huffman_dictionary(freq);
-    if (!codes) {
-        printf("Error: failed to build Huffman codes\n");
-        fclose(in);
-        fclose(out);
-        free(freq);
-        return;
+    if (input_size > 0) {
+        double ratio = (double)output_size / input_size;
+        fprintf(report, "Compression: %.2f%%\n", (1.0 - ratio) * 100.0);
     }
+}
 
-    // 5. Кодируем данные файла
-    unsigned char byte = 0;
-    int bit_count = 0;
-    long total_bits = 0;
-    int c;
-
-    while ((c = fgetc(in)) != EOF) {
-        char* code = codes[c];
-        if (!code) {
-            printf("Error: no code for symbol %d\n", c);
-            break;
-        }
+// --- Прогресс декодирования: точка на отчёт ---
+void print_progress_dot(void* user, uint64_t done, uint64_t total) {
+    (void)done;
+    (void)total;
+    FILE* report = (FILE*)user;
+    fputc('.', report);
+    fflush(report);
+}
 
-        for (int i = 0; code[i] != '\0'; i++) {
-            if (code[i] == '1') {
-                byte |= (1 << (7 - bit_count));
-            }
-            bit_count++;
-            total_bits++;
-
-            if (bit_count == 8) {
-                fputc(byte, out);
-                byte = 0;
-                bit_count = 0;
-            }
-        }
+// --- Кодирование файла в файл через контекст; ошибки — в report ---
+HuffError encode_path(HuffContext* ctx, const char* input_filename,
+                      const char* output_filename, FILE* report,
+                      HuffEncodeInfo* info, uint64_t* output_size) {
+    huff_stats_begin(ctx);
+    HuffTimer timer;
+    huff_timer_start(&timer, ctx->options.stats != NULL);
+
+    // 1. Открываем файлы; выход сразу отображается под наибольший размер
+    // и в конце обрезается по записанному (с конвейером — пишется потоком)
+    HuffInput in;
+    if (!huff_input_open_io(&in, input_filename, ctx->options.io)) {
+        report_printf(report, "Error: cannot read input file %s\n", input_filename);
+        return HUFF_ERROR_READ;
     }
-
-    // Записываем последний неполный байт
-    if (bit_count > 0) {
-        fputc(byte, out);
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+    HuffOutput out;
+    if (!huff_output_open_io(&out, output_filename,
+                             huff_compress_bound(ctx, (size_t)in.file_size),
+                             ctx->options.io)) {
+        report_printf(report, "Error: cannot open files for encoding\n");
+        huff_input_close(&in);
+        return HUFF_ERROR_WRITE;
     }
-
-    // 6. Закрываем файлы
-    fclose(in);
-    fclose(out);
-
-    // 7. Вычисляем статистику
-    FILE* tmp = fopen(input_filename, "rb");
-    long input_size = 0;
-    if (tmp) {
-        fseek(tmp, 0, SEEK_END);
-        input_size = ftell(tmp);
-        fclose(tmp);
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+
+    // 2. Кодируем
+    HuffError err = huff_encode_stream(ctx, &in, &out, info);
+    *output_size = huff_output_size(&out);
+    huff_timer_start(&timer, ctx->options.stats != NULL);
+    huff_input_close(&in);
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+    if (!huff_output_close(&out) && err == HUFF_OK) err = HUFF_ERROR_WRITE;
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+    huff_stats_end(ctx, info->input_size, *output_size);
+
+    if (err == HUFF_ERROR_READ) {
+        report_printf(report, "Error: cannot read input file %s\n", input_filename);
+    } else if (err == HUFF_ERROR_WRITE) {
+        report_printf(report, "Error: cannot write output file %s\n", output_filename);
+    } else if (err != HUFF_OK) {
+        report_printf(report, "Error: encoding failed: %s\n", huff_error_string(err));
     }
+    return err;
+}
 
-    tmp = fopen(output_filename, "rb");
-    long output_size = 0;
-    if (tmp) {
-        fseek(tmp, 0, SEEK_END);
-        output_size = ftell(tmp);
-        fclose(tmp);
-    }
+// --- Кодирование файла ---
+HuffError encode_file(const char* input_filename, const char* output_filename) {
+    return encode_file_ex(input_filename, output_filename, NULL);
+}
 
-    // 8. Выводим результаты
-    printf("\n=== Encoding Results ===\n");
-    printf("Input file:  %s (%ld bytes)\n", input_filename, input_size);
-    printf("Output file: %s (%ld bytes)\n", output_filename, output_size);
-    printf("Total bits:  %ld\n", total_bits);
+// --- Кодирование файла с параметрами ---
+HuffError encode_file_ex(const char* input_filename, const char* output_filename,
+                         const HuffOptions* options) {
+    FILE* report = report_stream(output_filename);
+    HuffContext* ctx = huff_context_create(options);
+    if (!ctx) {
+        fprintf(report, "Error: out of memory\n");
+        return HUFF_ERROR_NO_MEMORY;
+    }
 
-    if (input_size > 0) {
-        double ratio = (double)output_size / input_size;
-        printf("Compression: %.2f%%\n", (1.0 - ratio) * 100.0);
+    HuffEncodeInfo info;
+    uint64_t output_size = 0;
+    HuffError err = encode_path(ctx, input_filename, output_filename, report,
+                                &info, &output_size);
+    if (err != HUFF_OK) {
+        huff_context_free(ctx);
+        return err;
     }
 
-    // 9. Освобождаем память
-    for (int i = 0; i < 256; i++) {
-        if (codes[i]) {
-            free(codes[i]);
-        }
+    // Выводим результаты
+    const HuffOptions* used = &ctx->options;
+    print_encode_results(report, input_filename, info.input_size, output_filename,
+                         output_size, info.total_bits);
+
+    if (used->format == HUFF_FORMAT_BLOCKED) {
+        fprintf(report, "Block size:  %u bytes, threads: %d, streams: %d\n",
+                       used->block_size, ctx->threads, used->streams);
+    } else if (used->format == HUFF_FORMAT_CANONICAL && info.unique > 1) {
+        // Цена предела: насколько поток длиннее, чем с неограниченными кодами
+        uint64_t free_bits = info.total_bits - info.limit_cost;
+        fprintf(report, "Max code len: %d bits (limit %d), +%.3f%% bits vs unlimited\n",
+                       info.longest, used->max_code_len,
+                       free_bits > 0 ? 100.0 * (double)info.limit_cost / free_bits : 0.0);
     }
-    free(codes);
-    free(freq);
 
-    printf("Encoding completed successfully!\n");
+    fprintf(report, "Encoding completed successfully!\n");
+    huff_context_free(ctx);
+    return HUFF_OK;
 }
 
-// --- Декодирование файла ---
-void decode_file(const char* encoded_filename, const char* output_filename) {
-    // 1. Читаем частоты из заголовка
-    uint32_t freq[256];
-    read_frequencies_from_huff(encoded_filename, freq);
-
-    // 2. Проверяем количество уникальных символов
-    int unique = 0;
-    uint64_t total_symbols = 0;
-
-    for (int i = 0; i < 256; i++) {
-        if (freq[i] > 0) {
-            unique++;
-            total_symbols += freq[i];
-        }
-    }
-
-    printf("\n=== Decoding Information ===\n");
-    printf("Unique symbols: %d\n", unique);
-    printf("Total symbols to decode: %lu\n", (unsigned long)total_symbols);
+// --- Кодирование файла через контекст вызывающего, без отчёта ---
+HuffError huff_compress_file(HuffContext* ctx, const char* input_filename,
+                             const char* output_filename) {
+    HuffEncodeInfo info;
+    uint64_t output_size;
+    return encode_path(ctx, input_filename, output_filename, NULL, &info, &output_size);
+}
 
-    // 3. Случай: пустой файл
-    if (unique == 0 || total_symbols == 0) {
-        FILE* out = fopen(output_filename, "wb");
-        if (out) fclose(out);
-        printf("Decoding completed (empty file)\n");
-        return;
+// --- Декодирование файла в файл через контекст; ход и итоги — в report ---
+HuffError decode_path(HuffContext* ctx, const char* encoded_filename,
+                      const char* output_filename, FILE* report) {
+    huff_stats_begin(ctx);
+    HuffTimer timer;
+    huff_timer_start(&timer, ctx->options.stats != NULL);
+
+    // 1. Читаем заголовок (любой версии)
+    HuffInput in;
+    if (!huff_input_open_io(&in, encoded_filename, ctx->options.io)) {
+        report_printf(report, "Error: cannot open %s\n", encoded_filename);
+        return HUFF_ERROR_READ;
     }
 
-    // 4. Особый случай: только один символ
-    if (unique == 1) {
-        int symbol = -1;
-        for (int i = 0; i < 256; i++) {
-            if (freq[i] > 0) {
-                symbol = i;
-                break;
-            }
-        }
-
-        FILE* out = fopen(output_filename, "wb");
-        if (!out) {
-            printf("Error: cannot create output file\n");
-            return;
-        }
-
-        for (uint64_t i = 0; i < total_symbols; i++) {
-            fputc(symbol, out);
+    HuffHeader header;
+    HuffError err = huff_read_header(&in, &header);
+    if (err != HUFF_OK) {
+        report_printf(report, "Error: invalid or unsupported header in %s\n", encoded_filename);
+        huff_input_close(&in);
+        return err;
+    }
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+
+    report_printf(report, "\n=== Decoding Information ===\n");
+    uint64_t size_hint;
+    if (header.version == HUFF_FORMAT_BLOCKED) {
+        // Блочный формат: итоги хранятся в хвосте файла
+        report_printf(report, "Format version: %d (block size %lu%s)\n", header.version,
+                      (unsigned long)header.block_size,
+                      header.file_flags & HUFF_FILE_FLAG_CHECKSUM ? ", CRC32C" : "");
+        int64_t tail_size = blocked_output_size(&in, header.block_size);
+        size_hint = tail_size > 0 ? (uint64_t)tail_size : 0;
+    } else if (header.version == HUFF_FORMAT_ADAPTIVE) {
+        // Адаптивный формат: размер — сумма кадров, у канала неизвестен
+        report_printf(report, "Format version: %d (adaptive)\n", header.version);
+        int64_t frames_size = adaptive_output_size(&in);
+        size_hint = frames_size > 0 ? (uint64_t)frames_size : 0;
+    } else {
+        report_printf(report, "Format version: %d\n", header.version);
+        report_printf(report, "Unique symbols: %d\n", header.unique);
+        report_printf(report, "Total symbols to decode: %lu\n",
+                      (unsigned long)header.total_symbols);
+        // Заголовок не проверен: код символа не короче бита, поэтому символов
+        // не больше 8 на байт входа (иначе выход начинается с порции и растёт)
+        size_hint = header.total_symbols;
+        if (!in.size_known) {
+            size_hint = 0;
+        } else if (size_hint / 8 > in.file_size - in.consumed) {
+            size_hint = 8 * (in.file_size - in.consumed);
         }
-
-        fclose(out);
-        printf("Decoding completed (single symbol file)\n");
-        return;
     }
 
-    // 5. Общий случай: строим дерево Хаффмана
-    Node** nodes = (Node**)malloc(unique * sizeof(Node*));
-    if (!nodes) {
-        printf("Error: memory allocation failed\n");
-        return;
+    // 2. Размер выхода известен: файл сразу нужного размера
+    HuffOutput out;
+    if (!huff_output_open_io(&out, output_filename, size_hint, ctx->options.io)) {
+        report_printf(report, "Error: cannot create output file\n");
+        huff_input_close(&in);
+        return HUFF_ERROR_WRITE;
     }
-
-    int idx = 0;
-    for (int i = 0; i < 256; i++) {
-        if (freq[i] > 0) {
-            nodes[idx++] = create_node((unsigned char)i, freq[i]);
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+
+    // 3. Декодируем; пустому файлу и файлу из одного символа поток не нужен,
+    //    и точек прогресса для них нет
+    int has_stream = header.version == HUFF_FORMAT_BLOCKED ||
+                     header.version == HUFF_FORMAT_ADAPTIVE ||
+                     (header.unique > 1 && header.total_symbols > 0);
+    HuffProgressFn progress = ctx->options.progress;
+    int dots = progress == print_progress_dot;
+    if (dots && !has_stream) ctx->options.progress = NULL;
+    if (dots && has_stream) fprintf(report, "Decoding progress: ");
+    uint64_t decoded = 0;
+    err = huff_decode_stream(ctx, &in, &out, &header, &decoded);
+    if (dots && has_stream) fprintf(report, "\n");
+    ctx->options.progress = progress;
+
+    uint64_t consumed = in.consumed;
+    huff_timer_start(&timer, ctx->options.stats != NULL);
+    huff_input_close(&in);
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_READ);
+    if (!huff_output_close(&out) && err == HUFF_OK) err = HUFF_ERROR_WRITE;
+    huff_timer_lap(&timer, &ctx->stats, HUFF_PHASE_WRITE);
+    huff_stats_end(ctx, consumed, decoded);
+
+    // 4. Итоги
+    if (err == HUFF_ERROR_CORRUPT) {
+        if (header.version == HUFF_FORMAT_BLOCKED || header.version == HUFF_FORMAT_ADAPTIVE) {
+            report_printf(report, "Error: corrupted %s stream (decoded %lu symbols)\n",
+                          header.version == HUFF_FORMAT_BLOCKED ? "block" : "frame",
+                          (unsigned long)decoded);
+        } else {
+            report_printf(report, "Error: expected %lu symbols, decoded %lu\n",
+                          (unsigned long)header.total_symbols, (unsigned long)decoded);
         }
+        return err;
     }
-
-    int node_count = unique;
-    Node* root = build_huffman_tree(nodes, &node_count);
-
-    // 6. Открываем файлы
-    FILE* in = fopen(encoded_filename, "rb");
-    FILE* out = fopen(output_filename, "wb");
-
-    if (!in || !out) {
-        printf("Error: cannot open files for decoding\n");
-        free(nodes);
-        return;
+    if (err != HUFF_OK) {
+        report_printf(report, "Error: cannot %s: %s\n",
+                      err == HUFF_ERROR_READ ? "read input" : "write output file",
+                      err == HUFF_ERROR_READ ? encoded_filename : output_filename);
+        return err;
     }
 
-    // 7. Пропускаем заголовок
-    uint32_t symbol_count;
-    fread(&symbol_count, sizeof(uint32_t), 1, in);
-    for (uint32_t i = 0; i < symbol_count; i++) {
-        fgetc(in); // символ
-        uint32_t dummy;
-        fread(&dummy, sizeof(uint32_t), 1, in); // частота
+    if (!has_stream) {
+        report_printf(report, "Decoding completed (%s)\n",
+                      header.unique == 1 && header.total_symbols > 0 ? "single symbol file"
+                                                                      : "empty file");
+        return HUFF_OK;
     }
+    report_printf(report, "Decoding completed successfully!\n");
+    report_printf(report, "Decoded symbols: %lu\n", (unsigned long)decoded);
+    if (header.file_flags & HUFF_FILE_FLAG_CHECKSUM) {
+        report_printf(report, "Checksum: CRC32C of every block and of the file verified\n");
+    }
+    return HUFF_OK;
+}
 
-    // 8. Декодируем данные
-    Node* current = root;
-    uint64_t decoded = 0;
-    int byte;
-    int bytes_read = 0;
-
-    printf("Decoding progress: ");
+// --- Декодирование файла ---
+HuffError decode_file(const char* encoded_filename, const char* output_filename) {
+    return decode_file_ex(encoded_filename, output_filename, NULL);
+}
 
-    while (decoded < total_symbols && (byte = fgetc(in)) != EOF) {
-        bytes_read++;
+// --- Декодирование файла с параметрами ---
+// Формат берётся из файла, из параметров важны число потоков, статистика
+// и прогресс (по умолчанию — точки в отчёт).
+HuffError decode_file_ex(const char* encoded_filename, const char* output_filename,
+                         const HuffOptions* options) {
+    FILE* report = report_stream(output_filename);
+    HuffOptions used;
+    if (options) used = *options;
+    else huff_default_options(&used);
+    if (!used.progress) {
+        used.progress = print_progress_dot;
+        used.progress_user = report;
+    }
+    HuffContext* ctx = huff_context_create(&used);
+    if (!ctx) {
+        fprintf(report, "Error: out of memory\n");
+        return HUFF_ERROR_NO_MEMORY;
+    }
 
-        // Показываем прогресс каждые 10KB
-        if (bytes_read % 10240 == 0) {
-            printf(".");
-            fflush(stdout);
-        }
+    HuffError err = decode_path(ctx, encoded_filename, output_filename, report);
+    huff_context_free(ctx);
+    return err;
+}
 
-        for (int i = 0; i < 8 && decoded < total_symbols; i++) {
-            int bit = (byte >> (7 - i)) & 1;
-            current = bit ? current->right : current->left;
+// --- Декодирование файла через контекст вызывающего, без отчёта ---
+HuffError huff_decompress_file(HuffContext* ctx, const char* encoded_filename,
+                               const char* output_filename) {
+    return decode_path(ctx, encoded_filename, output_filename, NULL);
+}
 
-            if (!current->left && !current->right) {
-                fputc(current->symbol, out);
-                decoded++;
-                current = root;
-            }
-        }
+// --- Кусок исходных данных файла формата 3, без отчёта ---
+// Файл отображается без подгрузки страниц: читаются только хвост и блоки
+// куска. Кусок пишется частями по блоку, поэтому память не растёт с len.
+HuffError huff_decompress_file_range(HuffContext* ctx, const char* encoded_filename,
+                                     const char* output_filename, uint64_t offset,
+                                     uint64_t len) {
+    HuffInput in;
+    HuffHeader header;
+    if (!huff_input_open_random(&in, encoded_filename)) return HUFF_ERROR_READ;
+    HuffError err = huff_read_header(&in, &header);
+    if (err == HUFF_OK && header.version != HUFF_FORMAT_BLOCKED) err = HUFF_ERROR_CORRUPT;
+    if (err == HUFF_OK && !in.mapped) err = HUFF_ERROR_READ;
+    if (err != HUFF_OK) {
+        huff_input_close(&in);
+        return err;
     }
 
-    printf("\n");
-
-    // 9. Проверяем корректность декодирования
-    if (decoded != total_symbols) {
-        printf("Warning: expected %lu symbols, decoded %lu\n",
-               (unsigned long)total_symbols, (unsigned long)decoded);
+    int64_t tail_size = blocked_output_size(&in, header.block_size);
+    if (tail_size < 0) {
+        huff_input_close(&in);
+        return (HuffError)tail_size;
+    }
+    uint64_t total = (uint64_t)tail_size;
+    uint64_t left = offset < total ? total - offset : 0;
+    if (left > len) left = len;
+    HuffOutput out;
+    if (!huff_output_open(&out, output_filename, left)) {
+        huff_input_close(&in);
+        return HUFF_ERROR_WRITE;
     }
 
-    // 10. Закрываем файлы и освобождаем память
-    fclose(in);
-    fclose(out);
-    free(nodes);
+    while (err == HUFF_OK && left > 0) {
+        size_t n = left < header.block_size ? (size_t)left : (size_t)header.block_size;
+        uint8_t* dst = huff_output_reserve(&out, n);
+        if (!dst) {
+            err = HUFF_ERROR_WRITE;
+            break;
+        }
+        int64_t got = decode_blocked_range(ctx, &in, &header, offset, dst, n);
+        if (got != (int64_t)n) {
+            err = got < 0 ? (HuffError)got : HUFF_ERROR_CORRUPT;
+            break;
+        }
+        if (!huff_output_commit(&out, n)) err = HUFF_ERROR_WRITE;
+        offset += n;
+        left -= n;
+    }
 
-    printf("Decoding completed successfully!\n");
-    printf("Decoded symbols: %lu\n", (unsigned long)decoded);
-}
\ No newline at end of file
+    huff_input_close(&in);
+    if (!huff_output_close(&out) && err == HUFF_OK) err = HUFF_ERROR_WRITE;
+    return err;
+}
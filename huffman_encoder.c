@@ -0,0 +1,136 @@
+#include "huffman_internal.h"
+
+// --- Запись 8 байт, старший байт первым ---
+HUFF_INLINE void store_be64(uint8_t* p, uint64_t v) {
+    p[0] = (uint8_t)(v >> 56);
+    p[1] = (uint8_t)(v >> 48);
+    p[2] = (uint8_t)(v >> 40);
+    p[3] = (uint8_t)(v >> 32);
+    p[4] = (uint8_t)(v >> 24);
+    p[5] = (uint8_t)(v >> 16);
+    p[6] = (uint8_t)(v >> 8);
+    p[7] = (uint8_t)v;
+}
+
+// --- Инициализация записи битов ---
+void bit_writer_init(BitWriter* bw, uint8_t* out) {
+    bw->acc = 0;
+    bw->count = 0;
+    bw->p = out;
+}
+
+// --- Кодирование n символов ---
+// Каждый код целиком дописывается в аккумулятор; если он не влезает,
+// старшая часть дополняет acc до 64 бит, acc сбрасывается в буфер,
+// а остаток кода начинает новый acc.
+HUFF_INLINE void encode_symbols(const HuffCode* codes, const uint8_t* in, size_t n,
+                                BitWriter* bw) {
+    uint64_t acc = bw->acc;
+    int count = bw->count;
+    uint8_t* p = bw->p;
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t word = codes[in[i]].word;
+        int len = codes[in[i]].len;
+        int room = 64 - count;
+
+        if (len < room) {
+            acc |= word << (room - len);
+            count += len;
+        } else {
+            acc |= word >> (len - room);
+            store_be64(p, acc);
+            p += 8;
+            count = len - room;
+            acc = count ? word << (64 - count) : 0;
+        }
+    }
+
+    bw->acc = acc;
+    bw->count = count;
+    bw->p = p;
+}
+
+// --- Кодирование n символов кодом, выбранным по предыдущему символу ---
+// codes[c] — коды после байта c; перед in[0] считается байт prev.
+HUFF_INLINE void encode_symbols_order1(const HuffCode* const* codes, const uint8_t* in,
+                                       size_t n, int prev, BitWriter* bw) {
+    uint64_t acc = bw->acc;
+    int count = bw->count;
+    uint8_t* p = bw->p;
+
+    for (size_t i = 0; i < n; i++) {
+        const HuffCode* code = &codes[prev][in[i]];
+        uint64_t word = code->word;
+        int len = code->len;
+        int room = 64 - count;
+        prev = in[i];
+
+        if (len < room) {
+            acc |= word << (room - len);
+            count += len;
+        } else {
+            acc |= word >> (len - room);
+            store_be64(p, acc);
+            p += 8;
+            count = len - room;
+            acc = count ? word << (64 - count) : 0;
+        }
+    }
+
+    bw->acc = acc;
+    bw->count = count;
+    bw->p = p;
+}
+
+// --- Варианты под процессор ---
+// Код дописывается сдвигами на переменную длину; с BMI2 это shlx/shrx
+// вместо сдвигов через cl.
+#ifdef HUFF_HAVE_X86_KERNELS
+HUFF_TARGET("bmi,bmi2")
+static void encode_symbols_bmi2(const HuffCode* codes, const uint8_t* in, size_t n,
+                                BitWriter* bw) {
+    encode_symbols(codes, in, n, bw);
+}
+
+HUFF_TARGET("bmi,bmi2")
+static void encode_symbols_order1_bmi2(const HuffCode* const* codes, const uint8_t* in,
+                                       size_t n, int prev, BitWriter* bw) {
+    encode_symbols_order1(codes, in, n, prev, bw);
+}
+#endif
+
+void huff_encode_symbols(const HuffCode* codes, const uint8_t* in, size_t n,
+                         BitWriter* bw) {
+#ifdef HUFF_HAVE_X86_KERNELS
+    if (huff_cpu_level() >= HUFF_CPU_BMI2) {
+        encode_symbols_bmi2(codes, in, n, bw);
+        return;
+    }
+#endif
+    encode_symbols(codes, in, n, bw);
+}
+
+void huff_encode_symbols_order1(const HuffCode* const* codes, const uint8_t* in, size_t n,
+                                int prev, BitWriter* bw) {
+#ifdef HUFF_HAVE_X86_KERNELS
+    if (huff_cpu_level() >= HUFF_CPU_BMI2) {
+        encode_symbols_order1_bmi2(codes, in, n, prev, bw);
+        return;
+    }
+#endif
+    encode_symbols_order1(codes, in, n, prev, bw);
+}
+
+// --- Сброс остатка: неполный последний байт дополняется нулями ---
+// Возвращает, сколько байт дописано.
+size_t bit_writer_finish(BitWriter* bw) {
+    size_t bytes = (size_t)(bw->count + 7) / 8;
+    for (size_t i = 0; i < bytes; i++) {
+        *bw->p++ = (uint8_t)(bw->acc >> (56 - 8 * i));
+    }
+
+    bw->acc = 0;
+    bw->count = 0;
+    return bytes;
+}
@@ -0,0 +1,411 @@
+#include "huffman_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Формат версии 2 (канонические коды):
+//   "HUF" + байт версии (2)
+//   байт флагов (HUFF_FLAG_BYTE_LENGTHS — длины по байту, иначе по полбайта;
+//                HUFF_FLAG_SYMBOL_LIST — список символов вместо битовой карты)
+//   число символов исходного файла (varint, 7 бит на байт, младшие первыми)
+//   битовая карта присутствующих символов (32 байта) либо, если так короче,
+//   их список: (количество - 1) и сами символы по возрастанию
+//   длины кодов присутствующих символов по возрастанию символа
+//   (при упаковке по полбайта первый символ — в старшей половине)
+//   битовый поток канонических кодов
+// У пустого файла заголовок заканчивается на числе символов.
+//
+// Формат версии 3 (блоки):
+//   "HUF" + байт версии (3), байт флагов файла (HUFF_FILE_FLAG_*)
+//   размер блока исходных данных (varint)
+//   с HUFF_FILE_FLAG_SEEK — шаг отметок в байтах исходных данных (varint)
+//   блоки, каждый независим от остальных:
+//     размер исходных данных блока (varint; 0 — блоков больше нет)
+//     байт флагов и таблица длин, как в формате 2
+//     длина битового потока в битах (varint)
+//     с HUFF_FILE_FLAG_CHECKSUM — CRC32C исходных данных блока (uint32_t)
+//     битовый поток блока, дополненный нулями до байта
+//   С флагом HUFF_FLAG_FOUR_STREAMS символы блока делятся на 4 части по
+//   ceil(n / 4) (последняя — остаток), и каждая кодируется своим потоком:
+//     длины четырёх потоков в битах (4 varint) — таблица переходов
+//     четыре потока подряд, каждый дополнен нулями до байта
+//   Блок, который код Хаффмана почти не сжимает, и блок из длинных серий
+//   одинаковых байтов пишутся без таблиц (флаг — единственный в байте):
+//     HUFF_FLAG_STORED: после CRC32C — исходные данные блока как есть
+//     HUFF_FLAG_RUNS: размер списка серий в байтах (varint), CRC32C, список:
+//     для каждой серии байт и длина - 1 (varint)
+//   С флагом HUFF_FLAG_CONTEXTS (флаги таблицы длин тогда не ставятся) код
+//   символа выбирается по предыдущему байту блока или потока (перед первым
+//   символом — 0), и вместо одной таблицы длин идут:
+//     число кластеров контекстов - 1 (байт, кластеров от 2 до 16)
+//     кластер каждого предыдущего байта, по полбайта (128 байт, байт 0 —
+//     в старшей половине первого)
+//     для каждого кластера байт флагов и таблица длин, как в формате 2
+//   индекс: смещение начала каждого блока от начала файла (uint64_t)
+//   с HUFF_FILE_FLAG_SEEK — отметки (uint64_t): для каждого блока по порядку
+//     и каждого смещения в нём, кратного шагу, кроме 0, — позиция в битах
+//     от начала потоков блока, с которой декодируется символ с этим
+//     смещением (биты 0-55), и контекст этого символа (биты 56-63: байт
+//     перед ним, 0 в начале потока). Число отметок следует из всего
+//     символов, размера блока и шага, поэтому нигде не записано.
+//   с HUFF_FILE_FLAG_CHECKSUM — CRC32C всех исходных данных (uint32_t)
+//   хвост: всего символов (uint64_t), число блоков (uint32_t), "HUFI"
+// Многобайтовые числа индекса и хвоста — little-endian.
+//
+// Старый формат начинается с uint32_t symbol_count <= 256, поэтому по первым
+// четырём байтам форматы не путаются. Числа в нём — в порядке байт машины,
+// как их писал fwrite (little-endian — только в форматах 3 и 4). Частота
+// в нём 32-битная: вход, где какой-то байт встречается больше UINT32_MAX
+// раз, в старый формат не записывается (HUFF_ERROR_TOO_LARGE). Дерево
+// строится по частотам после huff_scale_frequencies. В остальных форматах
+// размеры — varint и uint64_t.
+
+// --- Локальные функции ---
+static int get_legacy_header(const uint8_t* buf, size_t size, size_t* pos,
+                             uint32_t symbol_count, HuffHeader* header);
+static int get_canonical_header(const uint8_t* buf, size_t size, size_t* pos,
+                                HuffHeader* header);
+static int get_blocked_header(const uint8_t* buf, size_t size, size_t* pos,
+                              HuffHeader* header);
+
+// --- Запись числа varint (7 бит на байт, младшие первыми) ---
+size_t put_varint(uint8_t* buf, uint64_t value) {
+    size_t pos = 0;
+    do {
+        uint8_t b = value & 0x7F;
+        value >>= 7;
+        buf[pos++] = value ? (b | 0x80) : b;
+    } while (value);
+    return pos;
+}
+
+// --- Чтение числа varint из памяти ---
+int get_varint(const uint8_t* buf, size_t size, size_t* pos, uint64_t* value) {
+    uint64_t v = 0;
+    for (int shift = 0; shift <= 63; shift += 7) {
+        if (*pos >= size) return 0;
+        uint8_t b = buf[(*pos)++];
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// --- Флаги упаковки таблицы длин ---
+int code_lengths_flags(const uint8_t* lens) {
+    int max_len = 0;
+    int unique = 0;
+    for (int i = 0; i < 256; i++) {
+        if (lens[i] > max_len) max_len = lens[i];
+        if (lens[i]) unique++;
+    }
+
+    int flags = 0;
+    if (max_len > 15) flags |= HUFF_FLAG_BYTE_LENGTHS;
+    if (unique > 0 && 1 + unique < 32) flags |= HUFF_FLAG_SYMBOL_LIST;
+    return flags;
+}
+
+// --- Запись таблицы длин: символы (карта или список) и длины ---
+// Нужно не больше HUFF_MAX_LENGTHS_SIZE байт. Хотя бы один символ обязателен.
+size_t put_code_lengths(uint8_t* buf, const uint8_t* lens, int flags) {
+    size_t pos = 0;
+
+    int unique = 0;
+    for (int i = 0; i < 256; i++) {
+        if (lens[i]) unique++;
+    }
+
+    if (flags & HUFF_FLAG_SYMBOL_LIST) {
+        buf[pos++] = (uint8_t)(unique - 1);
+        for (int i = 0; i < 256; i++) {
+            if (lens[i]) buf[pos++] = (uint8_t)i;
+        }
+    } else {
+        uint8_t* bitmap = buf + pos;
+        memset(bitmap, 0, 32);
+        for (int i = 0; i < 256; i++) {
+            if (lens[i]) bitmap[i >> 3] |= (uint8_t)(1u << (i & 7));
+        }
+        pos += 32;
+    }
+
+    int half = 0;
+    for (int i = 0; i < 256; i++) {
+        if (!lens[i]) continue;
+        if (flags & HUFF_FLAG_BYTE_LENGTHS) {
+            buf[pos++] = lens[i];
+        } else if (!half) {
+            buf[pos] = (uint8_t)(lens[i] << 4);
+            half = 1;
+        } else {
+            buf[pos++] |= lens[i];
+            half = 0;
+        }
+    }
+    if (half) pos++;
+
+    return pos;
+}
+
+// --- Чтение таблицы длин из памяти ---
+// Возвращает число символов или -1, если таблица битая.
+int get_code_lengths(const uint8_t* buf, size_t size, size_t* pos, int flags,
+                     uint8_t* lens) {
+    uint8_t bitmap[32];
+    memset(lens, 0, 256);
+
+    if (flags & HUFF_FLAG_SYMBOL_LIST) {
+        if (*pos >= size) return -1;
+        int count = buf[(*pos)++] + 1;
+        if (size - *pos < (size_t)count) return -1;
+        memset(bitmap, 0, sizeof(bitmap));
+        for (int i = 0; i < count; i++) {
+            uint8_t c = buf[(*pos)++];
+            bitmap[c >> 3] |= (uint8_t)(1u << (c & 7));
+        }
+    } else {
+        if (size - *pos < 32) return -1;
+        memcpy(bitmap, buf + *pos, 32);
+        *pos += 32;
+    }
+
+    int unique = 0;
+    int half = 0;
+    for (int i = 0; i < 256; i++) {
+        if (!(bitmap[i >> 3] & (1u << (i & 7)))) continue;
+        int len;
+        if (flags & HUFF_FLAG_BYTE_LENGTHS) {
+            if (*pos >= size) return -1;
+            len = buf[(*pos)++];
+        } else if (!half) {
+            if (*pos >= size) return -1;
+            len = buf[*pos] >> 4;
+            half = 1;
+        } else {
+            len = buf[(*pos)++] & 0x0F;
+            half = 0;
+        }
+        if (len == 0 || len > HUFF_MAX_DECODE_LEN) return -1;
+
+        lens[i] = (uint8_t)len;
+        unique++;
+    }
+    if (half) (*pos)++;
+
+    return unique;
+}
+
+// --- Запись таблиц контекстов: число кластеров, карта, длины кластеров ---
+// Нужно не больше HUFF_MAX_CONTEXT_TABLES_SIZE байт.
+size_t put_context_tables(uint8_t* buf, int clusters, const uint8_t* map,
+                          const uint8_t (*lens)[256]) {
+    size_t pos = 0;
+
+    buf[pos++] = (uint8_t)(clusters - 1);
+    for (int c = 0; c < 256; c += 2) {
+        buf[pos++] = (uint8_t)(map[c] << 4 | map[c + 1]);
+    }
+    for (int k = 0; k < clusters; k++) {
+        int flags = code_lengths_flags(lens[k]);
+        buf[pos++] = (uint8_t)flags;
+        pos += put_code_lengths(buf + pos, lens[k], flags);
+    }
+
+    return pos;
+}
+
+// --- Чтение таблиц контекстов ---
+// Возвращает число кластеров или -1, если таблицы битые.
+int get_context_tables(const uint8_t* buf, size_t size, size_t* pos, uint8_t* map,
+                       uint8_t (*lens)[256]) {
+    if (size - *pos < 1 + 128) return -1;
+    int clusters = buf[(*pos)++] + 1;
+    if (clusters < 2 || clusters > HUFF_MAX_CLUSTERS) return -1;
+    for (int c = 0; c < 256; c += 2) {
+        uint8_t b = buf[(*pos)++];
+        map[c] = b >> 4;
+        map[c + 1] = b & 0x0F;
+        if (map[c] >= clusters || map[c + 1] >= clusters) return -1;
+    }
+
+    for (int k = 0; k < clusters; k++) {
+        if (*pos >= size) return -1;
+        int flags = buf[(*pos)++];
+        if (flags & ~(HUFF_FLAG_BYTE_LENGTHS | HUFF_FLAG_SYMBOL_LIST)) return -1;
+        if (get_code_lengths(buf, size, pos, flags, lens[k]) < 2) return -1;
+    }
+    return clusters;
+}
+
+// --- Запись заголовка старого формата (частоты) ---
+// Частоты пишутся в порядке байт машины, как и раньше.
+size_t put_legacy_header(uint8_t* buf, const uint32_t* freq) {
+    uint32_t symbol_count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (freq[i]) symbol_count++;
+    }
+    memcpy(buf, &symbol_count, sizeof(uint32_t));
+    size_t pos = sizeof(uint32_t);
+
+    for (int i = 0; i < 256; i++) {
+        if (freq[i]) {
+            buf[pos++] = (uint8_t)i;
+            memcpy(buf + pos, &freq[i], sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+        }
+    }
+
+    return pos;
+}
+
+// --- Запись заголовка формата 2 (длины кодов) ---
+size_t put_canonical_header(uint8_t* buf, const uint8_t* lens, uint64_t total_symbols) {
+    size_t pos = 0;
+
+    buf[pos++] = 'H';
+    buf[pos++] = 'U';
+    buf[pos++] = 'F';
+    buf[pos++] = HUFF_FORMAT_CANONICAL;
+
+    int flags = code_lengths_flags(lens);
+    buf[pos++] = (uint8_t)flags;
+    pos += put_varint(buf + pos, total_symbols);
+    if (total_symbols > 0) pos += put_code_lengths(buf + pos, lens, flags);
+
+    return pos;
+}
+
+// --- Запись заголовка формата 3 (блоки) ---
+size_t put_blocked_header(uint8_t* buf, uint64_t block_size, int file_flags,
+                          uint64_t seek_interval) {
+    size_t pos = 0;
+
+    buf[pos++] = 'H';
+    buf[pos++] = 'U';
+    buf[pos++] = 'F';
+    buf[pos++] = HUFF_FORMAT_BLOCKED;
+    buf[pos++] = (uint8_t)file_flags;
+    pos += put_varint(buf + pos, block_size);
+    if (file_flags & HUFF_FILE_FLAG_SEEK) pos += put_varint(buf + pos, seek_interval);
+
+    return pos;
+}
+
+// --- Запись заголовка формата 4 (адаптивный): только версия и флаги ---
+size_t put_adaptive_header(uint8_t* buf) {
+    size_t pos = 0;
+
+    buf[pos++] = 'H';
+    buf[pos++] = 'U';
+    buf[pos++] = 'F';
+    buf[pos++] = HUFF_FORMAT_ADAPTIVE;
+    buf[pos++] = 0;
+
+    return pos;
+}
+
+// --- Старый формат: частоты -> дерево -> коды ---
+int get_legacy_header(const uint8_t* buf, size_t size, size_t* pos,
+                      uint32_t symbol_count, HuffHeader* header) {
+    if (symbol_count > 256 || size - *pos < symbol_count * 5) return 0;
+
+    for (uint32_t i = 0; i < symbol_count; i++) {
+        uint8_t c = buf[(*pos)++];
+        memcpy(&header->freq[c], buf + *pos, sizeof(uint32_t));
+        *pos += sizeof(uint32_t);
+    }
+
+    int unique = 0;
+    for (int i = 0; i < 256; i++) {
+        if (header->freq[i] > 0) {
+            unique++;
+            header->total_symbols += header->freq[i];
+        }
+    }
+    header->unique = unique;
+    if (unique < 2) {
+        for (int i = 0; i < 256; i++) header->lens[i] = header->freq[i] ? 1 : 0;
+        return 1;
+    }
+
+    // Коды восстанавливаются только повторением построения дерева кодера,
+    // в том числе уменьшения частот, если их сумма больше 32 бит
+    uint64_t wide[256];
+    uint32_t model[256];
+    for (int i = 0; i < 256; i++) wide[i] = header->freq[i];
+    huff_scale_frequencies(wide, model);
+    HuffTree tree;
+    header->max_len = collect_code_words(huff_build_tree(&tree, model),
+                                         header->words, header->lens);
+    return header->max_len <= HUFF_MAX_DECODE_LEN;
+}
+
+// --- Формат 2: длины -> канонические коды ---
+int get_canonical_header(const uint8_t* buf, size_t size, size_t* pos,
+                         HuffHeader* header) {
+    if (*pos >= size) return 0;
+    int flags = buf[(*pos)++];
+    // Остальные флаги относятся к блокам формата 3
+    if (flags & ~(HUFF_FLAG_BYTE_LENGTHS | HUFF_FLAG_SYMBOL_LIST)) return 0;
+    if (!get_varint(buf, size, pos, &header->total_symbols)) return 0;
+    if (header->total_symbols == 0) return 1;
+
+    header->unique = get_code_lengths(buf, size, pos, flags, header->lens);
+    if (header->unique <= 0) return 0;
+
+    for (int i = 0; i < 256; i++) {
+        if (header->lens[i] > header->max_len) header->max_len = header->lens[i];
+    }
+
+    if (header->unique < 2) return 1;
+    return huff_canonical_codes(header->lens, header->words);
+}
+
+// --- Формат 3: флаги и размер блока, остальное — в блоках и хвосте ---
+int get_blocked_header(const uint8_t* buf, size_t size, size_t* pos,
+                       HuffHeader* header) {
+    if (*pos >= size) return 0;
+    header->file_flags = buf[(*pos)++];
+    if (header->file_flags & ~(HUFF_FILE_FLAG_CHECKSUM | HUFF_FILE_FLAG_SEEK)) return 0;
+    if (!get_varint(buf, size, pos, &header->block_size)) return 0;
+    if ((header->file_flags & HUFF_FILE_FLAG_SEEK) &&
+        (!get_varint(buf, size, pos, &header->seek_interval) || header->seek_interval == 0)) {
+        return 0;
+    }
+    return header->block_size > 0;
+}
+
+// --- Чтение заголовка любого поддерживаемого формата ---
+// buf — начало файла (хватает HUFF_MAX_HEADER_SIZE байт или всего файла).
+// После успешного чтения *pos указывает на начало битового потока.
+int get_huff_header(const uint8_t* buf, size_t size, size_t* pos, HuffHeader* header) {
+    memset(header, 0, sizeof(*header));
+    *pos = 0;
+    if (size < 4) return 0;
+    const uint8_t* head = buf;
+    *pos = 4;
+
+    if (head[0] == 'H' && head[1] == 'U' && head[2] == 'F') {
+        header->version = head[3];
+        if (header->version == HUFF_FORMAT_CANONICAL) {
+            return get_canonical_header(buf, size, pos, header);
+        }
+        if (header->version == HUFF_FORMAT_BLOCKED) {
+            return get_blocked_header(buf, size, pos, header);
+        }
+        if (header->version == HUFF_FORMAT_ADAPTIVE) {
+            return *pos < size && buf[(*pos)++] == 0;
+        }
+        return 0;
+    }
+
+    // Старый формат целиком в порядке байт машины, как его пишет put_legacy_header
+    header->version = HUFF_FORMAT_LEGACY;
+    uint32_t symbol_count;
+    memcpy(&symbol_count, head, sizeof(uint32_t));
+    return get_legacy_header(buf, size, pos, symbol_count, header);
+}
@@ -0,0 +1,401 @@
+#ifndef HUFFMAN_INTERNAL_H
+#define HUFFMAN_INTERNAL_H
+
+// Внутренние объявления, общие для модулей библиотеки (не для пользователей)
+
+#include "huffman.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Ширина первичной таблицы декодирования (бит); если все коды не длиннее
+// HUFF_TABLE_MAX_ROOT_BITS, таблица одноуровневая шириной в самый длинный код
+#define HUFF_TABLE_BITS 11
+#define HUFF_TABLE_MAX_ROOT_BITS 12
+// Максимальная ширина вторичной таблицы (бит)
+#define HUFF_SUBTABLE_BITS 8
+// Максимальная длина кода, которую умеет читать табличный декодер
+#define HUFF_MAX_DECODE_LEN 56
+
+// --- Варианты ядер под процессор (huffman_cpu.c) ---
+// Каждый уровень включает предыдущие. Уровня AVX2 нет: ни одному ядру
+// векторные регистры не дали выигрыша больше шума замеров.
+// Тела ядер — HUFF_INLINE-функции: они встраиваются в обёртки с
+// HUFF_TARGET и компилируются под их набор инструкций.
+typedef enum {
+    HUFF_CPU_GENERIC,
+    HUFF_CPU_BMI2,
+    HUFF_CPU_LEVELS
+} HuffCpuLevel;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HUFF_HAVE_X86_KERNELS 1
+#define HUFF_TARGET(isa) __attribute__((target(isa)))
+#endif
+#if defined(__GNUC__)
+#define HUFF_INLINE static inline __attribute__((always_inline))
+#else
+#define HUFF_INLINE static inline
+#endif
+
+HuffCpuLevel huff_cpu_detect(void);
+HuffCpuLevel huff_cpu_level(void);
+HuffCpuLevel huff_cpu_force(HuffCpuLevel level);
+const char* huff_cpu_name(HuffCpuLevel level);
+
+// --- Дерево Хаффмана (huffman_core.c) ---
+// Узлы лежат в массиве: 256 листьев по символам, за ними не больше 255
+// внутренних узлов. Дерево не требует освобождения.
+typedef struct {
+    Node nodes[2 * 256 - 1];
+} HuffTree;
+
+const Node* huff_build_tree(HuffTree* tree, const uint32_t* freq);
+int collect_code_words(const Node* root, uint64_t* words, uint8_t* lens);
+
+// --- Канонические коды (huffman_core.c) ---
+int huff_code_lengths(const uint32_t* freq, int max_len, uint8_t* lens);
+int huff_canonical_codes(const uint8_t* lens, uint64_t* words);
+
+// --- Заголовки .huff (huffman_format.c) ---
+#define HUFF_FLAG_BYTE_LENGTHS 0x01     // Длины кодов по байту, а не по полбайта
+#define HUFF_FLAG_SYMBOL_LIST  0x02     // Список символов вместо битовой карты
+#define HUFF_FLAG_FOUR_STREAMS 0x04     // Блок разбит на 4 потока (формат 3)
+#define HUFF_FLAG_CONTEXTS     0x08     // Таблицы по предыдущему байту (формат 3)
+#define HUFF_FLAG_STORED       0x10     // Блок лежит как есть (формат 3)
+#define HUFF_FLAG_RUNS         0x20     // Блок записан сериями байтов (формат 3)
+
+// Флаги файла формата 3 (байт после версии)
+#define HUFF_FILE_FLAG_CHECKSUM 0x01    // CRC32C у каждого блока и у всего файла
+#define HUFF_FILE_FLAG_SEEK     0x02    // Отметки для чтения с середины блока
+
+// Блоки короче этого кодируются одним потоком: таблица переходов не окупится
+#define HUFF_FOUR_STREAMS_MIN_BLOCK 1024
+
+// Наибольший размер таблицы длин (карта 32 байта + 256 длин)
+#define HUFF_MAX_LENGTHS_SIZE (1 + 256 + 256)
+// Кластеров контекстов в блоке и наибольший размер их таблиц
+#define HUFF_MAX_CLUSTERS 16
+#define HUFF_MAX_CONTEXT_TABLES_SIZE (1 + 128 + HUFF_MAX_CLUSTERS * (1 + HUFF_MAX_LENGTHS_SIZE))
+// Наибольший размер заголовка файла (старый формат: 4 + 256 * 5 байт)
+#define HUFF_MAX_HEADER_SIZE (4 + 256 * 5)
+
+typedef struct {
+    int version;                // HuffFormat файла
+    uint64_t total_symbols;     // Сколько символов в исходном файле (не формат 3)
+    uint64_t block_size;        // Размер блока (только формат 3)
+    int file_flags;             // HUFF_FILE_FLAG_* (только формат 3)
+    uint64_t seek_interval;     // Шаг отметок (формат 3 с HUFF_FILE_FLAG_SEEK)
+    int unique;                 // Сколько разных символов
+    int max_len;                // Длина самого длинного кода
+    uint32_t freq[256];         // Частоты (только старый формат)
+    uint8_t lens[256];          // Длины кодов, 0 — символа нет
+    uint64_t words[256];        // Коды (при unique >= 2)
+} HuffHeader;
+
+size_t put_legacy_header(uint8_t* buf, const uint32_t* freq);
+size_t put_canonical_header(uint8_t* buf, const uint8_t* lens, uint64_t total_symbols);
+size_t put_blocked_header(uint8_t* buf, uint64_t block_size, int file_flags,
+                          uint64_t seek_interval);
+size_t put_adaptive_header(uint8_t* buf);
+int get_huff_header(const uint8_t* buf, size_t size, size_t* pos, HuffHeader* header);
+
+size_t put_varint(uint8_t* buf, uint64_t value);
+int get_varint(const uint8_t* buf, size_t size, size_t* pos, uint64_t* value);
+int code_lengths_flags(const uint8_t* lens);
+size_t put_code_lengths(uint8_t* buf, const uint8_t* lens, int flags);
+int get_code_lengths(const uint8_t* buf, size_t size, size_t* pos, int flags,
+                     uint8_t* lens);
+size_t put_context_tables(uint8_t* buf, int clusters, const uint8_t* map,
+                          const uint8_t (*lens)[256]);
+int get_context_tables(const uint8_t* buf, size_t size, size_t* pos, uint8_t* map,
+                       uint8_t (*lens)[256]);
+
+// --- Ввод-вывод файлов (huffman_io.c) ---
+// Обычные файлы отображаются в память, остальные читаются и пишутся
+// через буфер. Чтение: peek даёт окно в непрочитанные данные, skip снимает
+// прочитанное. Запись: reserve даёт место прямо в файле (или в буфере),
+// commit подтверждает записанное. С конвейером (pipe) буфер — кусок из
+// кольца, которое наполняет или опустошает отдельный поток.
+typedef struct HuffPipe HuffPipe;
+
+typedef struct {
+    int fd;
+    const uint8_t* data;    // Отображение файла или buffer
+    size_t pos;             // Первый непрочитанный байт в data
+    size_t size;            // Сколько байт в data
+    uint8_t* buffer;        // Буфер чтения (без отображения)
+    size_t cap;
+    uint64_t consumed;      // Сколько байт снято с начала файла
+    uint64_t file_size;     // Размер файла, если size_known
+    int size_known;
+    int mapped;             // data целиком и живёт до закрытия
+    int memory;             // Буфер вызывающего: не отображение и не файл
+    int eof;
+    int error;
+    HuffPipe* pipe;         // Поток чтения (HUFF_IO_THREADS, HUFF_IO_URING)
+} HuffInput;
+
+typedef struct {
+    int fd;
+    uint8_t* data;          // Отображение файла или буфер записи
+    size_t pos;             // Сколько байт записано в data
+    size_t cap;
+    uint64_t flushed;       // Сколько байт уже ушло в файл из буфера
+    int mapped;
+    int memory;             // Буфер вызывающего фиксированного размера
+    int error;              // 1 или HuffError, если причина известна
+    HuffPipe* pipe;         // Поток записи (HUFF_IO_THREADS, HUFF_IO_URING)
+    uint8_t* spill;         // Запас за концом буфера вызывающего (до commit)
+    size_t spill_cap;
+    int spilled;            // Последний reserve отдал spill
+} HuffOutput;
+
+int huff_input_open(HuffInput* in, const char* filename);
+int huff_input_open_io(HuffInput* in, const char* filename, HuffIoMode mode);
+int huff_input_open_random(HuffInput* in, const char* filename);
+void huff_input_memory(HuffInput* in, const void* data, size_t size);
+size_t huff_input_peek(HuffInput* in, size_t want, const uint8_t** p);
+void huff_input_skip(HuffInput* in, size_t n);
+void huff_input_close(HuffInput* in);
+
+int huff_output_open(HuffOutput* out, const char* filename, uint64_t size_hint);
+int huff_output_open_io(HuffOutput* out, const char* filename, uint64_t size_hint,
+                        HuffIoMode mode);
+void huff_output_memory(HuffOutput* out, void* buf, size_t cap);
+uint8_t* huff_output_reserve(HuffOutput* out, size_t n);
+int huff_output_commit(HuffOutput* out, size_t n);
+int huff_output_write(HuffOutput* out, const void* buf, size_t n);
+int huff_output_flush(HuffOutput* out);
+uint64_t huff_output_size(const HuffOutput* out);
+HuffError huff_output_error(const HuffOutput* out);
+int huff_output_close(HuffOutput* out);
+
+// --- Конвейерный ввод-вывод (huffman_aio.c) ---
+// Поток чтения заранее читает вход кусками по HUFF_PIPE_CHUNK в кольцо из
+// HUFF_PIPE_SLOTS буферов, поток записи пишет готовые куски выхода, а
+// кодер тем временем работает с соседними буферами. uring — запросы на все
+// свободные буферы уходят в io_uring разом; если ядро его не дало, поток
+// читает pread и пишет pwrite (каналы — read/write).
+#define HUFF_PIPE_SLOTS 4
+#define HUFF_PIPE_CHUNK (4 * 1024 * 1024)
+
+int huff_pipe_input_open(HuffInput* in, const char* filename, int uring);
+size_t huff_pipe_peek(HuffInput* in, size_t want, const uint8_t** p);
+void huff_pipe_input_close(HuffInput* in);
+int huff_pipe_output_open(HuffOutput* out, const char* filename, int uring);
+uint8_t* huff_pipe_reserve(HuffOutput* out, size_t n);
+int huff_pipe_output_flush(HuffOutput* out);
+int huff_pipe_output_close(HuffOutput* out);
+int huff_pipe_uring(const HuffPipe* pipe);   // Работает ли через io_uring
+
+// --- Пул потоков (huffman_pool.c) ---
+// Задачи выполняются в порядке постановки; при threads <= 1 потоков нет
+// и задача выполняется прямо в huff_pool_submit.
+typedef struct HuffPool HuffPool;
+
+HuffPool* huff_pool_create(int threads);
+void huff_pool_submit(HuffPool* pool, void (*fn)(void*), void* arg);
+void huff_pool_wait(HuffPool* pool);
+void huff_pool_destroy(HuffPool* pool);
+int huff_cpu_count(void);
+int huff_steal_run(int threads, int count, void (*fn)(void*, int, int), void* arg);
+
+// --- Блочный формат (huffman_blocks.c) ---
+HuffError encode_blocks(HuffContext* ctx, HuffInput* in, HuffOutput* out, uint64_t* total_bits);
+int decode_blocks(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                  const HuffHeader* header, uint64_t* decoded);
+void huff_blocks_release(HuffContext* ctx);
+int64_t blocked_output_size(const HuffInput* in, uint64_t block_size);
+size_t blocked_compress_bound(size_t size, size_t block_size, size_t seek_interval);
+int64_t decode_blocked_range(HuffContext* ctx, const HuffInput* in, const HuffHeader* header,
+                             uint64_t offset, uint8_t* dst, size_t len);
+
+// --- Статистика и прогресс (huffman_stats.c) ---
+// Таймер отмечает границы фаз; при on == 0 ничего не делает.
+typedef struct {
+    int on;
+    double wall;
+    double cpu;             // Время процессора этого потока
+} HuffTimer;
+
+double huff_wall_time(void);
+double huff_process_time(void);
+void huff_timer_start(HuffTimer* t, int on);
+void huff_timer_lap(HuffTimer* t, HuffStats* stats, HuffPhase phase);
+void huff_stats_add_codes(HuffStats* stats, const uint32_t* freq, const uint8_t* lens,
+                          uint64_t bits);
+void huff_stats_add_codes64(HuffStats* stats, const uint64_t* freq, const uint8_t* lens,
+                            uint64_t bits);
+void huff_stats_merge(HuffStats* to, const HuffStats* from);
+void huff_stats_begin(HuffContext* ctx);
+void huff_stats_end(HuffContext* ctx, uint64_t bytes_in, uint64_t bytes_out);
+void huff_progress(HuffContext* ctx, uint64_t done, uint64_t total, int final);
+
+// --- Таблица декодирования (huffman_table.c) ---
+// Элемент таблицы упакован в uint32_t:
+//   биты 0-5   — сколько бит снять с потока на этом уровне
+//   биты 6-9   — ширина подтаблицы (0 у листа)
+//   биты 10-31 — символ (лист) или смещение подтаблицы (ссылка)
+// Память entries переиспользуется следующим huff_table_build, поэтому
+// таблицу перед первым построением нужно обнулить.
+//
+// Рядом с первичной таблицей строится таблица пар той же ширины: если за
+// первым кодом в окне root_bits целиком помещается и второй, элемент даёт
+// оба символа за один просмотр. Упаковка:
+//   биты 0-7   — первый символ
+//   биты 8-15  — второй символ
+//   биты 16-21 — сколько бит снять на оба
+//   биты 22-23 — сколько символов (1 или 2; 0 — код длиннее первичной
+//                таблицы, символ берётся по entries)
+#define PAIR_SYM1(p)  ((p) & 255u)
+#define PAIR_SYM2(p)  (((p) >> 8) & 255u)
+#define PAIR_LEN(p)   (((p) >> 16) & 63u)
+#define PAIR_COUNT(p) ((p) >> 22)
+
+typedef struct {
+    uint32_t* entries;
+    uint32_t* pairs;        // 1 << root_bits элементов
+    uint32_t size;
+    uint32_t cap;           // Под сколько элементов выделена память
+    int root_bits;          // Ширина первичной таблицы
+    int max_len;            // Длина самого длинного кода
+} HuffDecodeTable;
+
+int huff_table_build(HuffDecodeTable* table, const uint64_t* words,
+                     const uint8_t* lens);
+void huff_table_free(HuffDecodeTable* table);
+
+// --- Чтение битов через 64-битный буфер ---
+// Биты выровнены по старшему разряду: следующий бит потока — бит 63.
+typedef struct {
+    uint64_t bits;
+    int count;              // Сколько валидных бит в bits
+    int pad;                // Сколько из них — нули, добавленные за концом
+    const uint8_t* p;       // Следующий ещё не загруженный байт
+    const uint8_t* end;
+} BitReader;
+
+void bit_reader_init(BitReader* br, const uint8_t* data, size_t size);
+void bit_reader_skip(BitReader* br, int bits);
+size_t huff_decode_symbols(const HuffDecodeTable* table, BitReader* br,
+                           uint8_t* out, size_t max_symbols, int final);
+int huff_decode_four_streams(const HuffDecodeTable* table, const uint8_t* src,
+                             const size_t* sizes, uint8_t* out, size_t n);
+
+// Таблицы по контексту: для каждого предыдущего байта — таблица его кластера
+typedef struct {
+    const uint32_t* entries[256];
+    uint8_t root_bits[256];
+    int max_len;            // Самый длинный код всех таблиц
+} HuffOrder1Tables;
+
+size_t huff_decode_symbols_order1(const HuffOrder1Tables* tables, BitReader* br,
+                                  uint8_t* out, size_t max_symbols, int prev);
+int huff_decode_four_streams_order1(const HuffOrder1Tables* tables, const uint8_t* src,
+                                    const size_t* sizes, uint8_t* out, size_t n);
+
+// --- Запись битов через 64-битный аккумулятор (huffman_encoder.c) ---
+// Коды складываются в acc начиная со старшего разряда; заполненный acc
+// уходит в буфер сразу 8 байтами. В буфере p должно быть место на
+// 8 * ceil(бит / 64) байт.
+typedef struct {
+    uint64_t acc;
+    int count;              // Сколько бит занято в acc
+    uint8_t* p;             // Куда писать следующие 8 байт
+} BitWriter;
+
+void bit_writer_init(BitWriter* bw, uint8_t* out);
+void huff_encode_symbols(const HuffCode* codes, const uint8_t* in, size_t n,
+                         BitWriter* bw);
+void huff_encode_symbols_order1(const HuffCode* const* codes, const uint8_t* in, size_t n,
+                                int prev, BitWriter* bw);
+size_t bit_writer_finish(BitWriter* bw);
+
+// --- Контексты порядка 1 (huffman_order1.c) ---
+// Рабочая память кодера: частоты пар и они же без нулей, по контекстам
+// подряд (символы контекста c — с nz_start[c] до nz_start[c + 1]).
+typedef struct {
+    uint32_t pair[256 * 256];       // pair[prev * 256 + cur]
+    uint32_t nz_start[257];
+    uint32_t nz_count[256 * 256];
+    uint8_t nz_sym[256 * 256];
+} HuffOrder1Model;
+
+void huff_pair_histogram(HuffOrder1Model* model, const uint8_t* data, size_t size);
+int huff_cluster_contexts(HuffOrder1Model* model, int max_clusters, uint8_t* map,
+                          uint32_t (*cluster_freq)[256]);
+uint64_t huff_cluster_lengths(uint32_t (*cluster_freq)[256], int clusters, int max_len,
+                              uint8_t (*lens)[256]);
+
+// --- Адаптивная модель (huffman_adaptive.c) ---
+// Счётчики уже закодированных символов и коды по ним; кодер держит codes,
+// декодер — table. Перестраивается, когда coded доходит до next_rebuild.
+typedef struct {
+    int decoder;
+    uint32_t freq[256];
+    uint8_t lens[256];
+    HuffCode codes[256];
+    HuffDecodeTable table;
+    uint64_t coded;                 // Символов с начала потока
+    uint64_t next_rebuild;
+} HuffAdaptiveModel;
+
+int huff_adaptive_init(HuffAdaptiveModel* m, int decoder);
+void huff_adaptive_release(HuffAdaptiveModel* m);
+size_t huff_adaptive_encode_frame(HuffAdaptiveModel* m, const uint8_t* src, size_t n,
+                                  uint8_t* dst, uint64_t* bits);
+int64_t huff_adaptive_decode_frame(HuffAdaptiveModel* m, const uint8_t* src, size_t size,
+                                   size_t* used, uint8_t* dst, size_t cap);
+int64_t adaptive_output_size(const HuffInput* in);
+size_t adaptive_compress_bound(size_t size);
+
+// --- Контекст сжатия (huffman_api.c) ---
+// Всё, что переживает вызовы: параметры, пул, задачи блоков с их буферами
+// и таблицами, смещения и отметки для индекса, таблица декодирования и
+// гистограммы кусков форматов 1 и 2, адаптивная модель формата 4,
+// статистика текущего вызова.
+struct HuffContext {
+    HuffOptions options;            // С подставленными значениями по умолчанию
+    int threads;
+    HuffPool* pool;
+    struct EncodeJob* encode_jobs;  // batch задач (huffman_blocks.c)
+    struct DecodeJob* decode_jobs;
+    int batch;
+    uint64_t* offsets;
+    size_t offsets_cap;
+    uint64_t* checkpoints;          // Отметки блоков для индекса (формат 3)
+    size_t checkpoints_cap;
+    HuffDecodeTable table;
+    uint32_t (*chunk_freq)[256];    // Гистограммы кусков одного потока (форматы 1 и 2)
+    size_t chunk_freq_cap;
+    HuffAdaptiveModel adaptive;
+    HuffStats stats;
+    double stats_wall;              // Начало вызова: часы и время процесса
+    double stats_cpu;
+    double progress_time;           // Когда прогресс сообщался последний раз
+};
+
+// Итоги кодирования для отчёта
+typedef struct {
+    uint64_t input_size;
+    uint64_t total_bits;            // Сумма длин битовых потоков
+    int unique;                     // Разных символов (форматы 1 и 2)
+    int longest;                    // Самый длинный код (формат 2)
+    uint64_t limit_cost;            // На сколько бит предел длины удлинил поток
+} HuffEncodeInfo;
+
+// Кодирование и декодирование между любыми входом и выходом; файловые
+// функции и функции в памяти отличаются только тем, что открывают.
+HuffError huff_encode_stream(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                             HuffEncodeInfo* info);
+HuffError huff_read_header(HuffInput* in, HuffHeader* header);
+// Статистику вызова открывает и закрывает вызывающий (huff_stats_begin/end).
+HuffError huff_decode_stream(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                             const HuffHeader* header, uint64_t* decoded);
+HuffError encode_adaptive(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                          HuffEncodeInfo* info);
+HuffError decode_adaptive(HuffContext* ctx, HuffInput* in, HuffOutput* out,
+                          uint64_t* decoded);
+
+#endif // HUFFMAN_INTERNAL_H
\ No newline at end of file
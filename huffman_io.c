@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE         // MAP_POPULATE
+
+#include "huffman_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Обычный файл отображается в память целиком, и данные читаются и пишутся
+// прямо в отображении, без копий в буферы stdio. Каналы, устройства и
+// файлы, которые не удалось отобразить, идут через буфер и read/write
+// кусками по HUFF_IO_CHUNK. Имя "-" — stdin для чтения и stdout для записи.
+// В режимах HUFF_IO_THREADS и HUFF_IO_URING вход и выход идут через кольца
+// буферов отдельных потоков (huffman_aio.c), а здесь только перенаправляются.
+#define HUFF_IO_CHUNK (1024 * 1024)
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+// --- Открытие входного файла ---
+// random — читаться будут отдельные места: страницы не подгружаются заранее.
+static int input_open(HuffInput* in, const char* filename, int random) {
+    memset(in, 0, sizeof(*in));
+    int is_stdin = strcmp(filename, "-") == 0;
+    in->fd = is_stdin ? dup(STDIN_FILENO) : open(filename, O_RDONLY);
+    if (in->fd < 0) return 0;
+
+    // stdin отображается, только если это файл, прочитанный с начала
+    struct stat st;
+    if (fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        (!is_stdin || lseek(in->fd, 0, SEEK_CUR) == 0)) {
+        in->file_size = (uint64_t)st.st_size;
+        in->size_known = 1;
+        if (st.st_size == 0) {
+            in->eof = 1;
+            return 1;
+        }
+
+        // Страницы подгружаются сразу все: это дешевле, чем по одному
+        // прерыванию на каждые 4 КБ (кроме чтения отдельных мест)
+        void* map = mmap(NULL, (size_t)st.st_size, PROT_READ,
+                         MAP_PRIVATE | (random ? 0 : MAP_POPULATE), in->fd, 0);
+        if (map != MAP_FAILED) {
+            posix_madvise(map, (size_t)st.st_size,
+                          random ? POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+            in->data = (const uint8_t*)map;
+            in->size = (size_t)st.st_size;
+            in->mapped = 1;
+            in->eof = 1;
+        }
+    }
+    return 1;
+}
+
+int huff_input_open(HuffInput* in, const char* filename) {
+    return input_open(in, filename, 0);
+}
+
+int huff_input_open_random(HuffInput* in, const char* filename) {
+    return input_open(in, filename, 1);
+}
+
+// --- Открытие входа выбранным способом ---
+int huff_input_open_io(HuffInput* in, const char* filename, HuffIoMode mode) {
+    if (mode == HUFF_IO_MAP) return input_open(in, filename, 0);
+    return huff_pipe_input_open(in, filename, mode == HUFF_IO_URING);
+}
+
+// --- Вход из буфера в памяти: ведёт себя как отображённый файл ---
+void huff_input_memory(HuffInput* in, const void* data, size_t size) {
+    memset(in, 0, sizeof(*in));
+    in->fd = -1;
+    in->data = (const uint8_t*)data;
+    in->size = size;
+    in->file_size = size;
+    in->size_known = 1;
+    in->mapped = 1;
+    in->memory = 1;
+    in->eof = 1;
+}
+
+// --- Доступ к следующим want байтам без их снятия ---
+// Возвращает, сколько байт доступно по *p: не меньше want, если файл
+// не кончился раньше. Указатель действителен до следующего peek/skip.
+size_t huff_input_peek(HuffInput* in, size_t want, const uint8_t** p) {
+    if (in->pipe) return huff_pipe_peek(in, want, p);
+    while (in->size - in->pos < want && !in->eof) {
+        // Сдвигаем непрочитанное в начало буфера и, если надо, растим его
+        size_t rest = in->size - in->pos;
+        if (in->pos > 0) {
+            memmove(in->buffer, in->buffer + in->pos, rest);
+            in->pos = 0;
+            in->size = rest;
+        }
+        // want == SIZE_MAX — читать до конца файла
+        size_t need = want == (size_t)-1 ? rest + HUFF_IO_CHUNK : want;
+        if (need < HUFF_IO_CHUNK) need = HUFF_IO_CHUNK;
+        if (in->cap < need) {
+            size_t cap = in->cap ? in->cap : HUFF_IO_CHUNK;
+            while (cap < need) cap *= 2;
+            uint8_t* grown = (uint8_t*)realloc(in->buffer, cap);
+            if (!grown) {
+                in->error = 1;
+                break;
+            }
+            in->buffer = grown;
+            in->data = grown;
+            in->cap = cap;
+        }
+
+        ssize_t got = read(in->fd, in->buffer + in->size, in->cap - in->size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            if (got < 0) in->error = 1;
+            in->eof = 1;
+            break;
+        }
+        in->size += (size_t)got;
+        in->data = in->buffer;
+    }
+
+    *p = in->data + in->pos;
+    return in->size - in->pos;
+}
+
+// --- Снятие n байт, уже полученных через peek ---
+void huff_input_skip(HuffInput* in, size_t n) {
+    in->pos += n;
+    in->consumed += n;
+}
+
+// --- Закрытие входного файла ---
+void huff_input_close(HuffInput* in) {
+    if (in->pipe) huff_pipe_input_close(in);
+    if (in->mapped && !in->memory) munmap((void*)in->data, in->size);
+    free(in->buffer);
+    if (in->fd >= 0) close(in->fd);
+    memset(in, 0, sizeof(*in));
+    in->fd = -1;
+}
+
+// --- Отображение выходного файла размером cap ---
+// При неудаче файл может остаться длиной cap: вызывающий обрезает его сам
+// (при открытии — до нуля, при росте — при закрытии до записанного).
+static int output_map(HuffOutput* out, size_t cap) {
+    if (ftruncate(out->fd, (off_t)cap) != 0) return 0;
+    // Место на диске выделяется заранее. Без него страницы отображения
+    // получают место при первой записи, и на полном диске процесс получает
+    // SIGBUS вместо ошибки записи. Файловые системы без fallocate
+    // (EOPNOTSUPP, EINVAL) отображаются как есть.
+    int err = posix_fallocate(out->fd, 0, (off_t)cap);
+    if (err != 0 && err != EOPNOTSUPP && err != EINVAL) return 0;
+    void* map = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0);
+    if (map == MAP_FAILED) return 0;
+    out->data = (uint8_t*)map;
+    out->cap = cap;
+    return 1;
+}
+
+// --- Сброс буфера в файл (только без отображения) ---
+static int output_flush(HuffOutput* out) {
+    if (out->pipe) return huff_pipe_output_flush(out);
+    size_t done = 0;
+    while (done < out->pos) {
+        ssize_t put = write(out->fd, out->data + done, out->pos - done);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) {
+            out->error = 1;
+            return 0;
+        }
+        done += (size_t)put;
+    }
+    out->flushed += out->pos;
+    out->pos = 0;
+    return 1;
+}
+
+// --- Создание выходного файла ---
+// size_hint — ожидаемый размер: под него файл сразу отображается, а если
+// данных окажется больше, отображение растёт. 0 — размер неизвестен.
+int huff_output_open(HuffOutput* out, const char* filename, uint64_t size_hint) {
+    memset(out, 0, sizeof(*out));
+
+    // stdout пишется только потоком: он может быть каналом или дописываться
+    if (strcmp(filename, "-") == 0) {
+        out->fd = dup(STDOUT_FILENO);
+        return out->fd >= 0;
+    }
+
+    out->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out->fd < 0) {
+        // Запись в канал или устройство может быть открыта только на запись
+        out->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out->fd < 0) return 0;
+    }
+
+    struct stat st;
+    if (fstat(out->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (output_map(out, size_hint > 0 ? (size_t)size_hint : HUFF_IO_CHUNK)) {
+            out->mapped = 1;
+        } else if (ftruncate(out->fd, 0) != 0) {
+            // Файл уже мог вырасти до size_hint: без отображения пишем с нуля
+            close(out->fd);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// --- Создание выходного файла выбранным способом ---
+int huff_output_open_io(HuffOutput* out, const char* filename, uint64_t size_hint,
+                        HuffIoMode mode) {
+    if (mode == HUFF_IO_MAP) return huff_output_open(out, filename, size_hint);
+    return huff_pipe_output_open(out, filename, mode == HUFF_IO_URING);
+}
+
+// --- Место за концом буфера вызывающего ---
+// Кодеры берут место с запасом (словами по 8 байт, по худшему размеру кадра),
+// а подтверждают точный размер. Запрос, не влезающий в буфер, получает
+// отдельный кусок памяти; huff_output_commit переносит из него то, что
+// влезло, — так хватает буфера ровно по размеру сжатых данных.
+static uint8_t* output_spill(HuffOutput* out, size_t n) {
+    if (n > out->spill_cap) {
+        uint8_t* grown = (uint8_t*)realloc(out->spill, n);
+        if (!grown) {
+            out->error = HUFF_ERROR_NO_MEMORY;
+            return NULL;
+        }
+        out->spill = grown;
+        out->spill_cap = n;
+    }
+    out->spilled = 1;
+    return out->spill;
+}
+
+// --- Выход в буфер вызывающего: не растёт, переполнение — ошибка ---
+void huff_output_memory(HuffOutput* out, void* buf, size_t cap) {
+    memset(out, 0, sizeof(*out));
+    out->fd = -1;
+    out->data = (uint8_t*)buf;
+    out->cap = cap;
+    out->mapped = 1;
+    out->memory = 1;
+}
+
+// --- Место под n байт в текущей позиции ---
+// Указатель действителен до huff_output_commit.
+uint8_t* huff_output_reserve(HuffOutput* out, size_t n) {
+    if (out->error) return NULL;
+    out->spilled = 0;
+    if (out->pos + n <= out->cap) return out->data + out->pos;
+    if (out->memory) return output_spill(out, n);
+    // Конвейер: полный кусок уходит потоку записи, место даёт следующий
+    if (out->pipe) return huff_pipe_reserve(out, n);
+
+    size_t cap = out->cap ? out->cap * 2 : HUFF_IO_CHUNK;
+    while (cap < out->pos + n) cap *= 2;
+
+    if (out->mapped) {
+        munmap(out->data, out->cap);
+        out->data = NULL;
+        if (!output_map(out, cap)) {
+            out->error = 1;
+            return NULL;
+        }
+    } else {
+        uint8_t* grown = (uint8_t*)realloc(out->data, cap);
+        if (!grown) {
+            out->error = HUFF_ERROR_NO_MEMORY;
+            return NULL;
+        }
+        out->data = grown;
+        out->cap = cap;
+    }
+    return out->data + out->pos;
+}
+
+// --- Отдать записанное читателю (у отображения ничего не делает) ---
+int huff_output_flush(HuffOutput* out) {
+    if (out->mapped || out->pos == 0) return !out->error;
+    return output_flush(out);
+}
+
+// --- Подтверждение n байт, записанных после huff_output_reserve ---
+int huff_output_commit(HuffOutput* out, size_t n) {
+    if (out->spilled) {
+        out->spilled = 0;
+        if (out->cap - out->pos < n) {
+            out->error = 1;
+            return 0;
+        }
+        memcpy(out->data + out->pos, out->spill, n);
+    }
+    out->pos += n;
+    size_t chunk = out->pipe ? HUFF_PIPE_CHUNK : HUFF_IO_CHUNK;
+    if (!out->mapped && out->pos >= chunk) return output_flush(out);
+    return !out->error;
+}
+
+// --- Запись n байт из buf ---
+int huff_output_write(HuffOutput* out, const void* buf, size_t n) {
+    uint8_t* dst = huff_output_reserve(out, n);
+    if (!dst) return 0;
+    memcpy(dst, buf, n);
+    return huff_output_commit(out, n);
+}
+
+// --- Ошибка выхода ---
+// Если причина не записана, у буфера вызывающего это нехватка места.
+HuffError huff_output_error(const HuffOutput* out) {
+    if (out->error < 0) return (HuffError)out->error;
+    return out->memory ? HUFF_ERROR_DST_TOO_SMALL : HUFF_ERROR_WRITE;
+}
+
+// --- Сколько байт записано ---
+uint64_t huff_output_size(const HuffOutput* out) {
+    return out->flushed + out->pos;
+}
+
+// --- Закрытие: файл обрезается по записанному ---
+int huff_output_close(HuffOutput* out) {
+    int ok = !out->error;
+    if (out->memory) {
+        free(out->spill);
+        memset(out, 0, sizeof(*out));
+        out->fd = -1;
+        return ok;
+    }
+    if (out->pipe) {
+        if (!huff_pipe_output_close(out)) ok = 0;
+    } else if (out->mapped) {
+        munmap(out->data, out->cap);
+        if (ftruncate(out->fd, (off_t)out->pos) != 0) ok = 0;
+    } else {
+        if (ok && !output_flush(out)) ok = 0;
+        free(out->data);
+    }
+    if (close(out->fd) != 0) ok = 0;
+    memset(out, 0, sizeof(*out));
+    out->fd = -1;
+    return ok;
+}
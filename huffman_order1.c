@@ -0,0 +1,204 @@
+#include "huffman_internal.h"
+#include <math.h>
+#include <string.h>
+
+// Контексты порядка 1: код символа выбирается по предыдущему байту. Своя
+// таблица на каждый из 256 контекстов обошлась бы дороже выигрыша, поэтому
+// контексты с похожими распределениями собираются в кластеры (не больше
+// HUFF_MAX_CLUSTERS), и таблица строится на кластер.
+//
+// Кластеризация — k-means по цене кодирования: контекст c в кластере k
+// стоит sum f(c, s) * (-log2 p_k(s)) бит, где p_k — сглаженное
+// распределение кластера. Затравки выбираются жадно: первым берётся самый
+// частый контекст, каждым следующим — тот, кому ближайший кластер обходится
+// дороже всего по сравнению с собственным распределением. Затем контексты
+// переназначаются в самый дешёвый кластер, пока назначение меняется.
+
+#define CLUSTER_ITERATIONS 8
+
+// --- Частоты пар: model->pair[prev * 256 + cur] ---
+// У первого символа предыдущим считается 0 (так же считает декодер).
+void huff_pair_histogram(HuffOrder1Model* model, const uint8_t* data, size_t size) {
+    uint32_t* pair = model->pair;
+    unsigned prev = 0;
+    for (size_t i = 0; i < size; i++) {
+        pair[prev << 8 | data[i]]++;
+        prev = data[i];
+    }
+}
+
+// --- Цена кодирования контекста c ценами символов cost (бит) ---
+static double context_cost(const HuffOrder1Model* model, int c, const float* cost) {
+    double bits = 0;
+    for (uint32_t j = model->nz_start[c]; j < model->nz_start[c + 1]; j++) {
+        bits += (double)model->nz_count[j] * cost[model->nz_sym[j]];
+    }
+    return bits;
+}
+
+// --- Цена символа в кластере: -log2 сглаженной вероятности ---
+static void cluster_costs(const uint32_t* freq, float* cost) {
+    uint64_t total = 0;
+    for (int s = 0; s < 256; s++) total += freq[s];
+    double log_total = log2((double)total + 128.0);
+    for (int s = 0; s < 256; s++) {
+        cost[s] = (float)(log_total - log2((double)freq[s] + 0.5));
+    }
+}
+
+// --- Кластеризация контекстов ---
+// Возвращает число кластеров (не больше max_clusters); map[c] — кластер
+// контекста c (неиспользуемые контексты — в кластере 0), cluster_freq[k] —
+// сумма частот его контекстов.
+int huff_cluster_contexts(HuffOrder1Model* model, int max_clusters, uint8_t* map,
+                          uint32_t (*cluster_freq)[256]) {
+    if (max_clusters > HUFF_MAX_CLUSTERS) max_clusters = HUFF_MAX_CLUSTERS;
+    memset(map, 0, 256);
+
+    // 1. Ненулевые частоты каждого контекста подряд и собственная цена
+    //    контекста (энтропия его распределения)
+    uint64_t totals[256];
+    double own[256];
+    int used[256];
+    int used_count = 0;
+    uint32_t n = 0;
+    for (int c = 0; c < 256; c++) {
+        model->nz_start[c] = n;
+        totals[c] = 0;
+        for (int s = 0; s < 256; s++) {
+            uint32_t f = model->pair[c << 8 | s];
+            if (!f) continue;
+            model->nz_sym[n] = (uint8_t)s;
+            model->nz_count[n] = f;
+            n++;
+            totals[c] += f;
+        }
+        own[c] = 0;
+        for (uint32_t j = model->nz_start[c]; j < n; j++) {
+            own[c] += model->nz_count[j] * log2((double)totals[c] / model->nz_count[j]);
+        }
+        if (totals[c]) used[used_count++] = c;
+    }
+    model->nz_start[256] = n;
+    if (used_count == 0) return 0;
+
+    // 2. Затравки
+    uint8_t assign[256];
+    double best[256];
+    float cost[HUFF_MAX_CLUSTERS][256];
+    int clusters = 0;
+    int seed = used[0];
+    for (int i = 1; i < used_count; i++) {
+        if (totals[used[i]] > totals[seed]) seed = used[i];
+    }
+    for (int i = 0; i < used_count; i++) {
+        assign[used[i]] = 0;
+        best[used[i]] = 1e300;
+    }
+    while (seed >= 0) {
+        uint32_t freq[256] = {0};
+        for (uint32_t j = model->nz_start[seed]; j < model->nz_start[seed + 1]; j++) {
+            freq[model->nz_sym[j]] = model->nz_count[j];
+        }
+        cluster_costs(freq, cost[clusters]);
+        for (int i = 0; i < used_count; i++) {
+            int c = used[i];
+            double bits = context_cost(model, c, cost[clusters]);
+            if (bits < best[c]) {
+                best[c] = bits;
+                assign[c] = (uint8_t)clusters;
+            }
+        }
+        clusters++;
+
+        seed = -1;
+        double worst = 0;
+        for (int i = 0; clusters < max_clusters && i < used_count; i++) {
+            int c = used[i];
+            if (best[c] - own[c] > worst) {
+                worst = best[c] - own[c];
+                seed = c;
+            }
+        }
+    }
+
+    // 3. Переназначение, пока оно меняется
+    for (int iter = 0; iter < CLUSTER_ITERATIONS; iter++) {
+        memset(cluster_freq, 0, (size_t)clusters * sizeof(cluster_freq[0]));
+        for (int i = 0; i < used_count; i++) {
+            int c = used[i];
+            uint32_t* freq = cluster_freq[assign[c]];
+            for (uint32_t j = model->nz_start[c]; j < model->nz_start[c + 1]; j++) {
+                freq[model->nz_sym[j]] += model->nz_count[j];
+            }
+        }
+        for (int k = 0; k < clusters; k++) cluster_costs(cluster_freq[k], cost[k]);
+
+        int changed = 0;
+        for (int i = 0; i < used_count; i++) {
+            int c = used[i];
+            int to = assign[c];
+            double low = context_cost(model, c, cost[to]);
+            for (int k = 0; k < clusters; k++) {
+                double bits = context_cost(model, c, cost[k]);
+                if (bits < low) {
+                    low = bits;
+                    to = k;
+                }
+            }
+            if (to != assign[c]) {
+                assign[c] = (uint8_t)to;
+                changed = 1;
+            }
+        }
+        if (!changed) break;
+    }
+
+    // 4. Пустые кластеры выбрасываются, номера сжимаются
+    uint8_t renumber[HUFF_MAX_CLUSTERS];
+    int kept = 0;
+    memset(cluster_freq, 0, (size_t)clusters * sizeof(cluster_freq[0]));
+    for (int i = 0; i < used_count; i++) {
+        int c = used[i];
+        uint32_t* freq = cluster_freq[assign[c]];
+        for (uint32_t j = model->nz_start[c]; j < model->nz_start[c + 1]; j++) {
+            freq[model->nz_sym[j]] += model->nz_count[j];
+        }
+    }
+    for (int k = 0; k < clusters; k++) {
+        int empty = 1;
+        for (int i = 0; i < used_count && empty; i++) empty = assign[used[i]] != k;
+        renumber[k] = (uint8_t)kept;
+        if (empty) continue;
+        if (kept != k) memcpy(cluster_freq[kept], cluster_freq[k], sizeof(cluster_freq[0]));
+        kept++;
+    }
+    for (int i = 0; i < used_count; i++) map[used[i]] = renumber[assign[used[i]]];
+    return kept;
+}
+
+// --- Длины кодов кластеров ---
+// В кластер из одного символа добавляется второй, которого в потоке не
+// будет: табличному декодеру нужен полный код хотя бы из двух слов. Возвращает
+// длину битового потока всех символов.
+uint64_t huff_cluster_lengths(uint32_t (*cluster_freq)[256], int clusters, int max_len,
+                              uint8_t (*lens)[256]) {
+    uint64_t bits = 0;
+    for (int k = 0; k < clusters; k++) {
+        uint32_t freq[256];
+        memcpy(freq, cluster_freq[k], sizeof(freq));
+        int unique = 0;
+        int last = 0;
+        for (int s = 0; s < 256; s++) {
+            if (freq[s]) {
+                unique++;
+                last = s;
+            }
+        }
+        if (unique == 1) freq[(last + 1) & 255] = 1;
+
+        huff_code_lengths(freq, max_len, lens[k]);
+        for (int s = 0; s < 256; s++) bits += (uint64_t)cluster_freq[k][s] * lens[k][s];
+    }
+    return bits;
+}
@@ -0,0 +1,274 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "huffman_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    void (*fn)(void*);
+    void* arg;
+} PoolTask;
+
+struct HuffPool {
+    pthread_t* workers;
+    int threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t has_task;        // Появилась задача или пора выходить
+    pthread_cond_t all_done;        // Очередь пуста и никто не работает
+
+    PoolTask* tasks;                // Кольцевая очередь
+    int capacity;
+    int head;
+    int count;
+    int active;                     // Сколько задач выполняется прямо сейчас
+    int stop;
+};
+
+// --- Рабочий поток: берёт задачи из очереди, пока пул жив ---
+static void* pool_worker(void* arg) {
+    HuffPool* pool = (HuffPool*)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->count == 0 && !pool->stop) {
+            pthread_cond_wait(&pool->has_task, &pool->lock);
+        }
+        if (pool->count == 0 && pool->stop) break;
+
+        PoolTask task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        task.fn(task.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (pool->count == 0 && pool->active == 0) {
+            pthread_cond_broadcast(&pool->all_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// --- Число доступных ядер ---
+int huff_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// --- Создание пула ---
+HuffPool* huff_pool_create(int threads) {
+    HuffPool* pool = (HuffPool*)calloc(1, sizeof(HuffPool));
+    if (!pool) return NULL;
+    if (threads <= 1) return pool;  // Однопоточный режим: задачи сразу
+
+    pool->workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    pool->capacity = 64;
+    pool->tasks = (PoolTask*)malloc(pool->capacity * sizeof(PoolTask));
+    if (!pool->workers || !pool->tasks) {
+        free(pool->workers);
+        free(pool->tasks);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->has_task, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->workers[i], NULL, pool_worker, pool) != 0) break;
+        pool->threads++;
+    }
+    return pool;
+}
+
+// --- Постановка задачи в очередь ---
+void huff_pool_submit(HuffPool* pool, void (*fn)(void*), void* arg) {
+    if (pool->threads == 0) {
+        fn(arg);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == pool->capacity) {
+        // Очередь полна: расширяем, разворачивая кольцо
+        PoolTask* grown = (PoolTask*)malloc(2 * pool->capacity * sizeof(PoolTask));
+        if (!grown) {
+            pthread_mutex_unlock(&pool->lock);
+            fn(arg);
+            return;
+        }
+        for (int i = 0; i < pool->count; i++) {
+            grown[i] = pool->tasks[(pool->head + i) % pool->capacity];
+        }
+        free(pool->tasks);
+        pool->tasks = grown;
+        pool->head = 0;
+        pool->capacity *= 2;
+    }
+
+    pool->tasks[(pool->head + pool->count) % pool->capacity].fn = fn;
+    pool->tasks[(pool->head + pool->count) % pool->capacity].arg = arg;
+    pool->count++;
+    pthread_cond_signal(&pool->has_task);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// --- Ожидание, пока выполнятся все поставленные задачи ---
+void huff_pool_wait(HuffPool* pool) {
+    if (pool->threads == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count > 0 || pool->active > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// --- Остановка потоков и освобождение пула ---
+void huff_pool_destroy(HuffPool* pool) {
+    if (!pool) return;
+
+    if (pool->threads > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->has_task);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (int i = 0; i < pool->threads; i++) {
+            pthread_join(pool->workers[i], NULL);
+        }
+
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->has_task);
+        pthread_cond_destroy(&pool->all_done);
+    }
+
+    free(pool->workers);
+    free(pool->tasks);
+    free(pool);
+}
+
+// --- Параллельный цикл с кражей задач ---
+// Задачи раздаются по кругу в очереди потоков, каждая очередь под своим
+// замком. Поток берёт задачи из начала своей очереди, а когда она
+// опустела — крадёт из конца самой длинной чужой. Если задачи упорядочены
+// от тяжёлых к лёгким, каждый сначала берёт свои тяжёлые, а лёгкие из хвоста
+// того, кто застрял на большой задаче, достаются освободившимся.
+typedef struct {
+    pthread_mutex_t lock;
+    int* tasks;
+    int head;
+    int tail;
+} StealQueue;
+
+typedef struct {
+    StealQueue* queues;
+    int workers;
+    void (*fn)(void*, int, int);
+    void* arg;
+} StealRun;
+
+typedef struct {
+    StealRun* run;
+    int worker;
+} StealWorker;
+
+// --- Следующая задача потока: своя из начала или чужая из конца (-1 — нет) ---
+static int steal_next(StealRun* run, int worker) {
+    StealQueue* own = &run->queues[worker];
+    pthread_mutex_lock(&own->lock);
+    int task = own->head < own->tail ? own->tasks[own->head++] : -1;
+    pthread_mutex_unlock(&own->lock);
+    if (task >= 0) return task;
+
+    while (1) {
+        // Жертва — очередь с наибольшим остатком
+        int victim = -1;
+        int longest = 0;
+        for (int i = 0; i < run->workers; i++) {
+            StealQueue* q = &run->queues[i];
+            pthread_mutex_lock(&q->lock);
+            int left = q->tail - q->head;
+            pthread_mutex_unlock(&q->lock);
+            if (left > longest) {
+                longest = left;
+                victim = i;
+            }
+        }
+        if (victim < 0) return -1;
+
+        StealQueue* q = &run->queues[victim];
+        pthread_mutex_lock(&q->lock);
+        task = q->head < q->tail ? q->tasks[--q->tail] : -1;
+        pthread_mutex_unlock(&q->lock);
+        if (task >= 0) return task;
+    }
+}
+
+static void* steal_worker(void* arg) {
+    StealWorker* self = (StealWorker*)arg;
+    int task;
+    while ((task = steal_next(self->run, self->worker)) >= 0) {
+        self->run->fn(self->run->arg, task, self->worker);
+    }
+    return NULL;
+}
+
+// --- Выполнение fn(arg, задача, поток) для задач 0..count-1 ---
+// Вызывающий поток работает как поток 0. Возвращает, сколько потоков
+// работало (fn видит номера потоков меньше threads), 0 — нет памяти.
+int huff_steal_run(int threads, int count, void (*fn)(void*, int, int), void* arg) {
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+
+    StealRun run = {NULL, threads, fn, arg};
+    run.queues = (StealQueue*)calloc(threads, sizeof(StealQueue));
+    int* tasks = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    StealWorker* workers = (StealWorker*)malloc(threads * sizeof(StealWorker));
+    pthread_t* ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if (!run.queues || !tasks || !workers || !ids) {
+        free(run.queues);
+        free(tasks);
+        free(workers);
+        free(ids);
+        return 0;
+    }
+
+    // 1. Раздаём задачи по кругу: очередь i — задачи i, i + threads, ...
+    int pos = 0;
+    for (int i = 0; i < threads; i++) {
+        StealQueue* q = &run.queues[i];
+        pthread_mutex_init(&q->lock, NULL);
+        q->tasks = tasks + pos;
+        for (int task = i; task < count; task += threads) tasks[pos++] = task;
+        q->tail = (int)(tasks + pos - q->tasks);
+    }
+
+    // 2. Запускаем потоки; не запустившийся поток просто ничего не возьмёт,
+    //    его задачи разберут остальные
+    int started = 1;
+    for (int i = 0; i < threads; i++) {
+        workers[i].run = &run;
+        workers[i].worker = i;
+    }
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&ids[started], NULL, steal_worker, &workers[i]) != 0) break;
+        started++;
+    }
+    steal_worker(&workers[0]);
+    for (int i = 1; i < started; i++) pthread_join(ids[i], NULL);
+
+    for (int i = 0; i < threads; i++) pthread_mutex_destroy(&run.queues[i].lock);
+    free(run.queues);
+    free(tasks);
+    free(workers);
+    free(ids);
+    return threads;
+}
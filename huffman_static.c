@@ -0,0 +1,196 @@
+#include "huffman_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Статические таблицы: коды обучаются заранее на образцах и хранятся у
+// обеих сторон, поэтому сообщение не несёт ни частот, ни длин, а кодер не
+// считает гистограмму. Сообщение:
+//   номер таблицы (байт; 0 — данные лежат как есть)
+//   длина исходных данных (varint)
+//   битовый поток, дополненный нулями до байта (или сами данные)
+// При обучении к частоте каждого байта добавляется 1, поэтому код есть у
+// всех 256 байтов и символы, которых не было в образцах, кодируются без
+// escape-кода (только длиннее). Если поток не короче данных, сообщение
+// записывается как есть.
+//
+// Файл таблицы: "HUFT", байт версии (1), номер таблицы, байт флагов и
+// таблица длин, как в формате 2.
+
+#define STATIC_FILE_VERSION 1
+#define STATIC_MESSAGE_HEAD 11          // Номер и varint
+
+struct HuffStaticCoder {
+    int id;
+    HuffCode codes[256];
+    HuffDecodeTable table;
+};
+
+// Таблица 1: русский текст в cp1251, обучена на a.txt и b.txt
+// (huffman --train 1 ru.huft a.txt b.txt печатает эти длины)
+static const HuffStaticTable builtin_text = {
+    HUFF_STATIC_BUILTIN_TEXT,
+    {
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12,  8, 12, 12, 12, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+         3,  9, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,  6,  8,  7, 12,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 10, 11, 12, 12, 12, 10,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+        12, 12, 12, 12, 12, 11, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+        12, 12, 12, 12, 12, 12,  8, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+         8, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 11, 12, 12, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 11, 12, 12, 12, 12,
+        10, 11, 10, 11, 10, 12, 12, 11, 10, 12, 10, 12, 10, 10, 10,  9,
+        12, 10, 10, 12, 11, 12, 12, 11, 12, 12, 12, 12, 12, 12, 12, 11,
+         4,  6,  5,  6,  5,  4,  7,  7,  4,  7,  5,  5,  5,  4,  4,  6,
+         5,  5,  4,  6, 11,  7,  9,  6,  7,  9, 12,  6,  6,  9,  8,  6
+    }
+};
+
+// --- Обучение: длины по частотам образцов, у каждого байта есть код ---
+void huff_static_train(HuffStaticTable* table, int id, const uint32_t* freq) {
+    uint64_t floor_freq[256];
+    uint32_t model[256];
+    for (int i = 0; i < 256; i++) floor_freq[i] = (uint64_t)freq[i] + 1;
+    huff_scale_frequencies(floor_freq, model);
+    table->id = id;
+    huff_code_lengths(model, HUFF_DEFAULT_MAX_CODE_LEN, table->lens);
+}
+
+// --- Встроенная таблица по номеру (NULL — такой нет) ---
+const HuffStaticTable* huff_static_builtin(int id) {
+    return id == HUFF_STATIC_BUILTIN_TEXT ? &builtin_text : NULL;
+}
+
+// --- Запись таблицы в файл ---
+HuffError huff_static_save(const HuffStaticTable* table, const char* filename) {
+    uint8_t buf[6 + HUFF_MAX_LENGTHS_SIZE + 1];
+    size_t pos = 0;
+    memcpy(buf, "HUFT", 4);
+    pos += 4;
+    buf[pos++] = STATIC_FILE_VERSION;
+    buf[pos++] = (uint8_t)table->id;
+    int flags = code_lengths_flags(table->lens);
+    buf[pos++] = (uint8_t)flags;
+    pos += put_code_lengths(buf + pos, table->lens, flags);
+
+    FILE* f = fopen(filename, "wb");
+    if (!f) return HUFF_ERROR_WRITE;
+    int ok = fwrite(buf, 1, pos, f) == pos;
+    if (fclose(f) != 0) ok = 0;
+    return ok ? HUFF_OK : HUFF_ERROR_WRITE;
+}
+
+// --- Чтение таблицы из файла ---
+HuffError huff_static_load(HuffStaticTable* table, const char* filename) {
+    uint8_t buf[6 + HUFF_MAX_LENGTHS_SIZE + 2];
+    FILE* f = fopen(filename, "rb");
+    if (!f) return HUFF_ERROR_READ;
+    size_t size = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    size_t pos = 7;
+    if (size < pos || size == sizeof(buf) || memcmp(buf, "HUFT", 4) != 0 ||
+        buf[4] != STATIC_FILE_VERSION || buf[5] == 0 ||
+        (buf[6] & ~(HUFF_FLAG_BYTE_LENGTHS | HUFF_FLAG_SYMBOL_LIST))) {
+        return HUFF_ERROR_CORRUPT;
+    }
+    table->id = buf[5];
+    if (get_code_lengths(buf, size, &pos, buf[6], table->lens) != 256 || pos != size) {
+        return HUFF_ERROR_CORRUPT;
+    }
+
+    // Длины должны образовать код, который умеет читать декодер
+    uint64_t words[256];
+    for (int i = 0; i < 256; i++) {
+        if (table->lens[i] > HUFF_DEFAULT_MAX_CODE_LEN) return HUFF_ERROR_CORRUPT;
+    }
+    return huff_canonical_codes(table->lens, words) ? HUFF_OK : HUFF_ERROR_CORRUPT;
+}
+
+// --- Кодер и декодер таблицы: коды и таблица декодирования ---
+// Не меняется при работе, поэтому один на все потоки.
+HuffStaticCoder* huff_static_create(const HuffStaticTable* table) {
+    if (table->id < 1 || table->id > 255) return NULL;
+    HuffStaticCoder* coder = (HuffStaticCoder*)calloc(1, sizeof(HuffStaticCoder));
+    if (!coder) return NULL;
+
+    uint64_t words[256];
+    if (!huff_canonical_codes(table->lens, words) ||
+        !huff_table_build(&coder->table, words, table->lens)) {
+        huff_static_free(coder);
+        return NULL;
+    }
+    coder->id = table->id;
+    for (int i = 0; i < 256; i++) {
+        coder->codes[i].word = words[i];
+        coder->codes[i].len = table->lens[i];
+    }
+    return coder;
+}
+
+void huff_static_free(HuffStaticCoder* coder) {
+    if (!coder) return;
+    huff_table_free(&coder->table);
+    free(coder);
+}
+
+// --- Наибольший размер сообщения из len байт ---
+size_t huff_static_bound(size_t len) {
+    return STATIC_MESSAGE_HEAD + (len * HUFF_DEFAULT_MAX_CODE_LEN + 63) / 64 * 8 + 8;
+}
+
+// --- Сжатие сообщения ---
+int64_t huff_static_encode(const HuffStaticCoder* coder, const void* src, size_t len,
+                           void* dst, size_t dst_cap) {
+    if (dst_cap < huff_static_bound(len)) return HUFF_ERROR_DST_TOO_SMALL;
+    uint8_t* out = (uint8_t*)dst;
+    size_t pos = 1;
+    pos += put_varint(out + pos, len);
+
+    BitWriter bw;
+    bit_writer_init(&bw, out + pos);
+    huff_encode_symbols(coder->codes, (const uint8_t*)src, len, &bw);
+    size_t bytes = (size_t)(bw.p - (out + pos));
+    bytes += bit_writer_finish(&bw);
+
+    // Код не помог — данные как есть
+    if (bytes >= len) {
+        out[0] = 0;
+        memcpy(out + pos, src, len);
+        return (int64_t)(pos + len);
+    }
+    out[0] = (uint8_t)coder->id;
+    return (int64_t)(pos + bytes);
+}
+
+// --- Номер таблицы сообщения: 0 — данные как есть, -1 — пустой вход ---
+int huff_static_message_id(const void* src, size_t len) {
+    return len > 0 ? *(const uint8_t*)src : -1;
+}
+
+// --- Распаковка сообщения таблицей coder ---
+int64_t huff_static_decode(const HuffStaticCoder* coder, const void* src, size_t len,
+                           void* dst, size_t dst_cap) {
+    const uint8_t* in = (const uint8_t*)src;
+    size_t pos = 1;
+    uint64_t n;
+    if (len < 2 || !get_varint(in, len, &pos, &n)) return HUFF_ERROR_CORRUPT;
+    if (n > dst_cap) return HUFF_ERROR_DST_TOO_SMALL;
+
+    if (in[0] == 0) {
+        if (len - pos != n) return HUFF_ERROR_CORRUPT;
+        memcpy(dst, in + pos, (size_t)n);
+        return (int64_t)n;
+    }
+    if (in[0] != coder->id) return HUFF_ERROR_CORRUPT;
+
+    BitReader br;
+    bit_reader_init(&br, in + pos, len - pos);
+    size_t got = huff_decode_symbols(&coder->table, &br, (uint8_t*)dst, (size_t)n, 1);
+    if (got != n || br.count < br.pad) return HUFF_ERROR_CORRUPT;
+    return (int64_t)n;
+}
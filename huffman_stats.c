@@ -0,0 +1,163 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "huffman_internal.h"
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+// Статистика собирается, только если её просили (options.stats): часы
+// читаются на границах фаз, то есть на кусок или блок, а не на символ.
+// Задачи пула копят свою статистику отдельно, главный поток складывает её
+// после пачки.
+
+static const char* phase_names[HUFF_PHASE_COUNT] = {
+    "read", "histogram", "tables", "coding", "write"
+};
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// --- Время по часам, секунды ---
+double huff_wall_time(void) {
+    return clock_seconds(CLOCK_MONOTONIC);
+}
+
+// --- Время процессора всех потоков процесса, секунды ---
+double huff_process_time(void) {
+    return clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// --- Начало отсчёта фазы (on == 0 — часы не читаются вовсе) ---
+void huff_timer_start(HuffTimer* t, int on) {
+    t->on = on;
+    if (!on) return;
+    t->wall = huff_wall_time();
+    t->cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+// --- Время с прошлой отметки уходит в фазу phase, отсчёт начинается заново ---
+void huff_timer_lap(HuffTimer* t, HuffStats* stats, HuffPhase phase) {
+    if (!t->on) return;
+    double wall = huff_wall_time();
+    double cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+    stats->wall[phase] += wall - t->wall;
+    stats->cpu[phase] += cpu - t->cpu;
+    t->wall = wall;
+    t->cpu = cpu;
+}
+
+// --- Коды одной модели (файла или блока): длины по символам и энтропия ---
+// bits == 0 — модель из одного символа, описанная одной таблицей.
+void huff_stats_add_codes(HuffStats* stats, const uint32_t* freq, const uint8_t* lens,
+                          uint64_t bits) {
+    uint64_t wide[256];
+    for (int i = 0; i < 256; i++) wide[i] = freq[i];
+    huff_stats_add_codes64(stats, wide, lens, bits);
+}
+
+// То же для частот всего входа (формат 1 и 2), которые бывают больше 32 бит
+void huff_stats_add_codes64(HuffStats* stats, const uint64_t* freq, const uint8_t* lens,
+                            uint64_t bits) {
+    uint64_t n = 0;
+    for (int i = 0; i < 256; i++) n += freq[i];
+    if (n == 0) return;
+
+    double log_n = log2((double)n);
+    for (int i = 0; i < 256; i++) {
+        if (freq[i] == 0) continue;
+        stats->code_lengths[bits ? lens[i] : 0] += freq[i];
+        stats->entropy_bits += (double)freq[i] * (log_n - log2((double)freq[i]));
+    }
+    stats->symbols += n;
+    stats->bits += bits;
+}
+
+// --- Сложение статистики задачи в статистику вызова ---
+void huff_stats_merge(HuffStats* to, const HuffStats* from) {
+    for (int p = 0; p < HUFF_PHASE_COUNT; p++) {
+        to->wall[p] += from->wall[p];
+        to->cpu[p] += from->cpu[p];
+    }
+    for (int i = 0; i < 64; i++) to->code_lengths[i] += from->code_lengths[i];
+    to->entropy_bits += from->entropy_bits;
+    to->symbols += from->symbols;
+    to->bits += from->bits;
+    to->stored_blocks += from->stored_blocks;
+    to->run_blocks += from->run_blocks;
+}
+
+// --- Начало вызова: статистика и прогресс отсчитываются заново ---
+void huff_stats_begin(HuffContext* ctx) {
+    if (ctx->options.progress) ctx->progress_time = huff_wall_time();
+    if (!ctx->options.stats) return;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->stats_wall = huff_wall_time();
+    ctx->stats_cpu = huff_process_time();
+}
+
+// --- Конец вызова: итоги уходят в options.stats ---
+void huff_stats_end(HuffContext* ctx, uint64_t bytes_in, uint64_t bytes_out) {
+    if (!ctx->options.stats) return;
+    ctx->stats.total_wall = huff_wall_time() - ctx->stats_wall;
+    ctx->stats.total_cpu = huff_process_time() - ctx->stats_cpu;
+    ctx->stats.bytes_in = bytes_in;
+    ctx->stats.bytes_out = bytes_out;
+    *ctx->options.stats = ctx->stats;
+}
+
+// --- Отчёт о прогрессе не чаще раза в HUFF_PROGRESS_INTERVAL секунд ---
+// final — последний отчёт вызова, он уходит всегда.
+void huff_progress(HuffContext* ctx, uint64_t done, uint64_t total, int final) {
+    if (!ctx->options.progress) return;
+    double now = huff_wall_time();
+    if (!final && now - ctx->progress_time < HUFF_PROGRESS_INTERVAL) return;
+    ctx->progress_time = now;
+    ctx->options.progress(ctx->options.progress_user, done, total);
+}
+
+// --- Печать статистики ---
+void huff_print_stats(FILE* f, const HuffStats* stats) {
+    fprintf(f, "\n=== Statistics ===\n");
+    fprintf(f, "%-10s %10s %10s\n", "phase", "wall ms", "cpu ms");
+    for (int p = 0; p < HUFF_PHASE_COUNT; p++) {
+        fprintf(f, "%-10s %10.3f %10.3f\n", phase_names[p],
+                stats->wall[p] * 1e3, stats->cpu[p] * 1e3);
+    }
+    fprintf(f, "%-10s %10.3f %10.3f\n", "total", stats->total_wall * 1e3,
+            stats->total_cpu * 1e3);
+
+    fprintf(f, "Bytes:       %lu in, %lu out", (unsigned long)stats->bytes_in,
+            (unsigned long)stats->bytes_out);
+    if (stats->total_wall > 0) {
+        fprintf(f, " (%.1f MB/s)", stats->symbols / stats->total_wall / 1e6);
+    }
+    fprintf(f, "\nSymbols:     %lu, bits: %lu, blocks: %lu", (unsigned long)stats->symbols,
+            (unsigned long)stats->bits, (unsigned long)stats->blocks);
+    if (stats->stored_blocks || stats->run_blocks) {
+        fprintf(f, " (stored %lu, runs %lu)", (unsigned long)stats->stored_blocks,
+                (unsigned long)stats->run_blocks);
+    }
+    fprintf(f, "\n");
+
+    // Длины кодов есть только у кодирования
+    uint64_t coded = 0;
+    for (int len = 0; len < 64; len++) coded += stats->code_lengths[len];
+    if (coded == 0) return;
+
+    double average = (double)stats->bits / coded;
+    double entropy = stats->entropy_bits / coded;
+    fprintf(f, "Code length: %.4f bits/symbol, entropy %.4f", average, entropy);
+    if (entropy > 0) fprintf(f, " (+%.2f%%)", 100.0 * (average - entropy) / entropy);
+    fprintf(f, "\n");
+    fprintf(f, "Symbols by code length:\n");
+    for (int len = 0; len < 64; len++) {
+        if (stats->code_lengths[len] == 0) continue;
+        fprintf(f, "  %2d bits: %12lu (%5.2f%%)%s\n", len,
+                (unsigned long)stats->code_lengths[len],
+                100.0 * stats->code_lengths[len] / coded,
+                len == 0 ? "  single-symbol and run blocks" : "");
+    }
+}
@@ -0,0 +1,481 @@
+#include "huffman_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+// --- Упаковка элементов таблицы ---
+#define ENTRY_LEN(e)   ((e) & 63u)
+#define ENTRY_SUB(e)   (((e) >> 6) & 15u)
+#define ENTRY_VALUE(e) ((e) >> 10)
+#define MAKE_ENTRY(value, len, sub) \
+    (((uint32_t)(value) << 10) | ((uint32_t)(sub) << 6) | (uint32_t)(len))
+#define MAKE_PAIR(sym1, sym2, len, count) \
+    ((uint32_t)(sym1) | ((uint32_t)(sym2) << 8) | ((uint32_t)(len) << 16) | \
+     ((uint32_t)(count) << 22))
+
+// --- Локальные функции ---
+static int grow_table(HuffDecodeTable* table, uint32_t extra);
+static int fill_level(HuffDecodeTable* table, uint32_t base, int width,
+                      int consumed, const int* syms, int n,
+                      const uint64_t* words, const uint8_t* lens);
+static int build_pairs(HuffDecodeTable* table);
+
+// --- Увеличение таблицы на extra элементов (новые обнулены) ---
+// Память остаётся от прошлых построений и растёт удвоением.
+int grow_table(HuffDecodeTable* table, uint32_t extra) {
+    uint32_t size = table->size + extra;
+    if (size > table->cap) {
+        uint32_t cap = table->cap ? table->cap : size;
+        while (cap < size) cap *= 2;
+        uint32_t* grown = (uint32_t*)realloc(table->entries, cap * sizeof(uint32_t));
+        if (!grown) return 0;
+        table->entries = grown;
+        table->cap = cap;
+    }
+
+    memset(table->entries + table->size, 0, extra * sizeof(uint32_t));
+    table->size = size;
+    return 1;
+}
+
+// --- Заполнение одного уровня таблицы ---
+// Символы, чей остаток кода помещается в width бит, становятся листьями
+// (с повторением по свободным младшим битам). Остальные группируются по
+// префиксу и уходят в подтаблицы следующего уровня.
+int fill_level(HuffDecodeTable* table, uint32_t base, int width,
+               int consumed, const int* syms, int n,
+               const uint64_t* words, const uint8_t* lens) {
+    for (int i = 0; i < n; i++) {
+        int s = syms[i];
+        int rem = lens[s] - consumed;
+        if (rem > width) continue;
+
+        uint64_t tail = words[s] & ((1ull << rem) - 1);
+        uint32_t start = (uint32_t)(tail << (width - rem));
+        uint32_t span = 1u << (width - rem);
+        for (uint32_t j = 0; j < span; j++) {
+            table->entries[base + start + j] = MAKE_ENTRY(s, rem, 0);
+        }
+    }
+
+    int group[256];
+    for (int i = 0; i < n; i++) {
+        int s = syms[i];
+        int rem = lens[s] - consumed;
+        if (rem <= width) continue;
+
+        uint32_t prefix = (uint32_t)((words[s] >> (rem - width)) & ((1u << width) - 1));
+        if (table->entries[base + prefix] != 0) continue;  // Группа уже построена
+
+        // Собираем всех с тем же префиксом и ищем самый длинный остаток
+        int count = 0;
+        int longest = 0;
+        for (int j = i; j < n; j++) {
+            int t = syms[j];
+            int r = lens[t] - consumed;
+            if (r <= width) continue;
+            if (((words[t] >> (r - width)) & ((1u << width) - 1)) != prefix) continue;
+            group[count++] = t;
+            if (r - width > longest) longest = r - width;
+        }
+
+        int sub = longest < HUFF_SUBTABLE_BITS ? longest : HUFF_SUBTABLE_BITS;
+        uint32_t offset = table->size;
+        if (offset >= (1u << 22) || !grow_table(table, 1u << sub)) return 0;
+
+        table->entries[base + prefix] = MAKE_ENTRY(offset, width, sub);
+        if (!fill_level(table, offset, sub, consumed + width, group, count,
+                        words, lens)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// --- Таблица пар по готовой первичной таблице ---
+// Второй символ берётся по тем же root_bits битам, сдвинутым на длину
+// первого кода: он годится, только если его код целиком среди известных
+// бит (len2 <= root_bits - len1). Коды длиннее первичной таблицы остаются
+// одиночными и идут по подтаблицам.
+int build_pairs(HuffDecodeTable* table) {
+    if (!table->pairs) {
+        table->pairs = (uint32_t*)malloc(sizeof(uint32_t) << HUFF_TABLE_MAX_ROOT_BITS);
+        if (!table->pairs) return 0;
+    }
+
+    const uint32_t* entries = table->entries;
+    const int root_bits = table->root_bits;
+    const uint32_t mask = (1u << root_bits) - 1;
+    for (uint32_t i = 0; i <= mask; i++) {
+        uint32_t e = entries[i];
+        if (ENTRY_SUB(e)) {
+            table->pairs[i] = 0;
+            continue;
+        }
+        uint32_t len = ENTRY_LEN(e);
+        uint32_t next = entries[(i << len) & mask];
+        if (!ENTRY_SUB(next) && ENTRY_LEN(next) <= root_bits - len) {
+            table->pairs[i] = MAKE_PAIR(ENTRY_VALUE(e), ENTRY_VALUE(next),
+                                        len + ENTRY_LEN(next), 2);
+        } else {
+            table->pairs[i] = MAKE_PAIR(ENTRY_VALUE(e), 0, len, 1);
+        }
+    }
+    return 1;
+}
+
+// --- Построение таблицы декодирования по кодовым словам ---
+// words[s] — код символа s (младшие lens[s] бит, старший бит идёт первым),
+// lens[s] == 0 — символ отсутствует. Код должен быть полным префиксным,
+// иначе возвращается 0.
+int huff_table_build(HuffDecodeTable* table, const uint64_t* words,
+                     const uint8_t* lens) {
+    table->size = 0;
+    table->root_bits = 0;
+    table->max_len = 0;
+
+    int syms[256];
+    int n = 0;
+    for (int s = 0; s < 256; s++) {
+        if (lens[s] == 0) continue;
+        if (lens[s] > HUFF_MAX_DECODE_LEN) return 0;
+        syms[n++] = s;
+        if (lens[s] > table->max_len) table->max_len = lens[s];
+    }
+    if (n == 0) return 0;
+
+    int root_bits = table->max_len <= HUFF_TABLE_MAX_ROOT_BITS ? table->max_len
+                                                               : HUFF_TABLE_BITS;
+    if (!grow_table(table, 1u << root_bits) ||
+        !fill_level(table, 0, root_bits, 0, syms, n, words, lens)) {
+        huff_table_free(table);
+        return 0;
+    }
+    table->root_bits = root_bits;
+
+    // В полном коде каждый элемент занят; пустой означает битый заголовок
+    for (uint32_t i = 0; i < table->size; i++) {
+        if (table->entries[i] == 0) {
+            huff_table_free(table);
+            return 0;
+        }
+    }
+
+    if (!build_pairs(table)) {
+        huff_table_free(table);
+        return 0;
+    }
+    return 1;
+}
+
+// --- Освобождение таблицы ---
+void huff_table_free(HuffDecodeTable* table) {
+    free(table->entries);
+    free(table->pairs);
+    table->entries = NULL;
+    table->pairs = NULL;
+    table->size = 0;
+    table->cap = 0;
+}
+
+// --- Инициализация чтения битов ---
+void bit_reader_init(BitReader* br, const uint8_t* data, size_t size) {
+    br->bits = 0;
+    br->count = 0;
+    br->pad = 0;
+    br->p = data;
+    br->end = data + size;
+}
+
+// --- Дозагрузка буфера до 56+ бит ---
+HUFF_INLINE void bit_reader_refill(BitReader* br) {
+    if (br->end - br->p >= 8) {
+        const uint8_t* p = br->p;
+        uint64_t v = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+                     ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+                     ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+                     ((uint64_t)p[6] << 8)  |  (uint64_t)p[7];
+        br->bits |= v >> br->count;
+        br->p += (63 - br->count) >> 3;
+        br->count |= 56;
+        return;
+    }
+
+    // Хвост потока: дочитываем по байту, за концом подставляем нули
+    while (br->count <= 56) {
+        uint64_t byte = 0;
+        if (br->p < br->end) {
+            byte = *br->p++;
+        } else {
+            br->pad += 8;
+        }
+        br->bits |= byte << (56 - br->count);
+        br->count += 8;
+    }
+}
+
+// --- Пропуск bits < 8 бит: поток начинается с середины байта ---
+void bit_reader_skip(BitReader* br, int bits) {
+    bit_reader_refill(br);
+    br->bits <<= bits;
+    br->count -= bits;
+}
+
+// --- Декодирование одного символа по таблице ---
+HUFF_INLINE uint8_t decode_one(const uint32_t* entries, int root_bits, BitReader* br) {
+    uint32_t e = entries[br->bits >> (64 - root_bits)];
+    while (ENTRY_SUB(e)) {
+        br->bits <<= ENTRY_LEN(e);
+        br->count -= ENTRY_LEN(e);
+        e = entries[ENTRY_VALUE(e) + (br->bits >> (64 - ENTRY_SUB(e)))];
+    }
+    br->bits <<= ENTRY_LEN(e);
+    br->count -= ENTRY_LEN(e);
+    return (uint8_t)ENTRY_VALUE(e);
+}
+
+// --- Декодирование одного или двух символов за просмотр ---
+// Пишет out[0] и out[1] (второй — даже если символ один), возвращает,
+// сколько символов декодировано. Снимает не больше root_bits бит, кроме
+// кодов длиннее первичной таблицы.
+HUFF_INLINE size_t decode_pair(const uint32_t* pairs, const uint32_t* entries,
+                               int root_bits, BitReader* br, uint8_t* out) {
+    uint32_t pair = pairs[br->bits >> (64 - root_bits)];
+    if (PAIR_COUNT(pair) == 0) {
+        out[0] = decode_one(entries, root_bits, br);
+        return 1;
+    }
+    out[0] = (uint8_t)PAIR_SYM1(pair);
+    out[1] = (uint8_t)PAIR_SYM2(pair);
+    br->bits <<= PAIR_LEN(pair);
+    br->count -= PAIR_LEN(pair);
+    return PAIR_COUNT(pair);
+}
+
+// --- Декодирование потока символов ---
+// Декодирует не больше max_symbols символов. Если final == 0, останавливается,
+// когда во входном буфере осталось меньше 8 байт: вызывающий дочитывает
+// данные и продолжает. При final != 0 недостающие биты считаются нулями;
+// выход за конец потока виден по br->count < br->pad.
+HUFF_INLINE size_t decode_symbols(const HuffDecodeTable* table, BitReader* br,
+                               uint8_t* out, size_t max_symbols, int final) {
+    const uint32_t* entries = table->entries;
+    const uint32_t* pairs = table->pairs;
+    const int root_bits = table->root_bits;
+    const int max_len = table->max_len;
+    size_t n = 0;
+
+    while (n < max_symbols) {
+        if (br->end - br->p < 8) {
+            if (!final) break;
+            if (br->count < br->pad) break;
+        }
+
+        bit_reader_refill(br);
+
+        // После дозагрузки в буфере 56+ бит: снимаем символы, пока
+        // гарантированно хватает бит на самый длинный код. Пара снимает не
+        // больше root_bits <= max_len бит; последний символ — по одному,
+        // чтобы не писать за max_symbols и не снимать чужие биты.
+        do {
+            if (max_symbols - n >= 2) n += decode_pair(pairs, entries, root_bits, br, out + n);
+            else out[n++] = decode_one(entries, root_bits, br);
+        } while (br->count >= max_len && n < max_symbols);
+    }
+
+    return n;
+}
+
+// --- Декодирование блока из четырёх потоков ---
+// Поток k несёт символы out[k * seg ...], seg = ceil(n / 4), последний —
+// остаток до n. Соседние символы одного потока зависят друг от друга через
+// позицию в буфере, а четыре потока — нет, поэтому процессор ведёт четыре
+// цепочки одновременно. sizes — длины потоков в байтах, потоки лежат в src
+// подряд. Возвращает 1, если каждый поток дал ровно свои символы.
+HUFF_INLINE int decode_four_streams(const HuffDecodeTable* table, const uint8_t* src,
+                                    const size_t* sizes, uint8_t* out, size_t n) {
+    const uint32_t* entries = table->entries;
+    const uint32_t* pairs = table->pairs;
+    const int root_bits = table->root_bits;
+    const size_t seg = (n + 3) / 4;
+
+    BitReader br[4];
+    uint8_t* dst[4];
+    uint8_t* lim[4];
+    for (int k = 0; k < 4; k++) {
+        bit_reader_init(&br[k], src, sizes[k]);
+        src += sizes[k];
+        dst[k] = out + ((size_t)k * seg < n ? (size_t)k * seg : n);
+        lim[k] = out + ((size_t)(k + 1) * seg < n ? (size_t)(k + 1) * seg : n);
+    }
+
+    // 1. Общий цикл: после дозагрузки в каждом буфере 56+ бит, этого
+    //    хватает на per просмотров подряд без проверок; просмотр даёт до
+    //    двух символов, поэтому места в выходе нужно на 2 * per
+    const int per = 56 / table->max_len;
+    const ptrdiff_t room = 2 * per;
+    while (br[0].end - br[0].p >= 8 && br[1].end - br[1].p >= 8 &&
+           br[2].end - br[2].p >= 8 && br[3].end - br[3].p >= 8 &&
+           lim[0] - dst[0] >= room && lim[1] - dst[1] >= room &&
+           lim[2] - dst[2] >= room && lim[3] - dst[3] >= room) {
+        bit_reader_refill(&br[0]);
+        bit_reader_refill(&br[1]);
+        bit_reader_refill(&br[2]);
+        bit_reader_refill(&br[3]);
+        for (int i = 0; i < per; i++) {
+            dst[0] += decode_pair(pairs, entries, root_bits, &br[0], dst[0]);
+            dst[1] += decode_pair(pairs, entries, root_bits, &br[1], dst[1]);
+            dst[2] += decode_pair(pairs, entries, root_bits, &br[2], dst[2]);
+            dst[3] += decode_pair(pairs, entries, root_bits, &br[3], dst[3]);
+        }
+    }
+
+    // 2. Хвосты потоков — обычным декодером
+    int ok = 1;
+    for (int k = 0; k < 4; k++) {
+        size_t want = (size_t)(lim[k] - dst[k]);
+        size_t got = decode_symbols(table, &br[k], dst[k], want, 1);
+        if (got != want || br[k].count < br[k].pad) ok = 0;
+    }
+    return ok;
+}
+
+// --- Декодирование с таблицей по предыдущему символу ---
+// Как huff_decode_symbols при final != 0; перед out[0] считается байт prev.
+HUFF_INLINE size_t decode_symbols_order1(const HuffOrder1Tables* tables, BitReader* br,
+                                      uint8_t* out, size_t max_symbols, int prev) {
+    const int max_len = tables->max_len;
+    size_t n = 0;
+
+    while (n < max_symbols) {
+        if (br->end - br->p < 8 && br->count < br->pad) break;
+
+        bit_reader_refill(br);
+        do {
+            prev = decode_one(tables->entries[prev], tables->root_bits[prev], br);
+            out[n++] = (uint8_t)prev;
+        } while (br->count >= max_len && n < max_symbols);
+    }
+
+    return n;
+}
+
+// --- Декодирование блока из четырёх потоков с таблицами по контексту ---
+// Раскладка потоков — как у huff_decode_four_streams; каждый поток
+// начинается с контекста 0. Следующая таблица зависит от только что
+// декодированного символа, поэтому цепочка одного потока длиннее, чем без
+// контекстов, и четыре независимых потока выигрывают ещё больше.
+HUFF_INLINE int decode_four_streams_order1(const HuffOrder1Tables* tables, const uint8_t* src,
+                                           const size_t* sizes, uint8_t* out, size_t n) {
+    const size_t seg = (n + 3) / 4;
+
+    BitReader br[4];
+    uint8_t* dst[4];
+    uint8_t* lim[4];
+    int prev[4] = {0, 0, 0, 0};
+    for (int k = 0; k < 4; k++) {
+        bit_reader_init(&br[k], src, sizes[k]);
+        src += sizes[k];
+        dst[k] = out + ((size_t)k * seg < n ? (size_t)k * seg : n);
+        lim[k] = out + ((size_t)(k + 1) * seg < n ? (size_t)(k + 1) * seg : n);
+    }
+
+    // 1. Общий цикл, как без контекстов
+    const int per = 56 / tables->max_len;
+    while (br[0].end - br[0].p >= 8 && br[1].end - br[1].p >= 8 &&
+           br[2].end - br[2].p >= 8 && br[3].end - br[3].p >= 8 &&
+           lim[0] - dst[0] >= per && lim[1] - dst[1] >= per &&
+           lim[2] - dst[2] >= per && lim[3] - dst[3] >= per) {
+        bit_reader_refill(&br[0]);
+        bit_reader_refill(&br[1]);
+        bit_reader_refill(&br[2]);
+        bit_reader_refill(&br[3]);
+        for (int i = 0; i < per; i++) {
+            for (int k = 0; k < 4; k++) {
+                prev[k] = decode_one(tables->entries[prev[k]], tables->root_bits[prev[k]],
+                                     &br[k]);
+                *dst[k]++ = (uint8_t)prev[k];
+            }
+        }
+    }
+
+    // 2. Хвосты потоков
+    int ok = 1;
+    for (int k = 0; k < 4; k++) {
+        size_t want = (size_t)(lim[k] - dst[k]);
+        size_t got = decode_symbols_order1(tables, &br[k], dst[k], want, prev[k]);
+        if (got != want || br[k].count < br[k].pad) ok = 0;
+    }
+    return ok;
+}
+
+// --- Варианты под процессор ---
+// Тела выше встраиваются в каждую обёртку. С BMI2 сдвиги на переменную
+// длину (индекс в таблице, снятие кода, дозагрузка) идут через shlx/shrx:
+// без регистра cl и без записи флагов, цепочка символа короче.
+#ifdef HUFF_HAVE_X86_KERNELS
+HUFF_TARGET("bmi,bmi2")
+static size_t decode_symbols_bmi2(const HuffDecodeTable* table, BitReader* br,
+                                  uint8_t* out, size_t max_symbols, int final) {
+    return decode_symbols(table, br, out, max_symbols, final);
+}
+
+HUFF_TARGET("bmi,bmi2")
+static int decode_four_streams_bmi2(const HuffDecodeTable* table, const uint8_t* src,
+                                    const size_t* sizes, uint8_t* out, size_t n) {
+    return decode_four_streams(table, src, sizes, out, n);
+}
+
+HUFF_TARGET("bmi,bmi2")
+static size_t decode_symbols_order1_bmi2(const HuffOrder1Tables* tables, BitReader* br,
+                                         uint8_t* out, size_t max_symbols, int prev) {
+    return decode_symbols_order1(tables, br, out, max_symbols, prev);
+}
+
+HUFF_TARGET("bmi,bmi2")
+static int decode_four_streams_order1_bmi2(const HuffOrder1Tables* tables,
+                                           const uint8_t* src, const size_t* sizes,
+                                           uint8_t* out, size_t n) {
+    return decode_four_streams_order1(tables, src, sizes, out, n);
+}
+#endif
+
+size_t huff_decode_symbols(const HuffDecodeTable* table, BitReader* br,
+                           uint8_t* out, size_t max_symbols, int final) {
+#ifdef HUFF_HAVE_X86_KERNELS
+    if (huff_cpu_level() >= HUFF_CPU_BMI2) {
+        return decode_symbols_bmi2(table, br, out, max_symbols, final);
+    }
+#endif
+    return decode_symbols(table, br, out, max_symbols, final);
+}
+
+int huff_decode_four_streams(const HuffDecodeTable* table, const uint8_t* src,
+                             const size_t* sizes, uint8_t* out, size_t n) {
+#ifdef HUFF_HAVE_X86_KERNELS
+    if (huff_cpu_level() >= HUFF_CPU_BMI2) {
+        return decode_four_streams_bmi2(table, src, sizes, out, n);
+    }
+#endif
+    return decode_four_streams(table, src, sizes, out, n);
+}
+
+size_t huff_decode_symbols_order1(const HuffOrder1Tables* tables, BitReader* br,
+                                  uint8_t* out, size_t max_symbols, int prev) {
+#ifdef HUFF_HAVE_X86_KERNELS
+    if (huff_cpu_level() >= HUFF_CPU_BMI2) {
+        return decode_symbols_order1_bmi2(tables, br, out, max_symbols, prev);
+    }
+#endif
+    return decode_symbols_order1(tables, br, out, max_symbols, prev);
+}
+
+int huff_decode_four_streams_order1(const HuffOrder1Tables* tables, const uint8_t* src,
+                                    const size_t* sizes, uint8_t* out, size_t n) {
+#ifdef HUFF_HAVE_X86_KERNELS
+    if (huff_cpu_level() >= HUFF_CPU_BMI2) {
+        return decode_four_streams_order1_bmi2(tables, src, sizes, out, n);
+    }
+#endif
+    return decode_four_streams_order1(tables, src, sizes, out, n);
+}
@@ -52,12 +52,230 @@ void test_encoding_decoding(const char* filename) {
     printf("Temporary files removed.\n");
 }
 
+// --- Режим командной строки ---
+//   huffman -c|-d|-t [-a] [-x K] [-j N] [-r] [-f] [-q] [--stats] [--no-checksum]
+//           [--seek N] [--range СМЕЩЕНИЕ:ДЛИНА] [--io map|threads|uring]
+//           [-o ВЫХОД] ФАЙЛ|КАТАЛОГ ...
+// -c сжимает a в a.huff, -d распаковывает a.huff в a, -t сжимает и
+// распаковывает в памяти и сверяет. Файлы обрабатываются параллельно в
+// N потоков (по умолчанию по числу ядер), -r обходит каталоги, -f
+// перезаписывает существующие выходы, -q оставляет только ошибки и сводку.
+// -a сжимает в адаптивный формат: каждая порция входа сразу уходит кадром,
+// и распаковка на другом конце канала отдаёт её, не дожидаясь остального.
+// -x K кодирует блоки таблицами по предыдущему байту, собранными в K
+// кластеров (2..16): для текста это заметно короче одной таблицы.
+// Блоки и весь файл несут CRC32C, распаковка сверяет их по ходу;
+// --no-checksum их не пишет (на 4 байта на блок короче).
+// --seek N ставит в блоках отметки через каждые N КБ исходных данных, и
+// -d --range СМЕЩЕНИЕ:ДЛИНА распаковывает единственного входа только этот
+// кусок (по умолчанию в stdout), декодируя от ближайшей отметки перед ним.
+// --io threads читает и пишет файлы отдельными потоками, пока идёт
+// кодирование, --io uring — то же через io_uring (если ядро не даёт его,
+// через pread/pwrite); по умолчанию файлы отображаются в память.
+// Имя "-" — stdin, и тогда выход идёт в stdout, поэтому программу можно
+// ставить в конвейер:
+//   tail -F app.log | huffman -c -a - | ...
+// Отчёт о работе при выводе в stdout уходит в stderr.
+//   huffman --train ID ТАБЛИЦА ФАЙЛ ...
+// обучает статическую таблицу для коротких сообщений на файлах-образцах,
+// записывает её в файл ТАБЛИЦА и печатает длины кодов инициализатором C,
+// чтобы таблицу можно было встроить в библиотеку.
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -c|-d|-t [-a] [-x K] [-j N] [-r] [-f] [-q] [--stats] [--no-checksum]\n"
+            "          [--seek N] [--range OFFSET:LENGTH] [--io map|threads|uring]\n"
+            "          [-o OUTPUT] FILE|DIR ...\n"
+            "  -c  compress FILE to FILE.huff      -d  decompress FILE.huff to FILE\n"
+            "  -t  compress and decompress in memory and compare\n"
+            "  -a  adaptive format: no tables, each input chunk flushed as a frame\n"
+            "  -x  K tables chosen by the previous byte (2..16), better for text\n"
+            "  -j  files processed in parallel (default: number of CPUs)\n"
+            "  -r  recurse into directories         -f  overwrite existing outputs\n"
+            "  -q  print only errors and the summary\n"
+            "  --no-checksum  do not store CRC32C of blocks and of the file\n"
+            "  --seek N       seek points every N KiB inside blocks\n"
+            "  --range OFFSET:LENGTH  with -d, decompress only this part (default: stdout)\n"
+            "  --io MODE      map files (default) or overlap I/O with coding in reader\n"
+            "                 and writer threads: threads (pread/pwrite) or uring\n"
+            "  -o  output name for a single input   \"-\" reads stdin, writes stdout\n"
+            "       %s --train ID TABLE FILE ...\n"
+            "  train a static table for short messages (ID 1..255) on sample files\n",
+            program, program);
+}
+
+// --- Обучение статической таблицы на образцах ---
+static int train_table(int argc, char* argv[]) {
+    int id = argc >= 5 ? atoi(argv[2]) : 0;
+    if (id < 1 || id > 255) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // 1. Частоты байтов всех образцов (образцы бывают больше 4 ГБ)
+    uint64_t freq[256] = {0};
+    uint64_t total = 0;
+    static uint8_t buf[1 << 16];
+    for (int i = 4; i < argc; i++) {
+        FILE* f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "Error: cannot open %s\n", argv[i]);
+            return 1;
+        }
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            huff_histogram64(buf, n, freq);
+            total += n;
+        }
+        fclose(f);
+    }
+
+    // 2. Таблица
+    HuffStaticTable table;
+    uint32_t model[256];
+    huff_scale_frequencies(freq, model);
+    huff_static_train(&table, id, model);
+    if (huff_static_save(&table, argv[3]) != HUFF_OK) {
+        fprintf(stderr, "Error: cannot write %s\n", argv[3]);
+        return 1;
+    }
+
+    double bits = 0;
+    for (int i = 0; i < 256; i++) bits += (double)freq[i] * table.lens[i];
+    printf("Table %d: %lu sample bytes, %.4f bits/symbol -> %s\n", id,
+           (unsigned long)total, total ? bits / total : 0.0, argv[3]);
+    for (int i = 0; i < 256; i++) {
+        printf("%s%2d,%s", i % 16 ? " " : "    ", table.lens[i], i % 16 == 15 ? "\n" : "");
+    }
+    return 0;
+}
+
+// --- Распаковка куска одного файла ---
+static int decompress_range(const HuffBatchOptions* batch, const char* input,
+                            const char* range) {
+    char* end;
+    uint64_t offset = strtoull(range, &end, 10);
+    uint64_t len = 0;
+    int colon = *end == ':';
+    if (colon) len = strtoull(end + 1, &end, 10);
+    if (!colon || *end != '\0') {
+        fprintf(stderr, "Error: bad range %s (expected OFFSET:LENGTH)\n", range);
+        return 2;
+    }
+
+    HuffContext* ctx = huff_context_create(&batch->options);
+    if (!ctx) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    const char* output = batch->output ? batch->output : "-";
+    HuffError err = huff_decompress_file_range(ctx, input, output, offset, len);
+    huff_context_free(ctx);
+    if (err != HUFF_OK) {
+        fprintf(stderr, "Error: %s: %s\n", input, huff_error_string(err));
+        return 1;
+    }
+    return 0;
+}
+
+static int run_command(int argc, char* argv[]) {
+    if (strcmp(argv[1], "--train") == 0) return train_table(argc, argv);
+
+    HuffBatchOptions batch;
+    huff_default_batch_options(&batch);
+    int mode = 0;
+    int first = argc;
+    const char* range = NULL;
+
+    // 1. Ключи до первого имени файла ("--" заканчивает ключи)
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--") == 0) {
+            first = i + 1;
+            break;
+        }
+        if (arg[0] != '-' || arg[1] == '\0') {
+            first = i;
+            break;
+        }
+        if (strcmp(arg, "-c") == 0 || strcmp(arg, "-d") == 0 || strcmp(arg, "-t") == 0) {
+            if (mode && mode != arg[1]) {
+                print_usage(argv[0]);
+                return 2;
+            }
+            mode = arg[1];
+        } else if (strcmp(arg, "-j") == 0 && i + 1 < argc) {
+            batch.jobs = atoi(argv[++i]);
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            batch.output = argv[++i];
+        } else if (strcmp(arg, "-x") == 0 && i + 1 < argc) {
+            batch.options.contexts = atoi(argv[++i]);
+            if (batch.options.contexts < 2 || batch.options.contexts > 16) {
+                print_usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(arg, "-a") == 0) {
+            batch.options.format = HUFF_FORMAT_ADAPTIVE;
+        } else if (strcmp(arg, "-r") == 0) {
+            batch.recursive = 1;
+        } else if (strcmp(arg, "-f") == 0) {
+            batch.force = 1;
+        } else if (strcmp(arg, "-q") == 0) {
+            batch.quiet = 1;
+        } else if (strcmp(arg, "--stats") == 0) {
+            batch.stats = 1;
+        } else if (strcmp(arg, "--no-checksum") == 0) {
+            batch.options.checksum = 0;
+        } else if (strcmp(arg, "--seek") == 0 && i + 1 < argc) {
+            int kib = atoi(argv[++i]);
+            if (kib < 1 || kib > (int)(UINT32_MAX / 1024)) {
+                print_usage(argv[0]);
+                return 2;
+            }
+            batch.options.seek_interval = (uint32_t)kib * 1024;
+        } else if (strcmp(arg, "--range") == 0 && i + 1 < argc) {
+            range = argv[++i];
+        } else if (strcmp(arg, "--io") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "map") == 0) {
+                batch.options.io = HUFF_IO_MAP;
+            } else if (strcmp(mode, "threads") == 0) {
+                batch.options.io = HUFF_IO_THREADS;
+            } else if (strcmp(mode, "uring") == 0) {
+                batch.options.io = HUFF_IO_URING;
+            } else {
+                print_usage(argv[0]);
+                return 2;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    // Контексты и отметки есть только в блочном формате
+    int adaptive = batch.options.format == HUFF_FORMAT_ADAPTIVE;
+    if (!mode || first >= argc || batch.jobs < 0 ||
+        (adaptive && (batch.options.contexts || batch.options.seek_interval)) ||
+        (range && (mode != 'd' || argc - first != 1))) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (range) return decompress_range(&batch, argv[first], range);
+
+    // 2. Работаем
+    batch.mode = mode == 'c' ? HUFF_BATCH_COMPRESS
+               : mode == 'd' ? HUFF_BATCH_DECOMPRESS
+                             : HUFF_BATCH_TEST;
+    return huff_batch(&batch, argv + first, argc - first) == 0 ? 0 : 1;
+}
+
 // --- Главная функция ---
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1) return run_command(argc, argv);
+
     int choice;
     char filename[256];
-    char encoded_filename[256];
-    char decoded_filename[256];
+    char encoded_filename[256 + 5];     // Имя и ".huff"
+    char decoded_filename[256 + 12];    // Имя и "_decoded.bin"
     char filename2[256];
 
     printf("=== HUFFMAN ENCODING PROGRAM ===\n");
@@ -141,7 +359,7 @@ int main() {
                 if (freq) {
                     char** codes = build_huffman_dictionary(freq);
                     if (codes) {
-                        print_dictionary(codes, freq);
+                        print_dictionary((const char**)codes, freq);
 
                         // Освобождаем память
                         for (int i = 0; i < 256; i++) free(codes[i]);